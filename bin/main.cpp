@@ -1,6 +1,7 @@
 #include"../testing/xorshift.hpp"
 #include<partitioner.hpp>
 #include<bloom_store.hpp>
+#include<placement.hpp>
 #include<iostream>
 #include<cstring>
 #include<cassert>
@@ -14,6 +15,7 @@
 #define DELTA 100000
 #define K 20
 #define V 44
+#define QUEUE_DEPTH 32
 
 void Truncate(std::string& path) {
     int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
@@ -27,24 +29,48 @@ void Truncate(std::string& path) {
     assert(error_code == 0);
 }
 
-int main() {
+int main(int argc, char** argv) {
     // mimicing the "linux" workload in the MSST article: https://ieeexplore.ieee.org/document/6232390
+    // partition files are spread over directories given in command line (one per device), weighted by capacity. 
+    // --budget <MiB> shares a memory budget among active buffers, --codec compresses flushed blocks. 
+    // both are off by default to keep the reference numbers, random values don't compress anyway. 
+    auto directories = std::vector<std::string>();
+    size_t budget_bytes = 0;
+    bool use_codec = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string{argv[i]} == "--budget" && i + 1 < argc) { budget_bytes = std::stoul(argv[++i]) << 20; }
+        else if (std::string{argv[i]} == "--codec") { use_codec = true; }
+        else { directories.push_back(argv[i]); }
+    }
+    if (directories.empty()) { directories.push_back("."); }
+    auto weights = std::vector<size_t>();
+    bloomstore::Placement::CapacityWeights(directories, weights);
+    auto placement = bloomstore::Placement(directories, weights, QUEUE_DEPTH);
+    auto codec = bloomstore::LZCodec();
     auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
     for (char i = 'a'; i <= 'z'; ++i) {
         for (char j = 'a'; j <= 'z'; ++j) {
-            auto path_kv = std::string{"./test-kv-"} + i + j;
-            auto path_bf = std::string{"./test-bf-"} + i + j;
+            auto name_kv = std::string{"test-kv-"} + i + j;
+            auto name_bf = std::string{"test-bf-"} + i + j;
+            auto device  = placement.Place(name_kv);
+            auto path_kv = device->Path(name_kv);
+            auto path_bf = device->Path(name_bf);
             Truncate(path_kv);
             Truncate(path_bf);
             bloom_store_replications.push_back(new bloomstore::BloomStore(
                 path_kv, path_bf,
                 8192, 11,   // bf_slots, bf_functions
                 K   , V,    // key_bytes, value_bytes
-                512 , 1024  // ram_capacity, align
+                512 , 1024, // ram_capacity, align
+                device
             ));
+            if (use_codec) { bloom_store_replications.back()->UseCodec(codec); }
         }
     }
+    // active buffers of all partitions would take 676 * 512 * (K + V) bytes, a budget lets hot partitions take most of it
+    auto budget = bloomstore::MemoryBudget(budget_bytes);
     auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications));
+    if (budget_bytes != 0) { partitioner.UseBudget(budget); }
     auto random_number_generator = xorshift::XorShift32(5);
     auto begin = std::chrono::steady_clock::now();
     for (int i = 0; i < TOTAL; ++i) {
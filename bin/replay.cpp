@@ -0,0 +1,166 @@
+#include"../testing/xorshift.hpp"
+#include<partitioner.hpp>
+#include<bloom_store.hpp>
+#include<placement.hpp>
+#include<trace.hpp>
+#include<iostream>
+#include<cstring>
+#include<cassert>
+#include<unistd.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<chrono>
+#include<thread>
+#include<algorithm>
+#include<array>
+
+#define QUEUE_DEPTH 32
+#define ALIGN 1024
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    if (fd < 0) {
+        std::cerr << "open: "   << path  << std::endl;
+        std::cerr << "errno: "  << errno << std::endl;
+        std::cerr << "fd: "     << fd    << std::endl;
+    }
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+void Report(const char* name, std::vector<uint64_t>& latencies) {
+    if (latencies.empty()) { return; }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] / 1000.0; };
+    std::cout << name << ": " << latencies.size() << " ops"
+              << ", p50 = "  << percentile(0.5)   << " [us]"
+              << ", p99 = "  << percentile(0.99)  << " [us]"
+              << ", p999 = " << percentile(0.999) << " [us]"
+              << ", max = "  << latencies.back() / 1000.0 << " [us]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    // replay a trace recorded by Partitioner::UseRecorder against a fresh store
+    // usage: replay <trace> [threads] [open|closed] [partitions] [bf_slots] [bf_funcs] [ram_capacity] [directories...]
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <trace> [threads] [open|closed] [partitions] [bf_slots] [bf_funcs] [ram_capacity] [directories...]" << std::endl;
+        return 1;
+    }
+    auto path_trace   = std::string{argv[1]};
+    size_t nthreads   = argc > 2 ? std::stoul(argv[2]) : 1;
+    bool open_loop    = argc > 3 && std::string{argv[3]} == "open";
+    size_t npartitions= argc > 4 ? std::stoul(argv[4]) : 64;
+    size_t bf_slots   = argc > 5 ? std::stoul(argv[5]) : 8192;
+    size_t bf_funcs   = argc > 6 ? std::stoul(argv[6]) : 11;
+    size_t capacity   = argc > 7 ? std::stoul(argv[7]) : 512;
+    auto directories = std::vector<std::string>();
+    for (int i = 8; i < argc; ++i) { directories.push_back(argv[i]); }
+    if (directories.empty()) { directories.push_back("."); }
+    auto reader = bloomstore::TraceReader(path_trace);
+    auto key_bytes = reader.KeyBytes();
+    auto value_bytes = reader.ValueBytes();
+    auto weights = std::vector<size_t>();
+    bloomstore::Placement::CapacityWeights(directories, weights);
+    auto placement = bloomstore::Placement(directories, weights, QUEUE_DEPTH);
+    // flushes never take the whole queue, so reads always find a slot soon
+    placement.Limit(IOClass::Flush, 0, QUEUE_DEPTH / 2);
+    // merges in a trace are replayed as counter increments
+    auto merge_operator = bloomstore::AddOperator();
+    auto instances = std::vector<bloomstore::BloomStore*>();
+    for (size_t i = 0; i < npartitions; ++i) {
+        auto name_kv = std::string{"replay-kv-"} + std::to_string(i);
+        auto name_bf = std::string{"replay-bf-"} + std::to_string(i);
+        auto device  = placement.Place(name_kv);
+        auto path_kv = device->Path(name_kv);
+        auto path_bf = device->Path(name_bf);
+        Truncate(path_kv);
+        Truncate(path_bf);
+        instances.push_back(new bloomstore::BloomStore(
+            path_kv, path_bf,
+            bf_slots, bf_funcs,
+            key_bytes, value_bytes,
+            capacity, ALIGN,
+            device
+        ));
+        instances.back()->UseMergeOperator(merge_operator);
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(instances));
+    // partition p is homed on node p % nodes, and thread t serves from node t % nodes. 
+    // with fewer threads than nodes some nodes have no thread, so nothing is pinned
+    auto nodes = Numa::Nodes();
+    bool is_pinned = nthreads >= nodes && nodes > 1;
+    if (is_pinned) { partitioner.UseNuma(); }
+    // every thread owns a disjoint set of partitions, so operations on a key stay in order. 
+    // partitions of a node are dealt round robin to the threads serving that node
+    auto owner = [&](uint32_t partition) -> size_t {
+        if (!is_pinned) { return partition % nthreads; }
+        size_t node = partitioner.HomeNode(partition);
+        size_t node_threads = (nthreads - node + nodes - 1) / nodes;
+        return node + nodes * (partition / nodes % node_threads);
+    };
+    auto work = std::vector<std::vector<bloomstore::TraceEntry>>(nthreads);
+    auto entry = bloomstore::TraceEntry();
+    while (reader.Next(entry)) {
+        work[owner(partitioner.Route(std::span{entry.key}))].push_back(entry);
+    }
+    auto get_latencies = std::vector<std::vector<uint64_t>>(nthreads);
+    auto put_latencies = std::vector<std::vector<uint64_t>>(nthreads);
+    auto begin = std::chrono::steady_clock::now();
+    auto threads = std::vector<std::thread>();
+    for (size_t t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&, t]() {
+            if (is_pinned) { partitioner.Serve(t % nodes); }
+            auto random_number_generator = xorshift::XorShift32(t + 1);
+            auto value = std::vector<uint8_t>(value_bytes);
+            for (auto& entry: work[t]) {
+                auto start = std::chrono::steady_clock::now();
+                if (open_loop) {
+                    // open loop issues operations on their recorded schedule, latency includes falling behind
+                    start = begin + std::chrono::nanoseconds(entry.timestamp);
+                    std::this_thread::sleep_until(start);
+                }
+                auto key = std::span{entry.key};
+                bool is_tombstone = false;
+                bool is_found = false;
+                switch (entry.op) {
+                    case bloomstore::TraceOp::Put: {
+                        random_number_generator.Fill(std::span{value});
+                        partitioner.Put(key, std::span{value});
+                        break;
+                    }
+                    case bloomstore::TraceOp::Del: {
+                        partitioner.Del(key);
+                        break;
+                    }
+                    case bloomstore::TraceOp::Get: {
+                        partitioner.Get(key, std::span{value}, is_tombstone, is_found);
+                        break;
+                    }
+                    case bloomstore::TraceOp::Merge: {
+                        random_number_generator.Fill(std::span{value});
+                        partitioner.Merge(key, std::span{value});
+                        break;
+                    }
+                }
+                auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                (entry.op == bloomstore::TraceOp::Get ? get_latencies[t] : put_latencies[t]).push_back(latency);
+            }
+        });
+    }
+    for (auto& thread: threads) { thread.join(); }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+    auto gets = std::vector<uint64_t>();
+    auto puts = std::vector<uint64_t>();
+    for (size_t t = 0; t < nthreads; ++t) {
+        gets.insert(gets.end(), get_latencies[t].begin(), get_latencies[t].end());
+        puts.insert(puts.end(), put_latencies[t].begin(), put_latencies[t].end());
+    }
+    std::cout << "Time = " << elapsed << " [ms]" << std::endl;
+    std::cout << "Throughput = " << (gets.size() + puts.size()) / (elapsed + 0.0001) * 1000 << " [ops/sec]" << std::endl;
+    Report("Get", gets);
+    Report("Put/Del", puts);
+    std::cout << "Disk reads = " << partitioner.StatDiskReadCount()
+              << " (" << partitioner.StatDiskReadCount() / (gets.size() + 0.0001) << " per get)" << std::endl;
+    std::cout << "False positives = " << partitioner.StatFalsePositive() << std::endl;
+}
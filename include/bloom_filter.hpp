@@ -1,12 +1,18 @@
 #pragma once
 #include<cstdint>
 #include<vector>
+#include<array>
 #include<span>
 #include<port.hpp>
 #include<functional>
 
+// the number of blocks per bloom chain, one of 64, 128, 256, 512
+#ifndef BLOOMSTORE_CHAIN_WIDTH
+#define BLOOMSTORE_CHAIN_WIDTH 64
+#endif
+
 namespace bloomstore {
-class BloomChain;
+template<size_t W> class BasicBloomChain;
 class BloomFilter;
 struct PtrIterator;
 
@@ -16,52 +22,78 @@ class BloomFilter {
     private:
     std::vector<bool> slots;
     uint32_t nfunc;
-    friend BloomChain;
+    template<size_t W> friend class BasicBloomChain;
 
     public:
     BloomFilter(size_t nslots, size_t nfunc);
     void Insert(std::span<uint8_t> key);
+    void InsertHashed(uint32_t hash_a, uint32_t hash_b);
     bool Test(std::span<uint8_t> key);
     void Clear();
 
 };
 
-/// @brief readonly bloom filters that can run in parallel
-class BloomChain {
+/// @brief readonly bloom filters that can run in parallel. 
+///        each slot is a W-bit word (W / 64 lanes), bit j of it belongs to block j, 
+///        so one probe covers W blocks. 
+template<size_t W = 64>
+class BasicBloomChain {
+
+    static_assert(W == 64 || W == 128 || W == 256 || W == 512);
+    static constexpr size_t LANES = W / 64;
+    using Word = std::array<uint64_t, LANES>;
 
     private:
-    std::vector<uint64_t> space;
+    AlignedBuffer<uint64_t> space;
     std::span<uint64_t> matrix;
     std::span<size_t> block_addresses;
+    size_t nslots;
     uint32_t nfunc;
     uint16_t chain_length;
+    void Sealed(Word& mask);
+    void Probe(uint32_t hash_a, uint32_t hash_b, Word& mask);
 
     public:
-    BloomChain(size_t nslots, size_t nfunc, size_t align);
+    BasicBloomChain(size_t nslots, size_t nfunc, size_t align);
     void Join(BloomFilter& filter, size_t block_address);
+    void Insert(std::span<uint8_t> key);
+    void InsertHashed(uint32_t hash_a, uint32_t hash_b);
+    void AtomicInsertHashed(uint32_t hash_a, uint32_t hash_b);
+    bool TestActive(std::span<uint8_t> key);
+    void Seal(size_t block_address);
     PtrIterator Test(std::span<uint8_t> key);
+    PtrIterator AtomicTest(std::span<uint8_t> key);
+    PtrIterator Enumerate();
+    void Relocate(std::function<size_t(size_t)> relocate);
     bool IsFull();
+    void Clear();
     void Dump(FileObject& file);
+    void Dump(std::function<void(std::span<uint8_t>)> dumper);
     void Load(std::function<void(std::span<uint8_t>)> loader);
+    void Attach(std::span<uint8_t> space);
+    size_t ByteSize();
+    void Bind(size_t node);
 
 };
 
-/// @brief pointer iterator for bloomchain
+/// @brief the chain width used by stores, chosen at build time
+using BloomChain = BasicBloomChain<BLOOMSTORE_CHAIN_WIDTH>;
+
+/// @brief pointer iterator for bloomchain, visiting set bits from the newest block to the oldest
 struct PtrIterator {
 
     private:
     std::span<size_t> block_addresses;
-    uint64_t bitmask;
-    uint8_t progress;
-    friend BloomChain;
+    std::array<uint64_t, 8> bitmask;
+    template<size_t W> friend class BasicBloomChain;
 
     public:
     PtrIterator(
         std::span<size_t> block_addresses,
-        uint64_t bitmask,
-        uint8_t progress
+        std::span<uint64_t> bitmask
     );
     void Next(size_t& address, bool& depleted);
+    void DropOldest(size_t ncolumns);
 
 };
 
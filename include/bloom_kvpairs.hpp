@@ -6,9 +6,13 @@
 #include <span>
 #include <functional>
 #include <port.hpp>
+#include <merge_operator.hpp>
 
 namespace bloomstore {
 
+using KVVisitor = std::function<void(std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone)>;
+using KeyVisitor = std::function<void(std::span<uint8_t> key)>;
+
 class BitSpan {
   
     private:
@@ -18,28 +22,58 @@ class BitSpan {
     BitSpan(std::span<uint8_t> space);
     const bool Get(size_t i);
     void Set(size_t i, bool v);
+    const bool AtomicGet(size_t i);
+    void AtomicSet(size_t i, bool v);
 
 };
 
 class KVPairs {
 
     private:
-    std::vector<uint8_t> space;
+    AlignedBuffer<uint8_t> space;
+    std::span<uint8_t>   header;
     BitSpan              tombstone;
-    std::span<uint8_t>   pairs;
+    BitSpan              operand;
+    std::span<uint8_t>   tags;
+    std::span<uint8_t>   keys;
+    std::span<uint8_t>   values;
     size_t size;
     size_t key_bytes;
     size_t value_bytes;
     size_t capacity;
+    bool fits_unflagged;
+    AlignedBuffer<uint64_t> index;
+    void Bind(std::span<uint8_t> space);
+    void ReadHeader();
+    size_t Probe(std::span<uint8_t> key, uint32_t hash);
+    void Index(std::span<uint8_t> key, size_t i);
+    void Reindex();
+    size_t Claim(std::span<uint8_t> key, bool& is_coalesced);
+    size_t Match(std::span<uint8_t> key, uint8_t tag, size_t size);
 
     public:
-    KVPairs(size_t key_bytes, size_t value_bytes, size_t capacity, size_t align);
-    void Put(std::span<uint8_t> key, std::span<uint8_t> value);
-    void Del(std::span<uint8_t> key);
+    KVPairs(size_t key_bytes, size_t value_bytes, size_t capacity, size_t align, bool indexed = false);
+    bool Put(std::span<uint8_t> key, std::span<uint8_t> value);
+    bool Del(std::span<uint8_t> key);
+    bool Merge(std::span<uint8_t> key, std::span<uint8_t> operand, MergeOperator& merge_operator);
+    bool Publish(size_t i, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone);
     void Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
+    std::span<uint8_t> View(std::span<uint8_t> key, bool& is_tombstone, bool& is_found);
+    std::span<uint8_t> View(std::span<uint8_t> key, bool& is_tombstone, bool& is_found, bool& is_operand);
+    std::span<uint8_t> ConcurrentView(std::span<uint8_t> key, bool& is_tombstone, bool& is_found, bool& is_operand);
+    void ForEach(KVVisitor visitor, KeyVisitor operand_visitor = nullptr);
     bool IsFull();
+    bool IsEmpty();
+    size_t Remaining();
+    size_t UsedBytes();
     void Dump(FileObject& file);
+    void Dump(std::function<void(std::span<uint8_t>)> dumper);
     void Load(std::function<void(std::span<uint8_t>)> loader);
+    void Attach(std::span<uint8_t> space);
+    AlignedBuffer<uint8_t> Fork();
+    size_t ByteSize();
+    size_t IndexByteSize();
+    void Bind(size_t node);
 
 };
 
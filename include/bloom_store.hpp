@@ -2,19 +2,86 @@
 #include<port.hpp>
 #include<bloom_kvpairs.hpp>
 #include<bloom_filter.hpp>
+#include<memory_budget.hpp>
+#include<write_batch.hpp>
+#include<codec.hpp>
+#include<event_loop.hpp>
+#include<atomic>
+#include<memory>
+#include<shared_mutex>
 
 namespace bloomstore
 {
 class Partitioner;
 
+/// @brief the outcome of an asynchronous get, the value is written to the caller's buffer
+struct Lookup {
+    bool is_tombstone = false;
+    bool is_found = false;
+};
+
+/// @brief a value read in place. pin keeps the buffer holding it alive (active buffer, loaded block or mapping) 
+///        until the view is destroyed, later writes don't change it. 
+struct ValueView {
+    bool is_tombstone = false;
+    bool is_found = false;
+    std::span<const uint8_t> value;
+    std::shared_ptr<void> pin;
+};
+
 class BloomStore {
 
     private:
+    /// @brief a freed range of a file, punched once no view pins the file and no follower may read it
+    struct Hole {
+        FileObject* file;
+        size_t offset;
+        size_t length;
+        // the sequence number of the first tail record without it, 0 until published
+        uint64_t sequence;
+    };
     FileObject f_bloom_chains;
     FileObject f_kv_pairs;
+    std::unique_ptr<FileObject> f_cold_bloom_chains;
+    std::unique_ptr<FileObject> f_cold_kv_pairs;
+    size_t cold_chains = 0;
+    size_t auto_hot_chains = SIZE_MAX;
+    size_t held_chains = 0;
+    std::vector<Hole> holes;
+    std::unique_ptr<FileObject> f_block_times;
+    std::vector<uint64_t> block_times;
+    std::vector<uint64_t> sealed_times;
+    std::vector<uint64_t> staged_block_times;
+    size_t ttl = 0;
+    size_t expired_chains = 0;
+    size_t reclaimed_chains = 0;
     BloomChain bloom_chain_collector;
-    BloomFilter active_bloom_filter;
     KVPairs     active_kv_pairs;
+    KVPairs     temp_kv_pairs;
+    BloomChain  temp_bloom_chain;
+    MemoryBudget* budget = nullptr;
+    size_t budget_id = 0;
+    std::vector<uint8_t> staged_kv_pairs;
+    std::vector<uint8_t> staged_bloom_chains;
+    bool is_staging = false;
+    bool is_writing = false;
+    bool is_loading = false;
+    MemoryBudget* load_budget = nullptr;
+    Codec* codec = nullptr;
+    MergeOperator* merge_operator = nullptr;
+    std::vector<uint8_t> compressed_block;
+    std::atomic<size_t> reserved{0};
+    std::atomic<size_t> generation{0};
+    // concurrent readers share it, sealing a block takes it alone
+    std::shared_mutex seal_mutex;
+    std::atomic<bool> is_sealing{false};
+    std::shared_ptr<AlignedBuffer<uint8_t>> active_pin;
+    std::unique_ptr<SharedRecord> tail;
+    uint64_t tail_sequence = 0;
+    size_t followed_chains = 0;
+    size_t followed_blocks = 0;
+    size_t followed_times = 0;
+    bool is_read_only;
     size_t size;
     size_t key_bytes;
     size_t value_bytes;
@@ -23,6 +90,47 @@ class BloomStore {
     size_t bloom_filter_nslots;
     size_t bloom_filter_nfuncs;
     void TryFlush();
+    void Seal();
+    void ConcurrentWrite(std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone);
+    void Commit(IOClass io_class = IOClass::Flush);
+    Task<void> AsyncCommit(EventLoop& loop);
+    Task<void> AsyncAppend(EventLoop& loop, FileObject& file, std::vector<uint8_t>& staged, size_t nbytes);
+    bool IsStaging();
+    std::span<uint8_t> StagedBlock(size_t address);
+    std::span<uint8_t> StagedChain(size_t position);
+    size_t ChainBytes();
+    size_t AppendBlock(std::span<uint8_t> block);
+    void AppendChain(std::span<uint8_t> chain);
+    void Unpin();
+    void PublishTail();
+    void AppendTimes();
+    size_t ExpiredChains();
+    size_t DroppedChains();
+    uint64_t Deadline(bool is_written);
+    void FollowTimes(size_t nchains);
+    void DropExpired(PtrIterator& pointer_iter, size_t chain);
+    size_t BlockBytes(size_t address);
+    void AddHole(size_t address);
+    void AddHole(FileObject& file, size_t offset, size_t length);
+    void PunchHoles();
+    void RecoverHoles();
+    void DropChain(size_t position);
+    void ReclaimChain();
+    void FreeChains(size_t end_chain);
+    void Checkpoint(size_t& end_chain, size_t& nsealed);
+    size_t ScanBlockAddresses(std::vector<size_t>& addresses, size_t end_chain, size_t nsealed);
+    void Find(std::span<uint8_t> key, std::span<uint8_t>& found, std::vector<uint8_t>& operands, bool& is_tombstone, bool& is_found, size_t oldest_chain);
+    bool Probe(std::span<uint8_t> key, size_t oldest_chain, bool& is_operand);
+    bool Visit(KVPairs& kvpairs, std::span<uint8_t> key, std::span<uint8_t>& value, std::vector<uint8_t>& operands, bool& is_tombstone, bool& is_found);
+    void Fold(std::vector<uint8_t>& operands, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
+    FileObject& BlockFile(size_t address);
+    FileObject& ChainFile(size_t position);
+    void LoadBlock(KVPairs& kvpairs, size_t address);
+    void ReadBlock(size_t address, std::span<uint8_t> space);
+    std::shared_ptr<void> PinBlock(KVPairs& kvpairs, size_t address);
+    void LoadChain(BloomChain& bloom_chain, size_t position);
+    Task<void> AsyncLoadBlock(EventLoop& loop, KVPairs& kvpairs, std::span<uint8_t> buffer, size_t address);
+    Task<void> AsyncLoadChain(EventLoop& loop, BloomChain& bloom_chain, std::span<uint8_t> buffer, size_t position);
     friend Partitioner;
 
     public:
@@ -38,12 +146,38 @@ class BloomStore {
         size_t key_bytes,
         size_t value_bytes,
         size_t kv_ram_capacity,
-        size_t align
+        size_t align,
+        Device* device = nullptr,
+        FileMode mode = FileMode::Direct,
+        bool is_read_only = false
     );
     ~BloomStore();
     void Put(std::span<uint8_t> key, std::span<uint8_t> value);
     void Del(std::span<uint8_t> key);
+    void Merge(std::span<uint8_t> key, std::span<uint8_t> operand);
+    void ConcurrentPut(std::span<uint8_t> key, std::span<uint8_t> value);
+    void ConcurrentDel(std::span<uint8_t> key);
+    void ConcurrentGet(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
     void Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
+    ValueView GetView(std::span<uint8_t> key);
+    Task<Lookup> AsyncGet(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value);
+    Task<void> AsyncPut(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value);
+    bool Write(WriteBatch& batch, size_t begin, size_t end);
+    void BulkLoad(std::span<uint8_t> records, std::span<size_t> offsets, bool is_last = true);
+    void Flush();
+    void UseBudget(MemoryBudget& budget);
+    void UseCodec(Codec& codec);
+    void UseMergeOperator(MergeOperator& merge_operator);
+    void UseColdTier(std::string& path_kv, std::string& path_bf, Device* device = nullptr, FileMode mode = FileMode::Direct);
+    bool Demote(size_t hot_chains, size_t nchains);
+    void AutoDemote(size_t hot_chains);
+    void UseTail(std::string& path_tail);
+    void UseTTL(std::string& path_times, size_t ttl_ms);
+    bool Expire(size_t nchains);
+    bool Refresh();
+    void Bind(size_t node);
+    void ScanBlockAddresses(std::vector<size_t>& addresses);
+    void ScanBlock(size_t address, KVVisitor visitor);
 
 };
 
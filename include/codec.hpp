@@ -0,0 +1,29 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+#include<span>
+
+namespace bloomstore {
+
+/// @brief block compression algorithm, pluggable per store
+class Codec {
+
+    public:
+    virtual ~Codec() = default;
+    virtual void Compress(std::span<uint8_t> input, std::vector<uint8_t>& output) = 0;
+    virtual void Decompress(std::span<uint8_t> input, std::span<uint8_t> output) = 0;
+
+};
+
+/// @brief byte oriented lz77 compressor using lz4 block format. 
+///        it keeps no state between calls, so one codec can be shared by stores written from several threads. 
+class LZCodec: public Codec {
+
+    public:
+    void Compress(std::span<uint8_t> input, std::vector<uint8_t>& output) override;
+    void Decompress(std::span<uint8_t> input, std::span<uint8_t> output) override;
+
+};
+
+} // namespace bloomstore
@@ -0,0 +1,121 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<coroutine>
+#include<exception>
+#include<optional>
+#include<utility>
+#include<deque>
+#include<vector>
+#include<span>
+#include<type_traits>
+#include<port.hpp>
+
+namespace bloomstore {
+template<typename T> class Task;
+
+/// @brief the part of a task promise shared by all result types
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    /// @brief a finished task resumes whoever awaited it, or gives control back to event loop
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept { return handle.promise().continuation; }
+        void await_resume() noexcept {}
+    };
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template<typename T>
+struct TaskPromise: TaskPromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T value) { this->value = std::move(value); }
+};
+
+template<>
+struct TaskPromise<void>: TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+/// @brief a lazily started coroutine, it runs when awaited or spawned on an event loop
+template<typename T = void>
+class Task {
+
+    public:
+    using promise_type = TaskPromise<T>;
+
+    private:
+    std::coroutine_handle<promise_type> handle;
+    friend class EventLoop;
+
+    public:
+    explicit Task(std::coroutine_handle<promise_type> handle): handle{handle} {}
+    Task(Task&& other) noexcept: handle{std::exchange(other.handle, nullptr)} {}
+    Task(const Task&) = delete;
+    ~Task() { if (this->handle) { this->handle.destroy(); } }
+    bool await_ready() { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+        this->handle.promise().continuation = caller;
+        return this->handle;
+    }
+    T await_resume() {
+        if constexpr (!std::is_void_v<T>) { return std::move(*this->handle.promise().value); }
+    }
+    bool IsDone() { return this->handle.done(); }
+
+};
+
+template<typename T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/// @brief a single threaded loop driving tasks, which suspend on disk reads and appends. 
+///        run one loop per core, each keeps up to depth requests in flight. 
+class EventLoop {
+
+    private:
+    struct PendingIO {
+        FileObject* file;
+        size_t position;
+        std::span<uint8_t> bytes;
+        std::coroutine_handle<> handle;
+        bool is_append;
+    };
+    AsyncIO io;
+    std::deque<std::coroutine_handle<>> ready;
+    std::deque<PendingIO> waiting;
+    std::vector<Task<void>> spawned;
+    std::vector<void*> reaped;
+    void Submit(PendingIO request);
+    bool TrySubmit(PendingIO& request);
+
+    public:
+    /// @brief suspends the awaiting task until a read or append completes
+    class IOAwaiter {
+        EventLoop& loop;
+        PendingIO request;
+        public:
+        IOAwaiter(EventLoop& loop, PendingIO request): loop{loop}, request{request} {}
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { this->request.handle = handle; this->loop.Submit(this->request); }
+        void await_resume() { if (this->request.is_append) { this->request.file->Appended(this->request.bytes.size()); } }
+    };
+    EventLoop(size_t depth);
+    IOAwaiter Read(FileObject& file, size_t position, std::span<uint8_t> bytes);
+    IOAwaiter Append(FileObject& file, std::span<uint8_t> bytes);
+    void Spawn(Task<void>&& task);
+    void Run();
+
+};
+
+} // namespace bloomstore
@@ -8,4 +8,8 @@ uint32_t Mangle(uint8_t n, uint32_t hash_a, uint32_t hash_b, uint32_t size);
 
 uint32_t Hash(std::span<uint8_t> key, uint32_t seed);
 
+void Preimage(std::span<uint8_t> key, uint32_t seed, uint32_t hash);
+
+void HashBatch(std::span<uint8_t> keys, size_t key_bytes, size_t stride, uint32_t seed, std::span<uint32_t> hashes);
+
 } // namespace bloomstore
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<atomic>
+#include<deque>
+#include<array>
+
+namespace bloomstore {
+
+/// @brief memory held by a partition, by purpose
+enum class MemoryComponent { ActiveKVPairs, BloomChainCollector, Scratch, Count };
+
+/// @brief engine-wide memory budget for entries buffered in active kvpairs. 
+///        when the budget is exceeded, the coldest partitions are asked to flush early, 
+///        so hot partitions get to fill up their active buffers. 
+///        a partition is only flushed by the thread writing it, which learns about the request on its next write (see Charge), 
+///        so partitions owned by different threads can share a budget. charging and releasing are thread safe, registering is not. 
+class MemoryBudget {
+
+    private:
+    struct Partition {
+        std::array<size_t, size_t(MemoryComponent::Count)> reserved{};
+        std::atomic<size_t> buffered{0};
+        std::atomic<size_t> heat{0};
+        std::atomic<size_t> requested{0};
+    };
+    size_t budget;
+    std::atomic<size_t> total_buffered;
+    std::atomic<size_t> total_requested;
+    std::atomic<size_t> nputs;
+    std::deque<Partition> partitions;
+    bool Shrink(size_t hot_partition);
+
+    public:
+    MemoryBudget(size_t budget);
+    size_t Register();
+    void Reserve(size_t partition, MemoryComponent component, size_t bytes);
+    bool Charge(size_t partition, size_t bytes);
+    void Release(size_t partition);
+    size_t Buffered(size_t partition);
+    size_t Usage(size_t partition, MemoryComponent component);
+    size_t Usage(size_t partition);
+    size_t TotalBuffered();
+    size_t TotalRequested();
+    size_t TotalUsage();
+
+};
+
+} // namespace bloomstore
@@ -0,0 +1,26 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<span>
+
+namespace bloomstore {
+
+/// @brief folds merge operands into values, pluggable per store. 
+///        it must be associative, two pending operands are combined by merging the newer one into the older one. 
+class MergeOperator {
+
+    public:
+    virtual ~MergeOperator() = default;
+    virtual void Merge(std::span<uint8_t> value, std::span<uint8_t> operand) = 0;
+
+};
+
+/// @brief adds operands to values as little endian unsigned integers, e.g. for counters
+class AddOperator: public MergeOperator {
+
+    public:
+    void Merge(std::span<uint8_t> value, std::span<uint8_t> operand) override;
+
+};
+
+} // namespace bloomstore
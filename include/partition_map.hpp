@@ -0,0 +1,33 @@
+#pragma once
+#include<cstdint>
+#include<vector>
+#include<iostream>
+
+namespace bloomstore {
+
+/// @brief consistent hashing ring mapping key hashes to partitions. 
+///        a map without tokens routes by hash modulo the number of partitions, like stores written before rings. 
+class PartitionMap {
+
+    private:
+    std::vector<uint32_t> tokens;
+    std::vector<uint32_t> owners;
+    uint32_t npartitions;
+    void Place(uint32_t token, uint32_t partition);
+
+    public:
+    PartitionMap();
+    PartitionMap(size_t npartitions, size_t nvnodes);
+    uint32_t Route(uint32_t hash);
+    uint32_t Size();
+    bool IsEmpty();
+    bool IsModulo();
+    uint32_t AddPartition(size_t nvnodes);
+    uint32_t SplitPartition(uint32_t partition);
+    void Donors(PartitionMap& next, std::vector<uint32_t>& donors);
+    void Dump(std::ostream& out);
+    bool Load(std::istream& in);
+
+};
+
+} // namespace bloomstore
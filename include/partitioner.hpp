@@ -1,5 +1,9 @@
 #include<vector>
+#include<string>
 #include<bloom_store.hpp>
+#include<partition_map.hpp>
+#include<read_cache.hpp>
+#include<trace.hpp>
 
 namespace bloomstore {
 
@@ -7,16 +11,68 @@ class Partitioner {
 
     private:
     std::vector<BloomStore*> instances;
+    PartitionMap partition_map;
+    PartitionMap previous_map;
+    std::string path_map;
+    std::vector<uint32_t> migration_sources;
+    std::vector<size_t> migration_blocks;
+    std::vector<size_t> migration_chains;
+    std::vector<size_t> migration_sealed;
+    std::vector<uint8_t> migration_kept;
+    size_t migration_nsealed = 0;
+    bool migration_started = false;
+    size_t auto_migrate_writes = SIZE_MAX;
+    size_t migration_writes = 0;
+    MemoryBudget* budget = nullptr;
+    ReadCache* cache = nullptr;
+    TraceRecorder* recorder = nullptr;
+    bool numa = false;
+    uint64_t Deadline(uint32_t hash);
+    void LoadRecords(std::span<uint8_t> records, size_t nthreads, bool is_last);
+    void UseRing();
+    void BeginMigration();
+    void AdvanceMigration(size_t nwrites);
+    void MigrateEntry(uint32_t index, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone);
+    void KeepEntry(uint32_t source, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone);
+    bool LoadMap(std::istream& in);
+    void SaveMap();
 
     public:
     Partitioner(std::vector<BloomStore*>&& instances);
+    Partitioner(std::vector<BloomStore*>&& instances, std::string& path_map);
     ~Partitioner();
     void Put(std::span<uint8_t> key, std::span<uint8_t> value);
     void Del(std::span<uint8_t> key);
+    void Merge(std::span<uint8_t> key, std::span<uint8_t> operand);
+    void ConcurrentPut(std::span<uint8_t> key, std::span<uint8_t> value);
+    void ConcurrentDel(std::span<uint8_t> key);
+    void ConcurrentGet(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
+    void Flush();
     void Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found);
+    ValueView GetView(std::span<uint8_t> key);
+    Task<Lookup> AsyncGet(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value);
+    Task<void> AsyncPut(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value);
+    bool Write(WriteBatch& batch);
+    void BulkLoad(std::span<uint8_t> records, size_t nthreads);
+    void BulkLoad(std::string& path, size_t nthreads, size_t chunk_bytes = 64 << 20);
+    uint32_t AddPartition(BloomStore* instance);
+    uint32_t SplitPartition(uint32_t partition, BloomStore* instance);
+    bool IsMigrating();
+    bool Migrate(size_t nblocks);
+    void AutoMigrate(size_t nwrites);
+    bool Demote(size_t hot_chains, size_t nchains);
+    void AutoDemote(size_t hot_chains);
+    bool Expire(size_t nchains);
+    void UseBudget(MemoryBudget& budget);
+    void UseCache(ReadCache& cache);
+    void UseRecorder(TraceRecorder& recorder);
+    uint32_t Route(std::span<uint8_t> key);
+    void UseNuma();
+    size_t HomeNode(uint32_t partition);
+    void Serve(size_t node);
     size_t StatDiskReadCount();
     size_t StatFalsePositive();
 
 };
 
-} // namespace bloomstore
\ No newline at end of file
+} // namespace bloomstore
@@ -0,0 +1,26 @@
+#pragma once
+#include<cstdint>
+#include<vector>
+#include<string>
+#include<port.hpp>
+
+namespace bloomstore {
+
+/// @brief spread partition files over several devices, weighted round robin
+class Placement {
+
+    private:
+    std::vector<Device*> devices;
+    std::vector<size_t>  weights;
+    std::vector<int64_t> credits;
+
+    public:
+    Placement(std::vector<std::string>& directories, std::vector<size_t>& weights, size_t queue_depth);
+    ~Placement();
+    Device* Place(std::string& name);
+    void Limit(IOClass io_class, size_t bytes_per_second, size_t max_inflight);
+    static void CapacityWeights(std::vector<std::string>& directories, std::vector<size_t>& weights);
+
+};
+
+} // namespace bloomstore
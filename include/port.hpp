@@ -5,24 +5,247 @@
 #include<cstdint>
 #include<string>
 #include<span>
+#include<mutex>
+#include<condition_variable>
+#include<chrono>
+#include<vector>
+#include<unordered_map>
+#include<utility>
+#include<cstring>
+#include<algorithm>
+#include<memory>
+
+uint64_t Now();
+
+/// @brief a per-thread pool of page aligned buffers, so direct io never sees unaligned memory 
+///        and buffers on the read path are reused instead of allocated. 
+///        buffers of 2MiB and more are backed by transparent huge pages when the kernel allows. 
+///        a buffer goes back to the pool it came from, which lives on until its thread is gone and every such buffer is back. 
+class BufferPool {
+
+    private:
+    std::mutex mutex;
+    std::unordered_map<size_t, std::vector<void*>> free_lists;
+    size_t cached_bytes;
+    int node;
+    static size_t SizeClass(size_t bytes);
+
+    public:
+    static constexpr size_t ALIGN = 4096;
+    BufferPool();
+    ~BufferPool();
+    static BufferPool& Local();
+    static std::shared_ptr<BufferPool> Shared();
+    void* Borrow(size_t bytes);
+    void Return(void* buffer, size_t bytes, int node);
+    void UseNode(int node);
+    int Node();
+    size_t CachedBytes();
+};
+
+/// @brief numa topology of this host, read from sysfs. a host without numa is one node. 
+class Numa {
+
+    public:
+    static size_t Nodes();
+    static void Cpus(size_t node, std::vector<int>& cpus);
+    static void Pin(size_t node);
+    static void Bind(void* buffer, size_t bytes, size_t node);
+};
+
+/// @brief an owning array of T borrowed from the calling thread's buffer pool, page aligned. 
+///        it holds on to that pool, so it may be destroyed on any thread, or after its thread exited. 
+template<typename T>
+class AlignedBuffer {
+
+    private:
+    T* pointer;
+    size_t length;
+    std::shared_ptr<BufferPool> pool;
+    int node;
+
+    public:
+    /// @brief borrow a buffer of length elements with unspecified content, nothing for length 0
+    AlignedBuffer(size_t length):
+        pointer{nullptr},
+        length{length},
+        pool{length ? BufferPool::Shared() : nullptr},
+        node{-1}
+    {
+        if (this->pool) {
+            this->node = this->pool->Node();
+            this->pointer = static_cast<T*>(this->pool->Borrow(length * sizeof(T)));
+        }
+    }
+    /// @brief borrow a buffer of length elements filled with value
+    AlignedBuffer(size_t length, T value):
+        AlignedBuffer(length)
+    {
+        std::fill(this->pointer, this->pointer + length, value);
+    }
+    AlignedBuffer(const AlignedBuffer& other):
+        AlignedBuffer(other.length)
+    {
+        memcpy(this->pointer, other.pointer, this->length * sizeof(T));
+    }
+    AlignedBuffer(AlignedBuffer&& other) noexcept:
+        pointer{std::exchange(other.pointer, nullptr)},
+        length{std::exchange(other.length, 0)},
+        pool{std::move(other.pool)},
+        node{other.node}
+    {}
+    AlignedBuffer& operator=(AlignedBuffer other) noexcept {
+        std::swap(this->pointer, other.pointer);
+        std::swap(this->length, other.length);
+        std::swap(this->pool, other.pool);
+        std::swap(this->node, other.node);
+        return *this;
+    }
+    ~AlignedBuffer() {
+        if (this->pointer) { this->pool->Return(this->pointer, this->length * sizeof(T), this->node); }
+    }
+    T& operator[](size_t i) { return this->pointer[i]; }
+    T* data() { return this->pointer; }
+    T* begin() { return this->pointer; }
+    T* end() { return this->pointer + this->length; }
+    size_t size() { return this->length; }
+    /// @brief move pages of this buffer to a numa node
+    void Bind(size_t node) {
+        if (!this->pointer) { return; }
+        Numa::Bind(this->pointer, this->length * sizeof(T), node);
+        this->node = int(node);
+    }
+};
+
+/// @brief the priority class of an io request, a waiting request of a higher class is served first
+enum class IOClass { Foreground, Flush, Background };
+
+/// @brief a storage device mounted at a directory, with a bounded number of in-flight io requests. 
+///        free slots go to waiting requests by class priority, each class may be capped in slots and rate limited. 
+class Device {
+
+    private:
+    /// @brief the state of one io class, a token bucket of bytes and a slot cap
+    struct IOQueue {
+        size_t inflight = 0;
+        size_t waiting = 0;
+        size_t max_inflight = SIZE_MAX;
+        size_t bytes_per_second = 0;
+        double tokens = 0;
+        std::chrono::steady_clock::time_point refilled;
+    };
+    std::string directory;
+    size_t queue_depth;
+    size_t inflight;
+    IOQueue queues[3];
+    std::mutex mutex;
+    std::condition_variable available;
+    void Refill(IOQueue& queue);
+    bool IsAdmitted(IOClass io_class);
+    void Take(IOClass io_class, size_t bytes);
+
+    public:
+    Device(std::string& directory, size_t queue_depth);
+    std::string Path(std::string& name);
+    size_t Capacity();
+    void Limit(IOClass io_class, size_t bytes_per_second, size_t max_inflight);
+    void Acquire(IOClass io_class = IOClass::Foreground, size_t bytes = 0);
+    bool TryAcquire(IOClass io_class = IOClass::Foreground, size_t bytes = 0);
+    void Release(IOClass io_class = IOClass::Foreground);
+};
+
+/// @brief Direct bypasses page cache, Mapped reads through a read-only memory mapping
+enum class FileMode { Direct, Mapped };
+
+/// @brief access pattern hints for a mapped file
+enum class FileAdvice { Normal, Random, Sequential, WillNeed };
+
+struct MappingPin;
 
 class FileObject {
     
     private:
     std::string path;
     int32_t fd;
+    int32_t unsynced_fd;
     size_t size;
     size_t position;
+    Device* device;
+    FileMode mode;
+    FileAdvice advice;
+    bool is_read_only;
+    uint8_t* mapping;
+    size_t mapping_size;
+    std::shared_ptr<MappingPin> mapping_pin;
+    void Remap();
+    void Unpin();
+    friend class AsyncIO;
     
     public:
     FileObject(std::string& path);
+    FileObject(std::string& path, Device* device);
+    FileObject(std::string& path, Device* device, FileMode mode);
+    FileObject(std::string& path, Device* device, FileMode mode, bool is_read_only);
     ~FileObject();
-    void Append(std::span<uint8_t> bytes);
-    void Read(size_t position, std::span<uint8_t> bytes);
+    void Advise(FileAdvice advice);
+    bool IsMapped();
+    std::span<uint8_t> Map(size_t position, size_t length);
+    std::shared_ptr<void> Pin();
+    bool IsPinned();
+    void Append(std::span<uint8_t> bytes, IOClass io_class = IOClass::Flush);
+    void Appended(size_t nbytes);
+    void Unsync();
+    void Sync();
+    void Punch(size_t position, size_t length);
+    void Follow(size_t size);
+    void Read(size_t position, std::span<uint8_t> bytes, IOClass io_class = IOClass::Foreground);
     void Seek(size_t position);
     bool ContinueRead(std::span<uint8_t> bytes);
     bool ContinueReadRev(std::span<uint8_t> bytes);
     size_t Size();
 };
 
+/// @brief a small record of words shared by processes through a memory mapped file, with one writer and any number of readers. 
+///        readers never block the writer, they copy the record again if it changed meanwhile (a seqlock). 
+///        a reader may acknowledge the sequence number it has caught up with, so the writer knows what nobody reads any more. 
+class SharedRecord {
+
+    private:
+    std::string path;
+    int32_t fd;
+    uint64_t* words;
+    size_t nwords;
+    bool is_read_only;
+    size_t slot;
+    size_t Bytes();
+
+    public:
+    SharedRecord(std::string& path, size_t nwords, bool is_read_only);
+    ~SharedRecord();
+    uint64_t Store(std::span<uint64_t> record);
+    uint64_t Load(std::span<uint64_t> record);
+    uint64_t Sequence();
+    void Acknowledge(uint64_t sequence);
+    uint64_t Acknowledged();
+};
+
+/// @brief a kernel aio context, reads and appends are submitted without blocking and reaped once complete. 
+///        it is not thread safe, use one per thread. 
+class AsyncIO {
+
+    private:
+    uint64_t context;
+    size_t depth;
+    size_t inflight;
+    std::vector<void*> completed;
+
+    public:
+    AsyncIO(size_t depth);
+    ~AsyncIO();
+    bool Submit(FileObject& file, size_t position, std::span<uint8_t> bytes, void* tag);
+    bool Append(FileObject& file, std::span<uint8_t> bytes, void* tag);
+    void Reap(std::vector<void*>& tags, bool wait);
+    size_t Inflight();
+};
+
 #endif
\ No newline at end of file
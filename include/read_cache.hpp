@@ -0,0 +1,70 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+#include<string>
+#include<string_view>
+#include<list>
+#include<mutex>
+#include<memory>
+#include<atomic>
+#include<unordered_map>
+#include<span>
+
+namespace bloomstore {
+
+/// @brief a sharded key to value cache for hot reads, with tinylfu admission and a byte budget. 
+///        a key is only admitted when it was read more often than the entry it evicts. 
+///        absent keys may be cached too, so hot misses skip filters as well. 
+///        an entry may carry a deadline (wall clock milliseconds, see Now), it is a miss from then on. thread safe. 
+class ReadCache {
+
+    private:
+    struct Entry {
+        std::string value;
+        uint32_t hash;
+        bool is_present;
+        uint64_t deadline;
+        std::list<std::string_view>::iterator position;
+    };
+    /// @brief hashes owned keys and views alike, so lookups find entries without copying the key
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+    using EntryMap = std::unordered_map<std::string, Entry, KeyHash, std::equal_to<>>;
+    struct Shard {
+        std::mutex mutex;
+        EntryMap entries;
+        // views of the keys owned by entries, which never move
+        std::list<std::string_view> recency;
+        std::vector<uint8_t> sketch;
+        size_t samples = 0;
+        size_t bytes = 0;
+    };
+    std::unique_ptr<Shard[]> shards;
+    size_t nshards;
+    size_t shard_budget;
+    size_t sketch_width;
+    bool negative;
+    Shard& Locate(std::span<uint8_t> key, uint32_t& hash);
+    void Record(Shard& shard, uint32_t hash);
+    uint8_t Frequency(Shard& shard, uint32_t hash);
+    static std::string_view View(std::span<uint8_t> key);
+    void Evict(Shard& shard, EntryMap::iterator it);
+    bool Reserve(Shard& shard, size_t bytes, uint8_t frequency, EntryMap::iterator keep);
+
+    public:
+    std::atomic<size_t> stat_hit = 0;
+    std::atomic<size_t> stat_miss = 0;
+    ReadCache(size_t budget, size_t nshards = 16, bool negative = false);
+    bool Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_found);
+    void Admit(std::span<uint8_t> key, std::span<uint8_t> value, bool is_found, uint64_t deadline = UINT64_MAX);
+    void Update(std::span<uint8_t> key, std::span<uint8_t> value, uint64_t deadline = UINT64_MAX);
+    void Invalidate(std::span<uint8_t> key);
+    void Clear();
+    size_t Bytes();
+
+};
+
+} // namespace bloomstore
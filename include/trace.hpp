@@ -0,0 +1,65 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+#include<string>
+#include<span>
+#include<mutex>
+#include<chrono>
+#include<fstream>
+
+namespace bloomstore {
+
+/// @brief a traced operation
+enum class TraceOp : uint8_t { Put, Del, Get, Merge };
+
+/// @brief one operation read back from a trace
+struct TraceEntry {
+    TraceOp op;
+    uint64_t timestamp;
+    std::vector<uint8_t> key;
+};
+
+/// @brief records operations into a compact binary trace, for replaying real traffic offline. 
+///        each record is the operation, nanoseconds since the previous record (varint) 
+///        and either the whole key or its 32-bit hash. thread safe. 
+class TraceRecorder {
+
+    private:
+    std::ofstream out;
+    std::vector<char> buffer;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point start;
+    uint64_t last;
+    size_t key_bytes;
+    bool record_keys;
+
+    public:
+    TraceRecorder(std::string& path, size_t key_bytes, size_t value_bytes, bool record_keys = true);
+    ~TraceRecorder();
+    void Record(TraceOp op, std::span<uint8_t> key);
+    void Flush();
+
+};
+
+/// @brief reads a trace written by TraceRecorder. 
+///        hash-only traces give back stand-in keys derived from the hash, so a key keeps its identity, 
+///        and with the same hash as the recorded key, so it routes to the same partition. 
+class TraceReader {
+
+    private:
+    std::ifstream in;
+    uint64_t timestamp;
+    size_t key_bytes;
+    size_t value_bytes;
+    bool record_keys;
+
+    public:
+    TraceReader(std::string& path);
+    bool Next(TraceEntry& entry);
+    size_t KeyBytes();
+    size_t ValueBytes();
+
+};
+
+} // namespace bloomstore
@@ -0,0 +1,43 @@
+#pragma once
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+#include<span>
+
+namespace bloomstore {
+class BloomStore;
+class Partitioner;
+
+/// @brief a batch of puts and deletes, hashed together once applied and written partition by partition
+class WriteBatch {
+
+    private:
+    struct Entry {
+        uint32_t hash;
+        uint32_t hash_a;
+        uint32_t hash_b;
+        uint32_t partition;
+        size_t   offset;
+        bool     is_tombstone;
+    };
+    std::vector<uint8_t> bytes;
+    std::vector<Entry>   entries;
+    size_t key_bytes;
+    size_t value_bytes;
+    bool   atomic;
+    size_t nhashed = 0;
+    void Add(std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone);
+    void HashEntries();
+    friend BloomStore;
+    friend Partitioner;
+
+    public:
+    WriteBatch(size_t key_bytes, size_t value_bytes, bool atomic = false);
+    void Put(std::span<uint8_t> key, std::span<uint8_t> value);
+    void Del(std::span<uint8_t> key);
+    size_t Size();
+    void Clear();
+
+};
+
+} // namespace bloomstore
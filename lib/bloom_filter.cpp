@@ -4,6 +4,9 @@
 #include<cstring>
 #include<cassert>
 #include<iostream>
+#include<algorithm>
+#include<bit>
+#include<atomic>
 
 namespace bloomstore
 {
@@ -23,6 +26,13 @@ BloomFilter::BloomFilter(size_t nslots, size_t nfunc):
 void BloomFilter::Insert(std::span<uint8_t> key) {
     uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
     uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
+    this->InsertHashed(hash_a, hash_b);
+}
+
+/// @brief insert a key whose hashes are computed ahead of time
+/// @param hash_a the key hashed with seed 'A'
+/// @param hash_b the key hashed with seed 'B'
+void BloomFilter::InsertHashed(uint32_t hash_a, uint32_t hash_b) {
     for (uint32_t i = 0; i < this->nfunc; ++i) {
         uint32_t hash_z = Mangle(i, hash_a, hash_b, this->slots.size());
         this->slots[hash_z] = true;
@@ -50,104 +60,290 @@ void BloomFilter::Clear() {
 
 // --- Bloom Chain --- //
 
-/// @brief test if key is in the represented set. it may possibly return false positive results
-/// @param key the tested key
-/// @return true iff key is in the represented set. 
-BloomChain::BloomChain(size_t nslots, size_t nfunc, size_t align):
+/// @brief initialize an empty bloom chain
+/// @param nslots   the number of slots of each bloom filter
+/// @param nfunc    the number of hash functions
+/// @param align    the serialized chain is padded to a multiple of align
+template<size_t W>
+BasicBloomChain<W>::BasicBloomChain(size_t nslots, size_t nfunc, size_t align):
+    space(((nslots * LANES + W + (align - 1)) / align * align + 7) / 8 * 8, 0),
+    nslots(nslots),
     nfunc(nfunc),
-    space(((nslots + sizeof(size_t) * 8 + (align - 1)) / align * align + 7) / 8 * 8, 0),
     chain_length(0)
 {
-    this->matrix = std::span{&this->space[0], nslots};
-    this->block_addresses = std::span{&this->space[nslots], 64};
+    this->matrix = std::span{&this->space[0], nslots * LANES};
+    this->block_addresses = std::span{&this->space[nslots * LANES], W};
+}
+
+/// @brief the mask of joined (or sealed) columns
+/// @param mask set to the mask
+template<size_t W>
+void BasicBloomChain<W>::Sealed(Word& mask) {
+    for (size_t l = 0; l < LANES; ++l) {
+        size_t nbits = std::min<size_t>(64, this->chain_length - std::min<size_t>(this->chain_length, 64 * l));
+        mask[l] = nbits == 64 ? ~uint64_t{0} : (uint64_t{1} << nbits) - 1;
+    }
+}
+
+/// @brief and mask with every slot a key hashes to, lane by lane
+/// @param hash_a   the key hashed with seed 'A'
+/// @param hash_b   the key hashed with seed 'B'
+/// @param mask     the columns to test, columns which may contain key are kept
+template<size_t W>
+void BasicBloomChain<W>::Probe(uint32_t hash_a, uint32_t hash_b, Word& mask) {
+    for (uint32_t i = 0; i < this->nfunc; ++i) {
+        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->nslots);
+        auto slot = &this->matrix[hash_z * LANES];
+        for (size_t l = 0; l < LANES; ++l) {
+            mask[l] &= slot[l];
+        }
+    }
 }
 
 /// @brief add new bloom filter to batch
 /// @param filter the new bloom filter
 /// @param block_address its block address
-void BloomChain::Join(BloomFilter& filter, size_t block_address) {
-    assert(this->chain_length < 64);
+template<size_t W>
+void BasicBloomChain<W>::Join(BloomFilter& filter, size_t block_address) {
+    assert(this->chain_length < W);
+    auto lane = this->chain_length / 64;
+    auto bit  = uint64_t{1} << (this->chain_length % 64);
     for (int i = 0; i < filter.slots.size(); ++i) {
         if (filter.slots[i]) {
-            this->matrix[i] = this->matrix[i] | (uint64_t{1} << this->chain_length);
+            this->matrix[i * LANES + lane] |= bit;
         }
     }
     this->block_addresses[this->chain_length] = block_address;
     this->chain_length += 1;
 }
 
-/// @brief test if key exists in current chain
+/// @brief insert key into the open column (the one after joined blocks), 
+///        so the active filter of a block is built in place and sealing it costs nothing
+/// @param key the inserted key
+template<size_t W>
+void BasicBloomChain<W>::Insert(std::span<uint8_t> key) {
+    uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
+    uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
+    this->InsertHashed(hash_a, hash_b);
+}
+
+/// @brief insert a key whose hashes are computed ahead of time into the open column
+/// @param hash_a the key hashed with seed 'A'
+/// @param hash_b the key hashed with seed 'B'
+template<size_t W>
+void BasicBloomChain<W>::InsertHashed(uint32_t hash_a, uint32_t hash_b) {
+    assert(this->chain_length < W);
+    auto lane = this->chain_length / 64;
+    auto bit  = uint64_t{1} << (this->chain_length % 64);
+    for (uint32_t i = 0; i < this->nfunc; ++i) {
+        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->nslots);
+        this->matrix[hash_z * LANES + lane] |= bit;
+    }
+}
+
+/// @brief insert into the open column like InsertHashed, with atomic or on words, so several writers can insert at once. 
+///        the chain must not be sealed meanwhile. 
+/// @param hash_a the key hashed with seed 'A'
+/// @param hash_b the key hashed with seed 'B'
+template<size_t W>
+void BasicBloomChain<W>::AtomicInsertHashed(uint32_t hash_a, uint32_t hash_b) {
+    assert(this->chain_length < W);
+    auto lane = this->chain_length / 64;
+    auto bit  = uint64_t{1} << (this->chain_length % 64);
+    for (uint32_t i = 0; i < this->nfunc; ++i) {
+        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->nslots);
+        std::atomic_ref<uint64_t>(this->matrix[hash_z * LANES + lane]).fetch_or(bit, std::memory_order_relaxed);
+    }
+}
+
+/// @brief test if key is in the open column, it may possibly return false positive results
+/// @param key the tested key
+/// @return true iff key is in the open column
+template<size_t W>
+bool BasicBloomChain<W>::TestActive(std::span<uint8_t> key) {
+    assert(this->chain_length < W);
+    uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
+    uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
+    auto lane = this->chain_length / 64;
+    uint64_t collector = uint64_t{1} << (this->chain_length % 64);
+    for (uint32_t i = 0; i < this->nfunc; ++i) {
+        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->nslots);
+        collector = collector & this->matrix[hash_z * LANES + lane];
+    }
+    return collector != 0;
+}
+
+/// @brief close the open column, its block was flushed at block_address
+/// @param block_address the block address
+template<size_t W>
+void BasicBloomChain<W>::Seal(size_t block_address) {
+    assert(this->chain_length < W);
+    this->block_addresses[this->chain_length] = block_address;
+    this->chain_length += 1;
+}
+
+/// @brief test if key exists in current chain, only joined (or sealed) blocks are reported
 /// @param key the inquired key
 /// @return a pointer iterator
-PtrIterator BloomChain::Test(std::span<uint8_t> key) {
+template<size_t W>
+PtrIterator BasicBloomChain<W>::Test(std::span<uint8_t> key) {
     uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
     uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
-    uint64_t collector = ~uint64_t{0};
+    auto collector = Word();
+    this->Sealed(collector);
+    this->Probe(hash_a, hash_b, collector);
+    return PtrIterator{this->block_addresses, std::span{collector}};
+}
+
+/// @brief test if key exists in sealed columns while concurrent writers set bits of the open column, see Test
+/// @param key the tested key
+/// @return a pointer iterator over the block addresses which may contain key
+template<size_t W>
+PtrIterator BasicBloomChain<W>::AtomicTest(std::span<uint8_t> key) {
+    uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
+    uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
+    auto collector = Word();
+    this->Sealed(collector);
     for (uint32_t i = 0; i < this->nfunc; ++i) {
-        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->matrix.size());
-        collector = collector & this->matrix[hash_z];
+        uint32_t hash_z = Mangle(i, hash_a, hash_b, this->nslots);
+        for (size_t l = 0; l < LANES; ++l) {
+            collector[l] &= std::atomic_ref<uint64_t>(this->matrix[hash_z * LANES + l]).load(std::memory_order_relaxed);
+        }
+    }
+    return PtrIterator{this->block_addresses, std::span{collector}};
+}
+
+/// @brief enumerate all joined blocks, from the newest to the oldest
+/// @return a pointer iterator over every joined block address
+template<size_t W>
+PtrIterator BasicBloomChain<W>::Enumerate() {
+    auto collector = Word();
+    this->Sealed(collector);
+    return PtrIterator{this->block_addresses, std::span{collector}};
+}
+
+/// @brief rewrite the address of every joined block, e.g. when blocks are moved to another file
+/// @param relocate maps an old block address to the new one
+template<size_t W>
+void BasicBloomChain<W>::Relocate(std::function<size_t(size_t)> relocate) {
+    for (size_t i = 0; i < this->chain_length; ++i) {
+        this->block_addresses[i] = relocate(this->block_addresses[i]);
     }
-    return PtrIterator{this->block_addresses, collector, 0};
 }
 
 /// @brief check if current chain is full
-/// @return when chain length is 64, return true
-bool BloomChain::IsFull() {
-    return this->chain_length == 64;
+/// @return when chain length is W, return true
+template<size_t W>
+bool BasicBloomChain<W>::IsFull() {
+    return this->chain_length == W;
+}
+
+/// @brief drop every column, sealed or open
+template<size_t W>
+void BasicBloomChain<W>::Clear() {
+    this->chain_length = 0;
+    memset(&this->space[0], 0, sizeof(uint64_t) * this->space.size());
 }
 
 /// @brief we cannot really know what do we want to do with the FileObject, so ... we just pass the loader
 /// @param loader the loading routine
-void BloomChain::Load(std::function<void(std::span<uint8_t>)> loader) {
+template<size_t W>
+void BasicBloomChain<W>::Load(std::function<void(std::span<uint8_t>)> loader) {
     auto space = std::span{(uint8_t*)(&this->space[0]), sizeof(uint64_t) * this->space.size()};
+    this->matrix = std::span{&this->space[0], this->matrix.size()};
+    this->block_addresses = std::span{&this->space[this->matrix.size()], W};
     loader(space);
-    this->chain_length = 64;
+    this->chain_length = W;
+}
+
+/// @brief read a serialized bloom chain in place without copying, e.g. from a memory mapped file. 
+///        the attached chain is read only and the space must outlive it (or next Load). 
+/// @param space the serialized bloom chain, ByteSize() bytes, 8-byte aligned
+template<size_t W>
+void BasicBloomChain<W>::Attach(std::span<uint8_t> space) {
+    assert(space.size() == this->ByteSize());
+    assert(reinterpret_cast<uintptr_t>(&space[0]) % sizeof(uint64_t) == 0);
+    auto words = std::span{reinterpret_cast<uint64_t*>(&space[0]), this->space.size()};
+    this->matrix = words.subspan(0, this->matrix.size());
+    this->block_addresses = words.subspan(this->matrix.size(), W);
+    this->chain_length = W;
+}
+
+/// @brief the number of bytes of a serialized bloom chain
+template<size_t W>
+size_t BasicBloomChain<W>::ByteSize() {
+    return sizeof(uint64_t) * this->space.size();
 }
 
 /// @brief dump current bloom chain into file and clear internal data
 /// @param file the file to dump into
-void BloomChain::Dump(FileObject& file) {
+template<size_t W>
+void BasicBloomChain<W>::Dump(FileObject& file) {
+    this->Dump([&](std::span<uint8_t> space) {
+        file.Append(space);
+    });
+}
+
+/// @brief dump current bloom chain through a dumper and clear internal data
+/// @param dumper the dumping routine, e.g. staging bytes for a larger write
+template<size_t W>
+void BasicBloomChain<W>::Dump(std::function<void(std::span<uint8_t>)> dumper) {
     assert(this->IsFull());
     auto space = std::span{(uint8_t*)(&this->space[0]), sizeof(uint64_t) * this->space.size()};
-    file.Append(space);
-    this->chain_length = 0;
-    memset(&this->space[0], 0, sizeof(uint64_t) * this->space.size());
+    dumper(space);
+    this->Clear();
+}
+
+/// @brief move the in-memory chain to a numa node
+/// @param node the numa node
+template<size_t W>
+void BasicBloomChain<W>::Bind(size_t node) {
+    this->space.Bind(node);
 }
 
+template class BasicBloomChain<64>;
+template class BasicBloomChain<128>;
+template class BasicBloomChain<256>;
+template class BasicBloomChain<512>;
+
 // --- PtrIterator --- //
 
 /// @brief initialize a pointer iterator
 /// @param block_addresses referred block addresses
-/// @param bitmask a bitmask indicating whether current key presents in bloom chain
-/// @param progress current iteration progress
+/// @param bitmask a bitmask indicating whether current key presents in bloom chain, one word per 64 blocks
 PtrIterator::PtrIterator(
     std::span<size_t> block_addresses,
-    uint64_t bitmask,
-    uint8_t progress
+    std::span<uint64_t> bitmask
 ):
     block_addresses{block_addresses},
-    bitmask{bitmask},
-    progress{progress}
-{}
+    bitmask{}
+{
+    assert(bitmask.size() * 64 == block_addresses.size());
+    std::copy(bitmask.begin(), bitmask.end(), this->bitmask.begin());
+}
 
-/// @brief get next address
+/// @brief get next address, skipping clear bits a word at a time
 /// @param address  the given address
 /// @param depleted if current iterator is depleted
 void PtrIterator::Next(size_t &address, bool& depleted) {
-    if (this->progress == this->block_addresses.size()) {
-        depleted = true;
-        return;
-    }
-    auto j = this->block_addresses.size() - this->progress - 1;
-    if ((this->bitmask) & (uint64_t{1} << j)) {
-        address = this->block_addresses[j];
+    for (size_t l = this->block_addresses.size() / 64; l-- > 0; ) {
+        if (this->bitmask[l] == 0) { continue; }
+        auto j = 63 - std::countl_zero(this->bitmask[l]);
+        this->bitmask[l] &= ~(uint64_t{1} << j);
+        address = this->block_addresses[l * 64 + j];
         depleted = false;
-        this->progress += 1;
         return;
     }
-    else {
-        this->progress += 1;
-        return Next(address, depleted);
+    depleted = true;
+}
+
+/// @brief skip the oldest columns, e.g. blocks whose entries are expired
+/// @param ncolumns the number of skipped columns
+void PtrIterator::DropOldest(size_t ncolumns) {
+    for (size_t l = 0; l < this->block_addresses.size() / 64 && ncolumns != 0; ++l) {
+        auto n = std::min<size_t>(ncolumns, 64);
+        this->bitmask[l] &= n == 64 ? 0 : ~((uint64_t{1} << n) - 1);
+        ncolumns -= n;
     }
 }
 
@@ -1,7 +1,14 @@
 #include<cstring>
 #include<cassert>
 #include<bloom_kvpairs.hpp>
+#include<hashing.hpp>
 #include<iostream>
+#include<bit>
+#include<atomic>
+#include<thread>
+#ifdef __SSE2__
+#include<emmintrin.h>
+#endif
 
 namespace bloomstore {
 
@@ -9,6 +16,18 @@ namespace bloomstore {
 #define V (this->value_bytes)
 #define C (this->capacity)
 
+// the number of entries is stored in front of each serialized kvpairs, so partially filled ones can be flushed
+static constexpr size_t HEADER_BYTES = sizeof(uint64_t);
+
+// a serialized kvpairs is laid out as
+//   [header][tombstone bits][1-byte tag per entry][keys][values][operand bits][padding to align]
+// so a lookup only touches tags and keys until it finds a match. 
+// tags are the top byte of the index hash. 
+// operand bits come last, blocks written before merge operands have them in zeroed padding. 
+// such blocks lack the operand flag in their header, and they only line up if that padding was wide enough. 
+#define TAG(hash) static_cast<uint8_t>((hash) >> 24)
+#define HEADER_OPERANDS (uint64_t{1} << 63)
+
 /// @brief initialize bitspan with a space
 /// @param space the used space (must not overlap any others)
 BitSpan::BitSpan(std::span<uint8_t> space):
@@ -29,63 +48,322 @@ void BitSpan::Set(size_t i, bool v) {
     this->space[i / 8] = (this->space[i / 8] & ~(1<<(i % 8))) | (v << (i % 8));
 }
 
+/// @brief get element at index i, safe against writers of neighbouring elements
+/// @param i index
+/// @return the elment at index i
+const bool BitSpan::AtomicGet(size_t i) {
+    return (std::atomic_ref<uint8_t>(this->space[i / 8]).load(std::memory_order_relaxed) >> (i % 8)) & 1;
+}
+
+/// @brief set element at index to value, safe against writers of neighbouring elements
+/// @param i index
+/// @param v value
+void BitSpan::AtomicSet(size_t i, bool v) {
+    auto byte = std::atomic_ref<uint8_t>(this->space[i / 8]);
+    if (v) { byte.fetch_or(1 << (i % 8), std::memory_order_relaxed); }
+    else   { byte.fetch_and(~(1 << (i % 8)), std::memory_order_relaxed); }
+}
+
 /// @brief initialize an empty kv storage
-KVPairs::KVPairs(size_t key_bytes, size_t value_bytes, size_t capacity, size_t align):
+/// @param indexed if true, keep an open addressing hash index so Get doesn't scan (for the active buffer)
+KVPairs::KVPairs(size_t key_bytes, size_t value_bytes, size_t capacity, size_t align, bool indexed):
     size{0},
     key_bytes{key_bytes},
     value_bytes{value_bytes},
     capacity{capacity},
-    space((capacity * key_bytes * value_bytes + (capacity + 7) / 8 + align - 1) / align * align, 0),
-    tombstone(std::span{&this->space[0], (C+7)/8})
+    space((HEADER_BYTES + 2 * ((capacity + 7) / 8) + capacity * (1 + key_bytes + value_bytes) + align - 1) / align * align, 0),
+    fits_unflagged{(HEADER_BYTES + (capacity + 7) / 8 + capacity * (1 + key_bytes + value_bytes) + align - 1) / align * align == this->space.size()},
+    tombstone(std::span{&this->space[0], (C+7)/8}),
+    operand(std::span{&this->space[0], (C+7)/8}),
+    index(indexed ? std::bit_ceil(2 * capacity) : 0, 0)
 {
-    this->tombstone = BitSpan(std::span{&this->space[0], (C+7)/8});
-    this->pairs = std::span{&this->space[(C+7)/8], C*(K+V)};
+    this->Bind(std::span{&this->space[0], this->space.size()});
+}
+
+// --- Hash Index --- //
+// each index slot holds (hash << 32) | (entry + 1), 0 for an empty slot. 
+// writes to a resident key overwrite its entry in place, so at most one entry (and slot) per key. 
+
+/// @brief find the index slot of key, or the empty slot where it would go
+/// @param key  the inquired key
+/// @param hash the key hash
+/// @return a position in index
+size_t KVPairs::Probe(std::span<uint8_t> key, uint32_t hash) {
+    size_t mask = this->index.size() - 1;
+    for (size_t p = hash & mask; ; p = (p + 1) & mask) {
+        uint64_t slot = this->index[p];
+        if (slot == 0) { return p; }
+        if ((slot >> 32) != hash) { continue; }
+        size_t j = (slot & 0xffffffff) - 1;
+        if (0 == memcmp(&this->keys[j * K], &key[0], K)) { return p; }
+    }
+}
+
+/// @brief point key to entry i in index
+/// @param key  the key of entry i
+/// @param i    the newest entry of key
+void KVPairs::Index(std::span<uint8_t> key, size_t i) {
+    if (this->index.size() == 0) { return; }
+    uint32_t hash = Hash(key, static_cast<uint32_t>('I'));
+    this->index[this->Probe(key, hash)] = (uint64_t{hash} << 32) | (i + 1);
+}
+
+/// @brief rebuild index from entries
+void KVPairs::Reindex() {
+    if (this->index.size() == 0) { return; }
+    std::fill(this->index.begin(), this->index.end(), 0);
+    for (size_t i = 0; i < this->size; ++i) {
+        this->Index(this->keys.subspan(i * K, K), i);
+    }
+}
+
+/// @brief point tombstones and pairs into a serialized kvpairs
+/// @param space the serialized kvpairs
+void KVPairs::Bind(std::span<uint8_t> space) {
+    size_t offset = HEADER_BYTES + (C+7)/8;
+    this->header = space.subspan(0, HEADER_BYTES);
+    this->tombstone = BitSpan(space.subspan(HEADER_BYTES, (C+7)/8));
+    this->tags = space.subspan(offset, C);
+    this->keys = space.subspan(offset + C, C*K);
+    this->values = space.subspan(offset + C + C*K, C*V);
+    this->operand = BitSpan(space.subspan(offset + C + C*K + C*V, (C+7)/8));
+}
+
+/// @brief find the entry to write key into. an indexed kvpairs reuses the entry of a resident key, 
+///        otherwise a new entry is appended. 
+/// @param key          the written key
+/// @param is_coalesced set to true iff an existing entry is reused
+/// @return the entry index
+size_t KVPairs::Claim(std::span<uint8_t> key, bool& is_coalesced) {
+    is_coalesced = false;
+    size_t p = 0;
+    uint32_t hash = Hash(key, static_cast<uint32_t>('I'));
+    if (this->index.size() != 0) {
+        p = this->Probe(key, hash);
+        if (this->index[p] != 0) {
+            is_coalesced = true;
+            return (this->index[p] & 0xffffffff) - 1;
+        }
+    }
+    assert(this->size < this->capacity);
+    auto i = this->size;
+    this->size += 1;
+    this->tags[i] = TAG(hash);
+    memcpy(&this->keys[i * K], &key[0], K);
+    if (this->index.size() != 0) {
+        this->index[p] = (uint64_t{hash} << 32) | (i + 1);
+    }
+    return i;
 }
 
 /// @brief put a key into storage
 /// @param key the inquired key
 /// @param val the inserted value
-void KVPairs::Put(std::span<uint8_t> key, std::span<uint8_t> val) {
+/// @return true iff the key was resident and got overwritten in place (no entry is taken)
+bool KVPairs::Put(std::span<uint8_t> key, std::span<uint8_t> val) {
     assert(key.size() == K);
     assert(val.size() == V);
-    assert(this->size < this->capacity);
-    auto i = this->size;
-    this->size += 1;
+    bool is_coalesced = false;
+    auto i = this->Claim(key, is_coalesced);
     this->tombstone.Set(i, false);
-    memcpy(&this->pairs[i * (K + V)], &key[0], K);
-    memcpy(&this->pairs[i * (K + V) + K], &val[0], V);
-    return;
+    this->operand.Set(i, false);
+    memcpy(&this->values[i * V], &val[0], V);
+    return is_coalesced;
 }
 
 /// @brief delete key by adding a tombstone
 /// @param key the deleted key
-void KVPairs::Del(std::span<uint8_t> key) {
+/// @return true iff the key was resident and got overwritten in place (no entry is taken)
+bool KVPairs::Del(std::span<uint8_t> key) {
     assert(key.size() == K);
-    assert(this->size < this->capacity);
-    auto i = this->size;
-    this->size += 1;
+    bool is_coalesced = false;
+    auto i = this->Claim(key, is_coalesced);
     this->tombstone.Set(i, true);
-    memcpy(&this->pairs[i * (K + V)], &key[0], K);
-    return;
+    this->operand.Set(i, false);
+    return is_coalesced;
+}
+
+/// @brief add a merge operand of key, folded into older entries when key is read. 
+///        a resident entry is merged in place: a value or operand takes the operand, a tombstone becomes a value merged from zeros. 
+/// @param key              the merged key
+/// @param operand          the merge operand, value_bytes long
+/// @param merge_operator   the merge operator
+/// @return true iff the key was resident and got merged in place (no entry is taken)
+bool KVPairs::Merge(std::span<uint8_t> key, std::span<uint8_t> operand, MergeOperator& merge_operator) {
+    assert(key.size() == K);
+    assert(operand.size() == V);
+    bool is_coalesced = false;
+    auto i = this->Claim(key, is_coalesced);
+    auto value = this->values.subspan(i * V, V);
+    if (!is_coalesced) {
+        this->tombstone.Set(i, false);
+        this->operand.Set(i, true);
+        memcpy(&value[0], &operand[0], V);
+        return false;
+    }
+    if (this->tombstone.Get(i)) {
+        this->tombstone.Set(i, false);
+        memset(&value[0], 0, V);
+    }
+    merge_operator.Merge(value, operand);
+    return true;
+}
+
+/// @brief write entry i reserved by one of several concurrent writers, then publish it. 
+///        entries are never coalesced, the index keeps pointing at the newest entry of each key. 
+///        entries are published in order: writer i waits for entry i - 1 and release-stores size = i + 1, 
+///        so size is the published prefix and readers acquiring it see entries before it whole, see ConcurrentView. 
+/// @param i            the entry reserved by this writer, below capacity
+/// @param key          the written key
+/// @param value        the written value, ignored for a tombstone
+/// @param is_tombstone whether the key is deleted
+/// @return true iff this entry is the last one to fill kvpairs up
+bool KVPairs::Publish(size_t i, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+    assert(key.size() == K);
+    assert(i < this->capacity);
+    uint32_t hash = Hash(key, static_cast<uint32_t>('I'));
+    this->tags[i] = TAG(hash);
+    memcpy(&this->keys[i * K], &key[0], K);
+    if (!is_tombstone) {
+        assert(value.size() == V);
+        memcpy(&this->values[i * V], &value[0], V);
+    }
+    this->tombstone.AtomicSet(i, is_tombstone);
+    if (this->index.size() != 0) {
+        // the key of an indexed entry is written before its slot, so probing never reads a torn key
+        size_t mask = this->index.size() - 1;
+        uint64_t desired = (uint64_t{hash} << 32) | (i + 1);
+        bool is_indexed = false;
+        for (size_t p = hash & mask; !is_indexed; p = (p + 1) & mask) {
+            auto slot = std::atomic_ref<uint64_t>(this->index[p]);
+            uint64_t seen = slot.load(std::memory_order_acquire);
+            while (!is_indexed) {
+                if (seen != 0) {
+                    size_t j = (seen & 0xffffffff) - 1;
+                    if ((seen >> 32) != hash || 0 != memcmp(&this->keys[j * K], &key[0], K)) { break; }
+                    // a newer entry of key is indexed already
+                    if (j > i) { is_indexed = true; break; }
+                }
+                is_indexed = slot.compare_exchange_weak(seen, desired, std::memory_order_acq_rel);
+            }
+        }
+    }
+    auto published = std::atomic_ref<size_t>(this->size);
+    while (published.load(std::memory_order_acquire) != i) {
+        std::this_thread::yield();
+    }
+    published.store(i + 1, std::memory_order_release);
+    return i + 1 == this->capacity;
+}
+
+/// @brief find the newest entry of key by comparing tags 16 at a time, then keys of matching tags
+/// @param key  the inquired key
+/// @param tag  the key tag
+/// @param size the number of entries searched, from the oldest
+/// @return the entry index, or size if key is absent
+size_t KVPairs::Match(std::span<uint8_t> key, uint8_t tag, size_t size) {
+    size_t end = size;
+#ifdef __SSE2__
+    auto needle = _mm_set1_epi8(static_cast<char>(tag));
+    while (end >= 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&this->tags[end - 16]));
+        uint32_t matches = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        while (matches != 0) {
+            size_t j = end - 16 + 31 - std::countl_zero(matches);
+            if (0 == memcmp(&this->keys[j * K], &key[0], K)) { return j; }
+            matches &= ~(uint32_t{1} << (j - (end - 16)));
+        }
+        end -= 16;
+    }
+#endif
+    while (end > 0) {
+        end -= 1;
+        if (this->tags[end] != tag) { continue; }
+        if (0 == memcmp(&this->keys[end * K], &key[0], K)) { return end; }
+    }
+    return size;
 }
 
 /// @brief get a key
 /// @param key the inquired key
 /// @return nullopt if not found, {nullopt} if deleted, {{value}} if entry exists
 void KVPairs::Get(std::span<uint8_t> key, std::span<uint8_t> val, bool& is_tombstone, bool& is_found) {
-    assert(key.size() == K);
     assert(val.size() == V);
+    auto view = this->View(key, is_tombstone, is_found);
+    if (is_found && !is_tombstone)
+        memcpy(&val[0], &view[0], V);
+}
+
+/// @brief get a key without copying its value, a merge operand reads as a value
+/// @param key the inquired key
+/// @return the value in place, empty if key is not found or deleted
+std::span<uint8_t> KVPairs::View(std::span<uint8_t> key, bool& is_tombstone, bool& is_found) {
+    bool is_operand = false;
+    return this->View(key, is_tombstone, is_found, is_operand);
+}
+
+/// @brief get a key without copying its value
+/// @param key          the inquired key
+/// @param is_operand   set to true iff the newest entry of key is a merge operand, which is returned as value
+/// @return the value in place, empty if key is not found or deleted
+std::span<uint8_t> KVPairs::View(std::span<uint8_t> key, bool& is_tombstone, bool& is_found, bool& is_operand) {
+    assert(key.size() == K);
     is_found = false;
     is_tombstone = false;
-    for (int i = 0; i < this->size; ++i) {
-        int j = this->size - i - 1;
-        bool eq = 0 == memcmp(&this->pairs[j * (K + V)], &key[0], K);
-        if (!eq) { continue; }
-        is_found = true;
-        is_tombstone = this->tombstone.Get(j);
-        if (!is_tombstone)
-            memcpy(&val[0], &this->pairs[j * (K + V) + K], V);
-        return;
+    is_operand = false;
+    uint32_t hash = Hash(key, static_cast<uint32_t>('I'));
+    size_t j = this->size;
+    if (this->index.size() != 0) {
+        uint64_t slot = this->index[this->Probe(key, hash)];
+        if (slot != 0) { j = (slot & 0xffffffff) - 1; }
+    }
+    else {
+        j = this->Match(key, TAG(hash), this->size);
+    }
+    if (j == this->size) { return {}; }
+    is_found = true;
+    is_tombstone = this->tombstone.Get(j);
+    if (is_tombstone) { return {}; }
+    is_operand = this->operand.Get(j);
+    return this->values.subspan(j * V, V);
+}
+
+/// @brief get a key while concurrent writers publish entries, see Publish. 
+///        only the published prefix is searched, by tags since the index may point at entries past it. 
+/// @param key          the inquired key
+/// @param is_operand   set to true iff the newest entry of key is a merge operand, which is returned as value
+/// @return the value in place, empty if key is not found or deleted
+std::span<uint8_t> KVPairs::ConcurrentView(std::span<uint8_t> key, bool& is_tombstone, bool& is_found, bool& is_operand) {
+    assert(key.size() == K);
+    is_found = false;
+    is_tombstone = false;
+    is_operand = false;
+    size_t end = std::atomic_ref<size_t>(this->size).load(std::memory_order_acquire);
+    size_t j = this->Match(key, TAG(Hash(key, static_cast<uint32_t>('I'))), end);
+    if (j == end) { return {}; }
+    is_found = true;
+    // writers of neighbouring entries set bits of the same byte
+    is_tombstone = this->tombstone.AtomicGet(j);
+    if (is_tombstone) { return {}; }
+    is_operand = this->operand.Get(j);
+    return this->values.subspan(j * V, V);
+}
+
+/// @brief visit every entry, from the newest to the oldest
+/// @param visitor          called with key, value and tombstone flag of each entry
+/// @param operand_visitor  called with key of each merge operand instead, if given
+void KVPairs::ForEach(KVVisitor visitor, KeyVisitor operand_visitor) {
+    for (size_t i = 0; i < this->size; ++i) {
+        size_t j = this->size - i - 1;
+        if (operand_visitor && this->operand.Get(j)) {
+            operand_visitor(this->keys.subspan(j * K, K));
+            continue;
+        }
+        visitor(
+            this->keys.subspan(j * K, K),
+            this->values.subspan(j * V, V),
+            this->tombstone.Get(j)
+        );
     }
 }
 
@@ -95,25 +373,108 @@ bool KVPairs::IsFull() {
     return this->size == this->capacity;
 }
 
-/// @brief dump current kvpairs to file and clear current object
+/// @brief check if current kvpairs object has no entry
+bool KVPairs::IsEmpty() {
+    return this->size == 0;
+}
+
+/// @brief the number of entries that still fit
+size_t KVPairs::Remaining() {
+    return this->capacity - this->size;
+}
+
+/// @brief the number of bytes taken by entries
+size_t KVPairs::UsedBytes() {
+    return this->size * (K + V);
+}
+
+/// @brief dump current kvpairs to file and clear current object, it doesn't have to be full
 /// @param file the file to dump into
 void KVPairs::Dump(FileObject& file) {
-    assert(this->IsFull());
+    this->Dump([&](std::span<uint8_t> space) {
+        file.Append(space);
+    });
+}
+
+/// @brief dump current kvpairs through a dumper and clear current object
+/// @param dumper the dumping routine, e.g. staging bytes for a larger write
+void KVPairs::Dump(std::function<void(std::span<uint8_t>)> dumper) {
+    uint64_t size = this->size | HEADER_OPERANDS;
+    memcpy(&this->header[0], &size, HEADER_BYTES);
     auto space = std::span{&this->space[0], this->space.size()};
-    file.Append(space);
+    dumper(space);
+    // only the prefix of each region holding entries was ever written
+    memset(&this->space[0], 0, HEADER_BYTES + (C+7)/8);
+    memset(&this->tags[0], 0, this->size);
+    memset(&this->keys[0], 0, this->size * K);
+    memset(&this->values[0], 0, this->size * V);
+    memset(this->values.data() + C * V, 0, (C+7)/8);
+    std::fill(this->index.begin(), this->index.end(), 0);
     this->size = 0;
-    memset(&this->space[0], 0, this->space.size());
 }
 
 /// @brief load kvpairs from file object
 /// @param loader loader takes a buffer and loads data into this buffer
 void KVPairs::Load(std::function<void(std::span<uint8_t>)> loader) {
     auto space = std::span{&this->space[0], this->space.size()};
+    this->Bind(space);
     loader(space);
-    this->size = this->capacity;
+    this->ReadHeader();
+}
+
+/// @brief read a serialized kvpairs in place without copying, e.g. from a memory mapped file. 
+///        the attached kvpairs is read only and the space must outlive it (or next Load). 
+/// @param space the serialized kvpairs, ByteSize() bytes
+void KVPairs::Attach(std::span<uint8_t> space) {
+    assert(space.size() == this->space.size());
+    this->Bind(space);
+    this->ReadHeader();
+}
+
+/// @brief take the number of entries from a loaded or attached header. 
+///        a block written before merge operands is only read if it has the same size, so its padding holds zeroed operand bits. 
+void KVPairs::ReadHeader() {
+    uint64_t size = 0;
+    memcpy(&size, &this->header[0], HEADER_BYTES);
+    bool is_misfit = !(size & HEADER_OPERANDS) && size != 0 && !this->fits_unflagged;
+    if (is_misfit) {
+        std::cerr << "kvpairs: block written before merge operands has a different size, rewrite it with the old version first" << std::endl;
+    }
+    assert(!is_misfit);
+    size &= ~HEADER_OPERANDS;
+    assert(size <= this->capacity);
+    this->size = size;
+    this->Reindex();
+}
+
+/// @brief move entries to a copy of space, e.g. when views still point into the current one
+/// @return the previous space, holding the same entries
+AlignedBuffer<uint8_t> KVPairs::Fork() {
+    auto space = AlignedBuffer<uint8_t>(this->space);
+    std::swap(space, this->space);
+    this->Bind(std::span{&this->space[0], this->space.size()});
+    return space;
+}
+
+/// @brief the number of bytes of a serialized kvpairs
+size_t KVPairs::ByteSize() {
+    return this->space.size();
+}
+
+/// @brief the number of bytes taken by hash index, 0 if not indexed
+size_t KVPairs::IndexByteSize() {
+    return this->index.size() * sizeof(uint64_t);
+}
+
+/// @brief move space and index to a numa node
+/// @param node the numa node
+void KVPairs::Bind(size_t node) {
+    this->space.Bind(node);
+    this->index.Bind(node);
 }
 
 #undef K
 #undef V
+#undef TAG
 
 } // namespace bloomstore
@@ -1,9 +1,32 @@
 #include<bloom_store.hpp>
+#include<hashing.hpp>
 #include<iostream>
+#include<algorithm>
+#include<cassert>
+#include<cstring>
+#include<utility>
+#include<thread>
 
 namespace bloomstore
 {
 
+// compressed blocks are stored as extents of 512-byte sectors, starting with the compressed length
+#define SECTOR_BYTES 512
+#define EXTENT_HEADER_BYTES sizeof(uint64_t)
+// block addresses keep the extent size in sectors on their top 16 bits
+#define EXTENT_SHIFT 48
+#define EXTENT_MAX_SECTORS 0xffff
+// and the tier on the bit below, set for blocks demoted to the cold kv file
+#define TIER_SHIFT 47
+#define BLOCK_OFFSET(address) ((address) & ((size_t{1} << TIER_SHIFT) - 1))
+// a bulk load writes staged blocks and chains once this many bytes piled up
+#define BULK_WRITE_BYTES (64 << 20)
+// the tail record holds the sizes of kv, bf, cold kv, cold bf and times files, 
+// the number of blocks sealed in the collector, their addresses and their seal times
+#define TAIL_WORDS (6 + 2 * BLOOMSTORE_CHAIN_WIDTH)
+#define TAIL_ADDRESSES 6
+#define TAIL_TIMES (6 + BLOOMSTORE_CHAIN_WIDTH)
+
 BloomStore::BloomStore(
     std::string& path_kv,
     std::string& path_bf,
@@ -12,20 +35,29 @@ BloomStore::BloomStore(
     size_t key_bytes,
     size_t value_bytes,
     size_t kv_ram_capacity,
-    size_t align
+    size_t align,
+    Device* device,
+    FileMode mode,
+    bool is_read_only
 ):
-    f_bloom_chains{path_bf},
-    f_kv_pairs{path_kv},
+    f_bloom_chains{path_bf, device, mode, is_read_only},
+    f_kv_pairs{path_kv, device, mode, is_read_only},
     bloom_chain_collector{bloom_filter_nslots, bloom_filter_nfuncs, align},
-    active_bloom_filter{bloom_filter_nslots, bloom_filter_nfuncs},
-    active_kv_pairs{key_bytes, value_bytes, kv_ram_capacity, align},
+    active_kv_pairs{key_bytes, value_bytes, kv_ram_capacity, align, true},
+    temp_kv_pairs{key_bytes, value_bytes, kv_ram_capacity, align},
+    temp_bloom_chain{bloom_filter_nslots, bloom_filter_nfuncs, align},
+    is_read_only{is_read_only},
     key_bytes{key_bytes},
     value_bytes{value_bytes},
     capacity{kv_ram_capacity},
     align{align},
     bloom_filter_nslots{bloom_filter_nslots},
     bloom_filter_nfuncs{bloom_filter_nfuncs}
-{}
+{
+    // blocks are read at random. chains are scanned newest to oldest on every miss, so they keep normal advice: 
+    // sequential readahead goes the wrong way and its free-behind would evict the chains every miss reads again
+    this->f_kv_pairs.Advise(FileAdvice::Random);
+}
 
 BloomStore::~BloomStore() {}
 
@@ -34,60 +66,266 @@ void BloomStore::Get(
     std::span<uint8_t> value, 
     bool& is_tombstone,
     bool& is_found
+) {
+    if (this->is_read_only) { this->Refresh(); }
+    this->stat_get_count += 1;
+    auto operands = std::vector<uint8_t>();
+    auto found = std::span<uint8_t>();
+    this->Find(key, found, operands, is_tombstone, is_found, 0);
+    if (is_found && !is_tombstone) { memcpy(&value[0], &found[0], this->value_bytes); }
+    this->Fold(operands, value, is_tombstone, is_found);
+}
+
+/// @brief look key up from active kvpairs down to chain oldest_chain, see Visit
+/// @param key          the inquired key
+/// @param found        set to the value in place, if a value is found
+/// @param operands     merge operands found on the way, newest first
+/// @param is_tombstone set to true iff key is deleted
+/// @param is_found     set to true iff a value or tombstone is found
+/// @param oldest_chain the oldest chain searched, older ones are not read
+void BloomStore::Find(
+    std::span<uint8_t> key, 
+    std::span<uint8_t>& found, 
+    std::vector<uint8_t>& operands, 
+    bool& is_tombstone, 
+    bool& is_found, 
+    size_t oldest_chain
 ) {
     is_tombstone = false;
     is_found = false; 
-    this->stat_get_count += 1;
     // try active kv pairs
-    if (this->active_bloom_filter.Test(key)) {
-        this->active_kv_pairs.Get(key, value, is_tombstone, is_found);
+    if (this->bloom_chain_collector.TestActive(key)) {
+        this->Visit(this->active_kv_pairs, key, found, operands, is_tombstone, is_found);
         if (is_found) { return; }
     }
     // try things on disk
-    auto temp_kvpairs = KVPairs(this->key_bytes, this->value_bytes, this->capacity, this->align);
-    auto try_bloom_chain = [&](bloomstore::PtrIterator&& pointer_iter) {
+    auto& temp_kvpairs = this->temp_kv_pairs;
+    auto try_bloom_chain = [&](bloomstore::PtrIterator&& pointer_iter, size_t chain) {
+        this->DropExpired(pointer_iter, chain);
         bool depleted = false;
         while (true) {
             size_t address;
             pointer_iter.Next(address, depleted);
             if (depleted) break;
-            temp_kvpairs.Load([&](std::span<uint8_t> span) {
-                this->stat_disk_read += 1;
-                this->f_kv_pairs.Read(address, span);
-            });
-            temp_kvpairs.Get(key, value, is_tombstone, is_found);
+            this->stat_disk_read += 1;
+            this->LoadBlock(temp_kvpairs, address);
+            bool is_hit = this->Visit(temp_kvpairs, key, found, operands, is_tombstone, is_found);
             if (is_found) return;
-            this->stat_false_positive += 1;
+            if (!is_hit) this->stat_false_positive += 1;
         }
     };
-    try_bloom_chain(std::move(this->bloom_chain_collector.Test(key)));
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto position = this->ChainBytes();
+    try_bloom_chain(std::move(this->bloom_chain_collector.Test(key)), position / bloom_chain.ByteSize());
     if (is_found) return;
-    auto bloom_chain = bloomstore::BloomChain(
-        this->bloom_filter_nslots, 
-        this->bloom_filter_nfuncs, 
-        this->align
-    );
-    this->f_bloom_chains.Seek(this->f_bloom_chains.Size());
-    while (true) {
-        bool is_read_successful = false;
-        bloom_chain.Load([&](std::span<uint8_t> span) {
-            this->stat_disk_read += 1;
-            is_read_successful 
-                = this->f_bloom_chains.ContinueReadRev(span);
-        });
-        if (!is_read_successful) return;
-        try_bloom_chain(std::move(bloom_chain.Test(key)));
+    // chains older than an expired or freed chain are expired or freed as well
+    auto floor = std::max(this->DroppedChains(), oldest_chain) * bloom_chain.ByteSize();
+    while (position >= floor + bloom_chain.ByteSize()) {
+        position -= bloom_chain.ByteSize();
+        this->stat_disk_read += 1;
+        this->LoadChain(bloom_chain, position);
+        try_bloom_chain(std::move(bloom_chain.Test(key)), position / bloom_chain.ByteSize());
         if (is_found) return;
     }
 }
 
+/// @brief check if key has an entry in active kvpairs, the collector or chains from oldest_chain on, without folding anything
+/// @param key          the inquired key
+/// @param oldest_chain the oldest chain searched
+/// @param is_operand   set to true iff only merge operands of key are found, they stack on an older value
+/// @return true iff some entry of key is found
+bool BloomStore::Probe(std::span<uint8_t> key, size_t oldest_chain, bool& is_operand) {
+    auto operands = std::vector<uint8_t>();
+    auto found = std::span<uint8_t>();
+    bool is_tombstone = false;
+    bool is_found = false;
+    this->Find(key, found, operands, is_tombstone, is_found, oldest_chain);
+    is_operand = !is_found && !operands.empty();
+    return is_found || is_operand;
+}
+
+/// @brief look key up in kvpairs on behalf of a read. a merge operand is stacked and the read goes on to older entries. 
+/// @param kvpairs      the searched kvpairs
+/// @param key          the inquired key
+/// @param value        set to the value in place, if a value is found
+/// @param operands     merge operands found so far, newest first
+/// @param is_tombstone set to true iff key is deleted here
+/// @param is_found     set to true iff a value or tombstone ends the read here
+/// @return true iff kvpairs has an entry of key
+bool BloomStore::Visit(KVPairs& kvpairs, std::span<uint8_t> key, std::span<uint8_t>& value, std::vector<uint8_t>& operands, bool& is_tombstone, bool& is_found) {
+    bool is_operand = false;
+    value = kvpairs.View(key, is_tombstone, is_found, is_operand);
+    if (!is_operand) { return is_found; }
+    operands.insert(operands.end(), value.begin(), value.end());
+    is_found = false;
+    return true;
+}
+
+/// @brief fold merge operands onto the value read under them, or zeros if the key is missing or deleted
+/// @param operands     merge operands, newest first
+/// @param value        the value read, updated in place
+/// @param is_tombstone set to false once there is an operand
+/// @param is_found     set to true once there is an operand
+void BloomStore::Fold(std::vector<uint8_t>& operands, std::span<uint8_t> value, bool& is_tombstone, bool& is_found) {
+    if (operands.empty()) { return; }
+    if (!this->merge_operator) {
+        std::cerr << "bloom store: merge operands found but no merge operator, call UseMergeOperator after reopening" << std::endl;
+    }
+    assert(this->merge_operator);
+    auto V = this->value_bytes;
+    if (!is_found || is_tombstone) { memset(&value[0], 0, V); }
+    for (size_t i = operands.size(); i > 0; i -= V) {
+        this->merge_operator->Merge(value, std::span{operands}.subspan(i - V, V));
+    }
+    is_found = true;
+    is_tombstone = false;
+}
+
+/// @brief get a key without copying its value, see ValueView. 
+///        a block read from disk is loaded once into pinned memory, a mapped block is not copied at all. 
+///        a value folded from merge operands is built in memory owned by the view. 
+/// @param key the inquired key
+/// @return the view of the value
+ValueView BloomStore::GetView(std::span<uint8_t> key) {
+    auto view = ValueView();
+    if (this->is_read_only) { this->Refresh(); }
+    this->stat_get_count += 1;
+    auto operands = std::vector<uint8_t>();
+    auto found = std::span<uint8_t>();
+    [&]() {
+        if (this->bloom_chain_collector.TestActive(key)) {
+            this->Visit(this->active_kv_pairs, key, found, operands, view.is_tombstone, view.is_found);
+            if (view.is_found) {
+                // writes fork active kvpairs while this pin is shared, see Unpin
+                if (!this->active_pin) { this->active_pin = std::make_shared<AlignedBuffer<uint8_t>>(0); }
+                view.pin = this->active_pin;
+                return;
+            }
+        }
+        auto& temp_kvpairs = this->temp_kv_pairs;
+        auto try_bloom_chain = [&](bloomstore::PtrIterator&& pointer_iter, size_t chain) {
+            this->DropExpired(pointer_iter, chain);
+            bool depleted = false;
+            while (true) {
+                size_t address;
+                pointer_iter.Next(address, depleted);
+                if (depleted) break;
+                this->stat_disk_read += 1;
+                auto pin = this->PinBlock(temp_kvpairs, address);
+                bool is_hit = this->Visit(temp_kvpairs, key, found, operands, view.is_tombstone, view.is_found);
+                if (view.is_found) {
+                    view.pin = std::move(pin);
+                    return;
+                }
+                if (!is_hit) this->stat_false_positive += 1;
+            }
+        };
+        auto& bloom_chain = this->temp_bloom_chain;
+        auto position = this->ChainBytes();
+        try_bloom_chain(std::move(this->bloom_chain_collector.Test(key)), position / bloom_chain.ByteSize());
+        if (view.is_found) return;
+        // chains older than an expired or freed chain are expired or freed as well
+        auto floor = this->DroppedChains() * bloom_chain.ByteSize();
+        while (position >= floor + bloom_chain.ByteSize()) {
+            position -= bloom_chain.ByteSize();
+            this->stat_disk_read += 1;
+            this->LoadChain(bloom_chain, position);
+            try_bloom_chain(std::move(bloom_chain.Test(key)), position / bloom_chain.ByteSize());
+            if (view.is_found) return;
+        }
+    }();
+    if (operands.empty()) {
+        if (view.is_found && !view.is_tombstone) { view.value = found; }
+        return view;
+    }
+    auto folded = std::make_shared<AlignedBuffer<uint8_t>>(this->value_bytes);
+    auto value = std::span{folded->data(), folded->size()};
+    if (view.is_found && !view.is_tombstone) { memcpy(&value[0], &found[0], this->value_bytes); }
+    this->Fold(operands, value, view.is_tombstone, view.is_found);
+    view.value = value;
+    view.pin = std::move(folded);
+    return view;
+}
+
+/// @brief stop sharing active kvpairs with views before it is written, views keep the entries as they were
+void BloomStore::Unpin() {
+    if (!this->active_pin) { return; }
+    if (this->active_pin.use_count() > 1) {
+        *this->active_pin = this->active_kv_pairs.Fork();
+    }
+    this->active_pin.reset();
+}
+
+/// @brief get a key without blocking, the task suspends on every chain and block read. 
+///        entries written while it is suspended may or may not be seen. 
+/// @param loop     the event loop running this task
+/// @param key      the inquired key, must stay alive until the task is done
+/// @param value    the value buffer, must stay alive until the task is done
+/// @return whether the key is found, and whether it is deleted
+Task<Lookup> BloomStore::AsyncGet(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value) {
+    auto result = Lookup();
+    if (this->is_read_only) { this->Refresh(); }
+    this->stat_get_count += 1;
+    auto operands = std::vector<uint8_t>();
+    auto found = std::span<uint8_t>();
+    if (this->bloom_chain_collector.TestActive(key)) {
+        this->Visit(this->active_kv_pairs, key, found, operands, result.is_tombstone, result.is_found);
+        if (result.is_found && !result.is_tombstone) { memcpy(&value[0], &found[0], this->value_bytes); }
+    }
+    if (result.is_found) { co_return result; }
+    // temp objects are shared with other tasks, so each task loads into its own
+    auto kvpairs = KVPairs(this->key_bytes, this->value_bytes, this->capacity, this->align);
+    auto bloom_chain = BloomChain(this->bloom_filter_nslots, this->bloom_filter_nfuncs, this->align);
+    // compressed extents are never larger than raw blocks
+    auto block_buffer = AlignedBuffer<uint8_t>(kvpairs.ByteSize());
+    auto chain_buffer = AlignedBuffer<uint8_t>(bloom_chain.ByteSize());
+    // collector may be sealed or dumped while suspended, take its candidates upfront
+    auto addresses = std::vector<size_t>();
+    auto collect = [&](bloomstore::PtrIterator&& pointer_iter, size_t chain) {
+        this->DropExpired(pointer_iter, chain);
+        addresses.clear();
+        bool depleted = false;
+        while (true) {
+            size_t address;
+            pointer_iter.Next(address, depleted);
+            if (depleted) break;
+            addresses.push_back(address);
+        }
+    };
+    auto position = this->ChainBytes();
+    auto floor = this->DroppedChains() * bloom_chain.ByteSize();
+    collect(std::move(this->bloom_chain_collector.Test(key)), position / bloom_chain.ByteSize());
+    while (!result.is_found) {
+        for (auto address: addresses) {
+            this->stat_disk_read += 1;
+            co_await this->AsyncLoadBlock(loop, kvpairs, std::span{block_buffer.data(), block_buffer.size()}, address);
+            bool is_hit = this->Visit(kvpairs, key, found, operands, result.is_tombstone, result.is_found);
+            if (result.is_found) {
+                if (!result.is_tombstone) { memcpy(&value[0], &found[0], this->value_bytes); }
+                break;
+            }
+            if (!is_hit) this->stat_false_positive += 1;
+        }
+        if (result.is_found || position < floor + bloom_chain.ByteSize()) { break; }
+        position -= bloom_chain.ByteSize();
+        this->stat_disk_read += 1;
+        co_await this->AsyncLoadChain(loop, bloom_chain, std::span{chain_buffer.data(), chain_buffer.size()}, position);
+        collect(std::move(bloom_chain.Test(key)), position / bloom_chain.ByteSize());
+    }
+    this->Fold(operands, value, result.is_tombstone, result.is_found);
+    co_return result;
+}
+
 void BloomStore::Put(
     std::span<uint8_t> key,
     std::span<uint8_t> value
 ) {
     this->stat_put_count += 1;
-    this->active_bloom_filter.Insert(key);
-    this->active_kv_pairs.Put(key, value);
+    this->Unpin();
+    // a key still in active buffer is already in the open filter column
+    if (this->active_kv_pairs.Put(key, value)) { return; }
+    this->bloom_chain_collector.Insert(key);
+    if (this->budget && this->budget->Charge(this->budget_id, this->key_bytes + this->value_bytes)) { this->Flush(); }
     this->TryFlush();
 }
 
@@ -95,21 +333,1141 @@ void BloomStore::Del(
     std::span<uint8_t> key
 ) {
     this->stat_put_count += 1;
-    this->active_bloom_filter.Insert(key);
-    this->active_kv_pairs.Del(key);
+    this->Unpin();
+    if (this->active_kv_pairs.Del(key)) { return; }
+    this->bloom_chain_collector.Insert(key);
+    if (this->budget && this->budget->Charge(this->budget_id, this->key_bytes + this->value_bytes)) { this->Flush(); }
+    this->TryFlush();
+}
+
+/// @brief put a key from a task without blocking on disk. a block it fills is sealed into memory, readable from there, 
+///        and written through the event loop while other tasks run, see AsyncCommit. 
+///        no Demote, Expire, Migrate or BulkLoad may run on this store until the loop has finished the task. 
+/// @param loop     the event loop running this task
+/// @param key      the inserted key, must stay alive until the task is done
+/// @param value    the inserted value, must stay alive until the task is done
+Task<void> BloomStore::AsyncPut(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value) {
+    assert(!this->is_loading);
+    this->stat_put_count += 1;
+    this->Unpin();
+    if (this->active_kv_pairs.Put(key, value)) { co_return; }
+    this->bloom_chain_collector.Insert(key);
+    bool must_flush = this->budget && this->budget->Charge(this->budget_id, this->key_bytes + this->value_bytes);
+    if (!must_flush && !this->active_kv_pairs.IsFull()) { co_return; }
+    this->is_staging = true;
+    this->Flush();
+    this->is_staging = false;
+    // the task writing already takes this block along
+    if (this->is_writing) { co_return; }
+    co_await this->AsyncCommit(loop);
+}
+
+/// @brief write staged blocks, chains and seal times through the event loop, then publish them to followers. 
+///        readers are served from staged bytes until they are written, see StagedBlock. 
+///        blocks sealed while it is suspended are staged behind and written by the next round. 
+/// @param loop the event loop running this task
+Task<void> BloomStore::AsyncCommit(EventLoop& loop) {
+    this->is_writing = true;
+    while (!this->staged_kv_pairs.empty() || !this->staged_bloom_chains.empty() || !this->staged_block_times.empty()) {
+        // a round writes what is staged now. blocks go first, so no chain on disk ever points past the end of kv file
+        size_t nblock_bytes = this->staged_kv_pairs.size();
+        size_t nchain_bytes = this->staged_bloom_chains.size();
+        size_t ntimes = this->staged_block_times.size();
+        co_await this->AsyncAppend(loop, this->f_kv_pairs, this->staged_kv_pairs, nblock_bytes);
+        co_await this->AsyncAppend(loop, this->f_bloom_chains, this->staged_bloom_chains, nchain_bytes);
+        if (ntimes != 0) {
+            // times file is mapped, aio would write it in place anyway
+            auto& times = this->staged_block_times;
+            this->f_block_times->Append(std::span{reinterpret_cast<uint8_t*>(times.data()), ntimes * sizeof(uint64_t)});
+            times.erase(times.begin(), times.begin() + ntimes);
+        }
+    }
+    this->is_writing = false;
+    this->PublishTail();
+}
+
+/// @brief append the first nbytes of staged bytes to file through the event loop, then drop them from staged bytes
+/// @param loop     the event loop running this task
+/// @param file     the appended file
+/// @param staged   the staged bytes, more may be staged behind while suspended
+/// @param nbytes   the number of appended bytes
+Task<void> BloomStore::AsyncAppend(EventLoop& loop, FileObject& file, std::vector<uint8_t>& staged, size_t nbytes) {
+    if (nbytes == 0) { co_return; }
+    if (file.IsMapped()) {
+        // kernel aio runs buffered writes synchronously anyway, a mapped file is appended in place
+        file.Append(std::span{staged}.subspan(0, nbytes));
+    }
+    else {
+        // direct io needs aligned memory, and staged bytes may move while suspended
+        auto buffer = AlignedBuffer<uint8_t>(nbytes);
+        memcpy(buffer.data(), staged.data(), nbytes);
+        co_await loop.Append(file, std::span{buffer.data(), buffer.size()});
+    }
+    // file has grown, readers go there from now on
+    staged.erase(staged.begin(), staged.begin() + nbytes);
+}
+
+/// @brief merge an operand into the value of key without reading it, see MergeOperator. 
+///        the operand is folded into a resident entry right away, otherwise it is folded when key is read. 
+/// @param key      the merged key
+/// @param operand  the merge operand, value_bytes long
+void BloomStore::Merge(std::span<uint8_t> key, std::span<uint8_t> operand) {
+    assert(this->merge_operator);
+    this->stat_put_count += 1;
+    this->Unpin();
+    if (this->active_kv_pairs.Merge(key, operand, *this->merge_operator)) { return; }
+    this->bloom_chain_collector.Insert(key);
+    if (this->budget && this->budget->Charge(this->budget_id, this->key_bytes + this->value_bytes)) { this->Flush(); }
     this->TryFlush();
 }
 
+/// @brief put a key, safe to call from several threads at once. 
+///        concurrent writes are never coalesced or charged to a memory budget, and blocks they fill never release it. 
+///        ConcurrentGet may run meanwhile, but no Put, Del, Write, Get or maintenance may run on this store 
+///        until writers are done and Flush is called. 
+/// @param key      the inserted key
+/// @param value    the inserted value
+void BloomStore::ConcurrentPut(std::span<uint8_t> key, std::span<uint8_t> value) {
+    this->ConcurrentWrite(key, value, false);
+}
+
+/// @brief delete a key, safe to call from several threads at once, see ConcurrentPut
+/// @param key the deleted key
+void BloomStore::ConcurrentDel(std::span<uint8_t> key) {
+    this->ConcurrentWrite(key, std::span<uint8_t>{}, true);
+}
+
+/// @brief get a key, safe to call from several threads at once and while ConcurrentPut and ConcurrentDel run. 
+///        active kvpairs is read up to the prefix writers have published, see KVPairs::Publish, 
+///        flushed blocks and chains are read while no writer seals a block. 
+/// @param key          the inquired key
+/// @param value        the value buffer
+/// @param is_tombstone set to true iff key is deleted
+/// @param is_found     set to true iff key has a value or tombstone
+void BloomStore::ConcurrentGet(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found) {
+    assert(!this->is_read_only);
+    std::atomic_ref<size_t>(this->stat_get_count).fetch_add(1, std::memory_order_relaxed);
+    // readers keep the lock shared back to back, a writer about to seal goes first
+    while (this->is_sealing.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    auto lock = std::shared_lock(this->seal_mutex);
+    auto operands = std::vector<uint8_t>();
+    bool is_operand = false;
+    auto found = this->active_kv_pairs.ConcurrentView(key, is_tombstone, is_found, is_operand);
+    if (is_operand) {
+        operands.insert(operands.end(), found.begin(), found.end());
+        is_found = false;
+    }
+    // temp objects are shared with Get, so each reader loads into its own
+    auto kvpairs = KVPairs(this->key_bytes, this->value_bytes, this->capacity, this->align);
+    auto bloom_chain = BloomChain(this->bloom_filter_nslots, this->bloom_filter_nfuncs, this->align);
+    size_t ndisk_read = 0;
+    size_t nfalse_positive = 0;
+    auto try_bloom_chain = [&](bloomstore::PtrIterator&& pointer_iter, size_t chain) {
+        this->DropExpired(pointer_iter, chain);
+        bool depleted = false;
+        while (true) {
+            size_t address;
+            pointer_iter.Next(address, depleted);
+            if (depleted) break;
+            ndisk_read += 1;
+            this->LoadBlock(kvpairs, address);
+            bool is_hit = this->Visit(kvpairs, key, found, operands, is_tombstone, is_found);
+            if (is_found) return;
+            if (!is_hit) nfalse_positive += 1;
+        }
+    };
+    auto position = this->ChainBytes();
+    if (!is_found) {
+        // writers set bits of the open column in the same words
+        try_bloom_chain(std::move(this->bloom_chain_collector.AtomicTest(key)), position / bloom_chain.ByteSize());
+    }
+    auto floor = this->DroppedChains() * bloom_chain.ByteSize();
+    while (!is_found && position >= floor + bloom_chain.ByteSize()) {
+        position -= bloom_chain.ByteSize();
+        ndisk_read += 1;
+        this->LoadChain(bloom_chain, position);
+        try_bloom_chain(std::move(bloom_chain.Test(key)), position / bloom_chain.ByteSize());
+    }
+    if (is_found && !is_tombstone) { memcpy(&value[0], &found[0], this->value_bytes); }
+    this->Fold(operands, value, is_tombstone, is_found);
+    std::atomic_ref<size_t>(this->stat_disk_read).fetch_add(ndisk_read, std::memory_order_relaxed);
+    std::atomic_ref<size_t>(this->stat_false_positive).fetch_add(nfalse_positive, std::memory_order_relaxed);
+}
+
+/// @brief reserve an entry of active kvpairs with fetch-add, set its filter bits and publish it. 
+///        the writer publishing the last entry flushes the block, writers that find it full wait for the next generation. 
+/// @param key          the written key
+/// @param value        the written value, empty for a tombstone
+/// @param is_tombstone whether the key is deleted
+void BloomStore::ConcurrentWrite(std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+    std::atomic_ref<size_t>(this->stat_put_count).fetch_add(1, std::memory_order_relaxed);
+    uint32_t hash_a = Hash(key, static_cast<uint32_t>('A'));
+    uint32_t hash_b = Hash(key, static_cast<uint32_t>('B'));
+    while (true) {
+        auto generation = this->generation.load(std::memory_order_acquire);
+        auto i = this->reserved.fetch_add(1, std::memory_order_acq_rel);
+        if (i < this->capacity) {
+            // filter bits go first, a published entry is always in the open column
+            this->bloom_chain_collector.AtomicInsertHashed(hash_a, hash_b);
+            if (this->active_kv_pairs.Publish(i, key, value, is_tombstone)) { this->Seal(); }
+            return;
+        }
+        while (this->generation.load(std::memory_order_acquire) == generation) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/// @brief collect addresses of all flushed blocks, from the newest to the oldest
+/// @param addresses the collected block addresses
+void BloomStore::ScanBlockAddresses(std::vector<size_t>& addresses) {
+    auto collect = [&](bloomstore::PtrIterator&& pointer_iter, size_t chain) {
+        this->DropExpired(pointer_iter, chain);
+        bool depleted = false;
+        while (true) {
+            size_t address;
+            pointer_iter.Next(address, depleted);
+            if (depleted) break;
+            addresses.push_back(address);
+        }
+    };
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto position = this->ChainBytes();
+    collect(this->bloom_chain_collector.Enumerate(), position / bloom_chain.ByteSize());
+    auto floor = this->DroppedChains() * bloom_chain.ByteSize();
+    while (position >= floor + bloom_chain.ByteSize()) {
+        position -= bloom_chain.ByteSize();
+        this->LoadChain(bloom_chain, position);
+        collect(bloom_chain.Enumerate(), position / bloom_chain.ByteSize());
+    }
+}
+
+/// @brief flush, and tell where blocks flushed from now on start, see Partitioner::Migrate
+/// @param end_chain    set to the number of chains dumped so far
+/// @param nsealed      set to the number of blocks sealed in the collector, the oldest blocks of chain end_chain
+void BloomStore::Checkpoint(size_t& end_chain, size_t& nsealed) {
+    assert(!this->is_writing);
+    this->Flush();
+    end_chain = this->f_bloom_chains.Size() / this->temp_bloom_chain.ByteSize();
+    nsealed = 0;
+    auto pointer_iter = this->bloom_chain_collector.Enumerate();
+    bool depleted = false;
+    while (true) {
+        size_t address;
+        pointer_iter.Next(address, depleted);
+        if (depleted) break;
+        nsealed += 1;
+    }
+}
+
+/// @brief collect addresses of blocks flushed before a checkpoint, from the newest to the oldest, see Checkpoint
+/// @param addresses    the collected block addresses
+/// @param end_chain    the number of chains dumped at the checkpoint
+/// @param nsealed      the number of blocks sealed in the collector at the checkpoint
+/// @return the number of collected blocks that were sealed in the collector, they come first
+size_t BloomStore::ScanBlockAddresses(std::vector<size_t>& addresses, size_t end_chain, size_t nsealed) {
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto chain_bytes = bloom_chain.ByteSize();
+    auto enumerate = [&](size_t chain) {
+        if (chain == this->f_bloom_chains.Size() / chain_bytes) { return this->bloom_chain_collector.Enumerate(); }
+        this->LoadChain(bloom_chain, chain * chain_bytes);
+        return bloom_chain.Enumerate();
+    };
+    auto collect = [&](bloomstore::PtrIterator& pointer_iter, size_t nskipped) {
+        size_t ncollected = 0;
+        bool depleted = false;
+        while (true) {
+            size_t address;
+            pointer_iter.Next(address, depleted);
+            if (depleted) break;
+            if (nskipped > 0) {
+                nskipped -= 1;
+                continue;
+            }
+            addresses.push_back(address);
+            ncollected += 1;
+        }
+        return ncollected;
+    };
+    size_t ncollected = 0;
+    if (nsealed != 0) {
+        // the sealed blocks are the oldest of chain end_chain, dumped since or still in the collector. 
+        // blocks sealed later are newer and expired blocks are older, so only the newest blocks are skipped
+        auto pointer_iter = enumerate(end_chain);
+        auto counter = pointer_iter;
+        size_t nblocks = 0;
+        bool depleted = false;
+        while (true) {
+            size_t address;
+            counter.Next(address, depleted);
+            if (depleted) break;
+            nblocks += 1;
+        }
+        this->DropExpired(pointer_iter, end_chain);
+        ncollected = collect(pointer_iter, nblocks - std::min(nblocks, nsealed));
+    }
+    for (auto chain = end_chain; chain > this->DroppedChains(); --chain) {
+        auto pointer_iter = enumerate(chain - 1);
+        this->DropExpired(pointer_iter, chain - 1);
+        collect(pointer_iter, 0);
+    }
+    return ncollected;
+}
+
+/// @brief visit entries of a flushed block, from the newest to the oldest
+/// @param address  the block address
+/// @param visitor  called with key, value and tombstone flag of each entry
+void BloomStore::ScanBlock(size_t address, KVVisitor visitor) {
+    this->LoadBlock(this->temp_kv_pairs, address);
+    // a merge operand is visited as the value read at the moment, folded with older entries
+    auto operand_keys = std::vector<uint8_t>();
+    this->temp_kv_pairs.ForEach(visitor, [&](std::span<uint8_t> key) {
+        operand_keys.insert(operand_keys.end(), key.begin(), key.end());
+    });
+    auto value = std::vector<uint8_t>(this->value_bytes);
+    for (size_t i = 0; i < operand_keys.size(); i += this->key_bytes) {
+        auto key = std::span{operand_keys}.subspan(i, this->key_bytes);
+        bool is_tombstone = false;
+        bool is_found = false;
+        this->Get(key, std::span{value}, is_tombstone, is_found);
+        visitor(key, std::span{value}, is_tombstone || !is_found);
+    }
+}
+
+/// @brief load a flushed block, in place when the kv file is mapped and block is not compressed
+/// @param kvpairs  the loaded kvpairs
+/// @param address  the block address
+void BloomStore::LoadBlock(KVPairs& kvpairs, size_t address) {
+    auto& file = this->BlockFile(address);
+    size_t offset = BLOCK_OFFSET(address);
+    size_t nsectors = address >> EXTENT_SHIFT;
+    if (nsectors == 0 && file.IsMapped() && offset < file.Size()) {
+        kvpairs.Attach(file.Map(offset, kvpairs.ByteSize()));
+        return;
+    }
+    kvpairs.Load([&](std::span<uint8_t> span) {
+        this->ReadBlock(address, span);
+    });
+}
+
+/// @brief read a flushed block into space, decompressing it if it is stored as an extent
+/// @param address  the block address
+/// @param space    the serialized block is written here, ByteSize() bytes
+void BloomStore::ReadBlock(size_t address, std::span<uint8_t> space) {
+    auto& file = this->BlockFile(address);
+    size_t offset = BLOCK_OFFSET(address);
+    size_t nsectors = address >> EXTENT_SHIFT;
+    auto staged = this->StagedBlock(address);
+    if (nsectors == 0) {
+        if (!staged.empty()) { memcpy(&space[0], &staged[0], space.size()); }
+        else { file.Read(offset, space); }
+        return;
+    }
+    assert(this->codec);
+    auto extent = std::span<uint8_t>{};
+    auto extent_buffer = AlignedBuffer<uint8_t>(0);
+    if (!staged.empty()) {
+        extent = staged.subspan(0, nsectors * SECTOR_BYTES);
+    }
+    else if (file.IsMapped()) {
+        extent = file.Map(offset, nsectors * SECTOR_BYTES);
+    }
+    else {
+        extent_buffer = AlignedBuffer<uint8_t>(nsectors * SECTOR_BYTES);
+        extent = std::span{extent_buffer.data(), extent_buffer.size()};
+        file.Read(offset, extent);
+    }
+    uint64_t length = 0;
+    memcpy(&length, &extent[0], EXTENT_HEADER_BYTES);
+    this->codec->Decompress(extent.subspan(EXTENT_HEADER_BYTES, length), space);
+}
+
+/// @brief load a flushed block into memory that outlives kvpairs, in place from the mapping if possible
+/// @param kvpairs  the loaded kvpairs, attached to the pinned memory
+/// @param address  the block address
+/// @return the pin keeping the memory alive
+std::shared_ptr<void> BloomStore::PinBlock(KVPairs& kvpairs, size_t address) {
+    auto& file = this->BlockFile(address);
+    if ((address >> EXTENT_SHIFT) == 0 && file.IsMapped() && this->StagedBlock(address).empty()) {
+        this->LoadBlock(kvpairs, address);
+        return file.Pin();
+    }
+    auto block = std::make_shared<AlignedBuffer<uint8_t>>(kvpairs.ByteSize());
+    auto space = std::span{block->data(), block->size()};
+    this->ReadBlock(address, space);
+    kvpairs.Attach(space);
+    return block;
+}
+
+/// @brief load a flushed chain, in place when the bf file is mapped
+/// @param bloom_chain  the loaded bloom chain
+/// @param position     the chain position in bf files
+void BloomStore::LoadChain(BloomChain& bloom_chain, size_t position) {
+    auto& file = this->ChainFile(position);
+    auto staged = this->StagedChain(position);
+    if (!staged.empty()) {
+        bloom_chain.Load([&](std::span<uint8_t> span) {
+            memcpy(&span[0], &staged[0], span.size());
+        });
+        return;
+    }
+    if (file.IsMapped()) {
+        bloom_chain.Attach(file.Map(position, bloom_chain.ByteSize()));
+        return;
+    }
+    bloom_chain.Load([&](std::span<uint8_t> span) {
+        file.Read(position, span);
+    });
+}
+
 void BloomStore::TryFlush() {
     if (this->active_kv_pairs.IsFull()) {
-        auto address = this->f_kv_pairs.Size();
-        this->active_kv_pairs.Dump(this->f_kv_pairs);
-        this->bloom_chain_collector.Join(this->active_bloom_filter, address);
-        this->active_bloom_filter.Clear();
+        this->Flush();
     }
+}
+
+/// @brief seal active kvpairs into a block even if it is not full, e.g. when memory budget runs out
+void BloomStore::Flush() {
+    if (this->active_kv_pairs.IsEmpty()) { return; }
+    this->Seal();
+    if (this->budget) { this->budget->Release(this->budget_id); }
+    if (this->IsStaging()) { return; }
+    // holes left for views or followers are retried every now and then
+    if (!this->holes.empty()) { this->PunchHoles(); }
+    // staged blocks are not in kv file yet, demoting waits for an unstaged flush
+    if (this->auto_hot_chains == SIZE_MAX) { return; }
+    auto total_chains = this->f_bloom_chains.Size() / this->temp_bloom_chain.ByteSize();
+    if (this->cold_chains + this->auto_hot_chains < total_chains) { this->Demote(this->auto_hot_chains, 1); }
+}
+
+/// @brief write active kvpairs out as a block and seal its filter column, without touching the memory budget. 
+///        concurrent writers seal full blocks through here, they never charged the budget and must not release it. 
+void BloomStore::Seal() {
+    // concurrent readers may be reading the block and the files
+    this->is_sealing.store(true, std::memory_order_release);
+    auto lock = std::unique_lock(this->seal_mutex);
+    this->Unpin();
+    size_t address = 0;
+    this->active_kv_pairs.Dump([&](std::span<uint8_t> span) {
+        address = this->AppendBlock(span);
+    });
+    // the active filter is the open column of collector, sealing it is all it takes
+    this->bloom_chain_collector.Seal(address);
+    this->sealed_times.push_back(Now());
     if (this->bloom_chain_collector.IsFull()) {
-        this->bloom_chain_collector.Dump(this->f_bloom_chains);
+        this->bloom_chain_collector.Dump([&](std::span<uint8_t> span) {
+            this->AppendChain(span);
+        });
+        this->AppendTimes();
+    }
+    // staged blocks are published by Commit once they are written
+    if (!this->IsStaging()) { this->PublishTail(); }
+    // concurrent writers reserve entries of the next block from here on
+    this->reserved.store(0, std::memory_order_release);
+    this->generation.fetch_add(1, std::memory_order_release);
+    this->is_sealing.store(false, std::memory_order_release);
+}
+
+/// @brief load a block through event loop, a mapped file or a staged block is read right away
+/// @param loop     the event loop
+/// @param kvpairs  the loaded kvpairs, attached to buffer
+/// @param buffer   the space kvpairs is read into, ByteSize() bytes owned by the calling task
+/// @param address  the block address
+Task<void> BloomStore::AsyncLoadBlock(EventLoop& loop, KVPairs& kvpairs, std::span<uint8_t> buffer, size_t address) {
+    auto& file = this->BlockFile(address);
+    if (file.IsMapped() || !this->StagedBlock(address).empty()) {
+        this->LoadBlock(kvpairs, address);
+        co_return;
+    }
+    size_t offset = BLOCK_OFFSET(address);
+    size_t nsectors = address >> EXTENT_SHIFT;
+    if (nsectors != 0) {
+        assert(this->codec);
+        auto extent = buffer.subspan(0, nsectors * SECTOR_BYTES);
+        co_await loop.Read(file, offset, extent);
+        uint64_t length = 0;
+        memcpy(&length, &extent[0], EXTENT_HEADER_BYTES);
+        kvpairs.Load([&](std::span<uint8_t> span) {
+            this->codec->Decompress(extent.subspan(EXTENT_HEADER_BYTES, length), span);
+        });
+        co_return;
+    }
+    co_await loop.Read(file, offset, buffer);
+    kvpairs.Attach(buffer);
+}
+
+/// @brief load a chain through event loop, a mapped file or a staged chain is read right away
+/// @param loop         the event loop
+/// @param bloom_chain  the loaded chain, attached to buffer
+/// @param buffer       the space the chain is read into, ByteSize() bytes owned by the calling task
+/// @param position     the chain position in bf files
+Task<void> BloomStore::AsyncLoadChain(EventLoop& loop, BloomChain& bloom_chain, std::span<uint8_t> buffer, size_t position) {
+    auto& file = this->ChainFile(position);
+    if (file.IsMapped() || !this->StagedChain(position).empty()) {
+        this->LoadChain(bloom_chain, position);
+        co_return;
+    }
+    co_await loop.Read(file, position, buffer);
+    bloom_chain.Attach(buffer);
+}
+
+/// @brief append a serialized block to kv file, compressed into an extent when a codec is used. 
+///        while staging, it is written later at the end of file. 
+/// @param block the serialized block
+/// @return the block address, with the extent size in sectors on its top bits (0 for a raw block)
+size_t BloomStore::AppendBlock(std::span<uint8_t> block) {
+    size_t offset = this->f_kv_pairs.Size() + this->staged_kv_pairs.size();
+    assert(offset < (size_t{1} << TIER_SHIFT));
+    size_t nsectors = 0;
+    auto extent = block;
+    if (this->codec) {
+        auto& buffer = this->compressed_block;
+        buffer.assign(EXTENT_HEADER_BYTES, 0);
+        this->codec->Compress(block, buffer);
+        uint64_t length = buffer.size() - EXTENT_HEADER_BYTES;
+        memcpy(&buffer[0], &length, EXTENT_HEADER_BYTES);
+        buffer.resize((buffer.size() + SECTOR_BYTES - 1) / SECTOR_BYTES * SECTOR_BYTES, 0);
+        // incompressible blocks stay raw
+        if (buffer.size() < block.size() && buffer.size() / SECTOR_BYTES <= EXTENT_MAX_SECTORS) {
+            nsectors = buffer.size() / SECTOR_BYTES;
+            extent = std::span{buffer};
+        }
+    }
+    if (this->IsStaging()) {
+        this->staged_kv_pairs.insert(this->staged_kv_pairs.end(), extent.begin(), extent.end());
+    }
+    else {
+        this->f_kv_pairs.Append(extent);
+    }
+    return offset | (nsectors << EXTENT_SHIFT);
+}
+
+/// @brief append a serialized chain to bf file, while staging it is written later
+/// @param chain the serialized chain
+void BloomStore::AppendChain(std::span<uint8_t> chain) {
+    if (this->IsStaging()) {
+        this->staged_bloom_chains.insert(this->staged_bloom_chains.end(), chain.begin(), chain.end());
+    }
+    else {
+        this->f_bloom_chains.Append(chain);
+    }
+}
+
+/// @brief keep seal times of the chain just dumped, they are written after the chain like chains are written after blocks
+void BloomStore::AppendTimes() {
+    auto& times = this->sealed_times;
+    if (this->f_block_times) {
+        this->block_times.insert(this->block_times.end(), times.begin(), times.end());
+        if (this->IsStaging()) {
+            this->staged_block_times.insert(this->staged_block_times.end(), times.begin(), times.end());
+        }
+        else {
+            this->f_block_times->Append(std::span{reinterpret_cast<uint8_t*>(times.data()), times.size() * sizeof(uint64_t)});
+        }
+    }
+    times.clear();
+}
+
+/// @brief compress flushed blocks with codec, blocks flushed before stay readable
+/// @param codec the codec, must be used again whenever the store is reopened
+void BloomStore::UseCodec(Codec& codec) {
+    this->codec = &codec;
+}
+
+/// @brief write blocks and chains staged during a batch, one append for each file. 
+///        blocks go first, so no chain on disk ever points past the end of kv file. 
+/// @param io_class the io class the appends are scheduled as
+void BloomStore::Commit(IOClass io_class) {
+    // the task writing blocks sealed by AsyncPut takes these along, behind them
+    if (this->is_writing) { return; }
+    if (!this->staged_kv_pairs.empty()) {
+        this->f_kv_pairs.Append(std::span{this->staged_kv_pairs}, io_class);
+        this->staged_kv_pairs.clear();
+    }
+    if (!this->staged_bloom_chains.empty()) {
+        this->f_bloom_chains.Append(std::span{this->staged_bloom_chains}, io_class);
+        this->staged_bloom_chains.clear();
+    }
+    if (!this->staged_block_times.empty()) {
+        auto& times = this->staged_block_times;
+        this->f_block_times->Append(std::span{reinterpret_cast<uint8_t*>(times.data()), times.size() * sizeof(uint64_t)}, io_class);
+        times.clear();
+    }
+    this->PublishTail();
+}
+
+/// @brief apply entries [begin, end) of a batch, all routed to this partition. 
+///        filter bits and entries are added a block at a time, and blocks filled by the batch are written together. 
+///        an atomic slice is sealed into one block, so it can't be larger than a block. 
+/// @param batch    the write batch
+/// @param begin    the first applied entry
+/// @param end      one past the last applied entry
+/// @return false if the slice is atomic and larger than a block, then nothing is applied
+bool BloomStore::Write(WriteBatch& batch, size_t begin, size_t end) {
+    auto K = this->key_bytes;
+    auto V = this->value_bytes;
+    if (batch.atomic && end - begin > this->capacity) { return false; }
+    batch.HashEntries();
+    this->Unpin();
+    // an atomic slice must not straddle two blocks
+    if (batch.atomic && end - begin > this->active_kv_pairs.Remaining()) {
+        this->Flush();
+    }
+    this->is_staging = true;
+    while (begin < end) {
+        auto chunk = std::min(end - begin, this->active_kv_pairs.Remaining());
+        size_t appended = 0;
+        for (auto i = begin; i < begin + chunk; ++i) {
+            auto& entry = batch.entries[i];
+            auto key = std::span{&batch.bytes[entry.offset], K};
+            bool is_coalesced = entry.is_tombstone ?
+                this->active_kv_pairs.Del(key) :
+                this->active_kv_pairs.Put(key, std::span{&batch.bytes[entry.offset + K], V});
+            if (is_coalesced) { continue; }
+            this->bloom_chain_collector.InsertHashed(entry.hash_a, entry.hash_b);
+            appended += 1;
+        }
+        this->stat_put_count += chunk;
+        if (this->budget && this->budget->Charge(this->budget_id, appended * (K + V))) { this->Flush(); }
+        this->TryFlush();
+        begin += chunk;
+    }
+    this->is_staging = false;
+    this->Commit();
+    return true;
+}
+
+/// @brief move active kvpairs, collector and scratch objects to a numa node, e.g. the home node of this partition
+/// @param node the numa node
+void BloomStore::Bind(size_t node) {
+    this->active_kv_pairs.Bind(node);
+    this->bloom_chain_collector.Bind(node);
+    this->temp_kv_pairs.Bind(node);
+    this->temp_bloom_chain.Bind(node);
+}
+
+/// @brief load many records at once. blocks and chains are built in memory, written with large unsynced appends, 
+///        and synced once at the end, then every record is on disk. records are applied in order, newer than anything before. 
+///        it doesn't touch the memory budget, early flushes would leave padded blocks all over the load. 
+///        a large load may come in several calls, e.g. chunks of a file, only the last one flushes and syncs. 
+/// @param records  key value records, key_bytes + value_bytes each
+/// @param offsets  the offsets of records routed to this partition
+/// @param is_last  false if more records follow in another call, nothing else may touch the store in between
+void BloomStore::BulkLoad(std::span<uint8_t> records, std::span<size_t> offsets, bool is_last) {
+    auto K = this->key_bytes;
+    auto V = this->value_bytes;
+    assert(!this->is_writing);
+    if (!this->is_loading) {
+        // entries buffered before are charged to budget, they are released before it is put aside
+        this->Flush();
+        this->load_budget = std::exchange(this->budget, nullptr);
+        this->f_kv_pairs.Unsync();
+        this->f_bloom_chains.Unsync();
+        this->is_loading = true;
+    }
+    this->is_staging = true;
+    for (auto offset: offsets) {
+        auto key = records.subspan(offset, K);
+        this->stat_put_count += 1;
+        if (!this->active_kv_pairs.Put(key, records.subspan(offset + K, V))) {
+            this->bloom_chain_collector.Insert(key);
+        }
+        this->TryFlush();
+        if (this->staged_kv_pairs.size() >= BULK_WRITE_BYTES) { this->Commit(IOClass::Background); }
+    }
+    // the active block stays open for the next call, so chunk ends leave no padded blocks behind
+    if (!is_last) { return; }
+    this->Flush();
+    this->is_staging = false;
+    this->Commit(IOClass::Background);
+    this->f_kv_pairs.Sync();
+    this->f_bloom_chains.Sync();
+    this->budget = std::exchange(this->load_budget, nullptr);
+    this->is_loading = false;
+}
+
+/// @brief fold merge operands with a merge operator, needed before Merge is called
+/// @param merge_operator the merge operator, must be used again whenever the store is reopened
+void BloomStore::UseMergeOperator(MergeOperator& merge_operator) {
+    this->merge_operator = &merge_operator;
+}
+
+/// @brief keep old blocks and chains in a second (slower, larger) pair of files, moved there by Demote. 
+///        chains keep their positions, the oldest cold_chains of them are read from the cold bf file. 
+/// @param path_kv  the cold kv file
+/// @param path_bf  the cold bf file
+/// @param device   the device holding cold files, nullptr for unbounded io
+/// @param mode     the io mode of cold files
+void BloomStore::UseColdTier(std::string& path_kv, std::string& path_bf, Device* device, FileMode mode) {
+    this->f_cold_kv_pairs = std::make_unique<FileObject>(path_kv, device, mode, this->is_read_only);
+    this->f_cold_bloom_chains = std::make_unique<FileObject>(path_bf, device, mode, this->is_read_only);
+    this->f_cold_kv_pairs->Advise(FileAdvice::Random);
+    // a demoted chain is appended to cold bf file only after its blocks, so every cold chain is complete
+    this->cold_chains = this->f_cold_bloom_chains->Size() / this->temp_bloom_chain.ByteSize();
+    this->RecoverHoles();
+}
+
+/// @brief demote on the writing thread from now on: whenever a flush leaves more than hot_chains chains hot, 
+///        the oldest one is moved, so cold files keep up with writes a chain at a time without Demote calls. 
+/// @param hot_chains the number of newest chains that stay in hot files, SIZE_MAX stops demoting
+void BloomStore::AutoDemote(size_t hot_chains) {
+    assert(hot_chains == SIZE_MAX || (this->f_cold_kv_pairs && this->f_cold_bloom_chains));
+    this->auto_hot_chains = hot_chains;
+}
+
+/// @brief move the oldest chains and their blocks to cold files, keeping the newest hot_chains chains hot. 
+///        blocks are appended to cold kv file before their chain, then freed from hot files by punching holes. 
+///        call it every now and then between requests, like Partitioner::Migrate. 
+///        chains a migration is still scanning by block address stay where they are, see Partitioner::Migrate. 
+/// @param hot_chains   the number of newest chains that stay in hot files
+/// @param nchains      the most chains moved in this call
+/// @return true iff no chain is older than hot_chains any more
+bool BloomStore::Demote(size_t hot_chains, size_t nchains) {
+    assert(this->f_cold_kv_pairs && this->f_cold_bloom_chains);
+    assert(!this->is_writing);
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto chain_bytes = bloom_chain.ByteSize();
+    auto block_bytes = this->temp_kv_pairs.ByteSize();
+    auto total_chains = this->f_bloom_chains.Size() / chain_bytes;
+    auto buffer = AlignedBuffer<uint8_t>(block_bytes);
+    auto moved = std::vector<size_t>();
+    for (size_t n = 0; n < nchains && this->cold_chains + hot_chains < total_chains && this->cold_chains >= this->held_chains; ++n) {
+        auto position = this->cold_chains * chain_bytes;
+        if (this->cold_chains < this->ExpiredChains()) {
+            // an expired chain is freed instead of moved, the cold bf file keeps a zeroed chain in its place. 
+            // chains are reclaimed in order, so older expired chains Expire has not got to yet go first
+            while (this->reclaimed_chains <= this->cold_chains) { this->ReclaimChain(); }
+            auto zeros = AlignedBuffer<uint8_t>(chain_bytes, 0);
+            this->f_cold_bloom_chains->Append(std::span{zeros.data(), zeros.size()}, IOClass::Background);
+            this->cold_chains += 1;
+            continue;
+        }
+        // a copy, a chain attached to the mapping is read only
+        bloom_chain.Load([&](std::span<uint8_t> span) {
+            this->f_bloom_chains.Read(position, span, IOClass::Background);
+        });
+        moved.clear();
+        bloom_chain.Relocate([&](size_t address) {
+            size_t nsectors = address >> EXTENT_SHIFT;
+            auto extent = std::span{buffer.data(), this->BlockBytes(address)};
+            this->f_kv_pairs.Read(BLOCK_OFFSET(address), extent, IOClass::Background);
+            size_t offset = this->f_cold_kv_pairs->Size();
+            assert(offset < (size_t{1} << TIER_SHIFT));
+            this->f_cold_kv_pairs->Append(extent, IOClass::Background);
+            moved.push_back(address);
+            return offset | (size_t{1} << TIER_SHIFT) | (nsectors << EXTENT_SHIFT);
+        });
+        bloom_chain.Dump([&](std::span<uint8_t> span) {
+            this->f_cold_bloom_chains->Append(span, IOClass::Background);
+        });
+        this->cold_chains += 1;
+        for (auto address: moved) { this->AddHole(address); }
+        this->AddHole(this->f_bloom_chains, position, chain_bytes);
+    }
+    // followers learn the chains are cold before their hot copies go
+    this->PublishTail();
+    this->PunchHoles();
+    return this->cold_chains + hot_chains >= total_chains;
+}
+
+/// @brief the number of bytes a flushed block takes in its kv file
+/// @param address the block address
+size_t BloomStore::BlockBytes(size_t address) {
+    size_t nsectors = address >> EXTENT_SHIFT;
+    return nsectors == 0 ? this->temp_kv_pairs.ByteSize() : nsectors * SECTOR_BYTES;
+}
+
+/// @brief free a block that is never read again once nothing may read it any more, see PunchHoles
+/// @param address the block address
+void BloomStore::AddHole(size_t address) {
+    this->AddHole(this->BlockFile(address), BLOCK_OFFSET(address), this->BlockBytes(address));
+}
+
+/// @brief free a range of a file once nothing may read it any more, see PunchHoles. 
+///        blocks are freed one after another, neighbouring holes not published yet are merged so whole filesystem blocks are freed. 
+/// @param file     the file
+/// @param offset   the first freed byte
+/// @param length   the number of freed bytes
+void BloomStore::AddHole(FileObject& file, size_t offset, size_t length) {
+    for (auto hole = this->holes.rbegin(); hole != this->holes.rend() && hole->sequence == 0; ++hole) {
+        if (hole->file != &file) { continue; }
+        if (hole->offset + hole->length == offset) {
+            hole->length += length;
+            return;
+        }
+        break;
+    }
+    this->holes.push_back({&file, offset, length, 0});
+}
+
+/// @brief punch holes added so far. views may still read freed blocks through the mapping, 
+///        and followers may still read freed chains and blocks until they acknowledge a tail record without them. 
+///        such holes wait, a later call punches them. 
+void BloomStore::PunchHoles() {
+    auto acknowledged = this->tail ? this->tail->Acknowledged() : UINT64_MAX;
+    std::erase_if(this->holes, [&](Hole& hole) {
+        bool is_followed = this->tail && (hole.sequence == 0 || hole.sequence > acknowledged);
+        if (is_followed || hole.file->IsPinned()) { return false; }
+        hole.file->Punch(hole.offset, hole.length);
+        return true;
+    });
+}
+
+/// @brief punch holes deferred before the store was last closed, they are not kept anywhere. 
+///        chains are demoted and freed oldest first, and blocks are appended in the order of their chains, 
+///        so everything in a kv file before the first block of its oldest live chain is free. 
+///        punching a hole again is harmless, so the whole range is punched on every open. 
+void BloomStore::RecoverHoles() {
+    if (this->is_read_only) { return; }
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto chain_bytes = bloom_chain.ByteSize();
+    auto total_chains = this->f_bloom_chains.Size() / chain_bytes;
+    // the first block of the oldest chain from chain on in file, or the end of file if chains from chain on live in another file. 
+    // chains freed by FreeChains are not counted after reopening, they read as zeros and are skipped
+    auto first_block = [&](size_t chain, size_t end_chain, FileObject& file) {
+        size_t first = file.Size();
+        for (; chain < end_chain && first == file.Size(); ++chain) {
+            this->LoadChain(bloom_chain, chain * chain_bytes);
+            auto pointer_iter = bloom_chain.Enumerate();
+            bool depleted = false;
+            while (true) {
+                size_t address;
+                pointer_iter.Next(address, depleted);
+                if (depleted) break;
+                first = std::min(first, BLOCK_OFFSET(address));
+            }
+        }
+        return first;
+    };
+    // hot chains before the oldest live one are demoted or reclaimed
+    auto hot_chain = std::max(this->cold_chains, this->reclaimed_chains);
+    if (hot_chain > 0) {
+        size_t end = first_block(hot_chain, total_chains, this->f_kv_pairs);
+        if (end > 0) { this->AddHole(this->f_kv_pairs, 0, end); }
     }
+    if (this->f_cold_kv_pairs && this->reclaimed_chains > 0) {
+        size_t end = first_block(this->reclaimed_chains, this->cold_chains, *this->f_cold_kv_pairs);
+        if (end > 0) { this->AddHole(*this->f_cold_kv_pairs, 0, end); }
+    }
+    this->PublishTail();
+    this->PunchHoles();
+}
+
+/// @brief free a chain and its blocks, hot or cold, the file offsets of everything else stay the same
+/// @param position the chain position in bf files
+void BloomStore::DropChain(size_t position) {
+    auto& bloom_chain = this->temp_bloom_chain;
+    auto& file = this->ChainFile(position);
+    bloom_chain.Load([&](std::span<uint8_t> span) {
+        file.Read(position, span, IOClass::Background);
+    });
+    auto pointer_iter = bloom_chain.Enumerate();
+    bool depleted = false;
+    while (true) {
+        size_t address;
+        pointer_iter.Next(address, depleted);
+        if (depleted) break;
+        this->AddHole(address);
+    }
+    this->AddHole(file, position, bloom_chain.ByteSize());
+}
+
+/// @brief free the oldest chains before end_chain, once entries still live in them are written again, see Partitioner::Migrate. 
+///        like expired chains they keep their offsets and read as zeros, gets stop above them. 
+///        a reopened store without ttl reads them again, they hold no filter bits so no block is read. 
+/// @param end_chain the first chain kept
+void BloomStore::FreeChains(size_t end_chain) {
+    assert(!this->is_read_only && this->ttl == 0);
+    for (; this->reclaimed_chains < end_chain; ++this->reclaimed_chains) {
+        this->DropChain(this->reclaimed_chains * this->temp_bloom_chain.ByteSize());
+    }
+    this->PublishTail();
+    this->PunchHoles();
+}
+
+/// @brief free the oldest chain not reclaimed yet, it must be expired. 
+///        its seal times are punched to zeros first, so a reopened store counts it as reclaimed (see UseTTL) 
+///        and a crash in between leaks the chain instead of freeing it twice. 
+void BloomStore::ReclaimChain() {
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    auto chain = this->reclaimed_chains;
+    assert(chain < this->ExpiredChains());
+    assert((chain + 1) * W * sizeof(uint64_t) <= this->f_block_times->Size());
+    this->f_block_times->Punch(chain * W * sizeof(uint64_t), W * sizeof(uint64_t));
+    this->DropChain(chain * this->temp_bloom_chain.ByteSize());
+    this->reclaimed_chains += 1;
+}
+
+/// @brief let entries expire ttl_ms after their block is sealed, without deleting keys one by one. 
+///        gets skip expired blocks and stop at the newest expired chain, Expire frees expired chains and their blocks. 
+///        the seal time of each block is kept in a times file, one word per block and W words per chain. 
+///        chains dumped while ttl was not used count as sealed right now, chains freed before have their times zeroed. 
+///        a read-only follower reads the times file as the writer appends it, and never frees chains. 
+/// @param path_times   the times file, must be used again whenever the store is reopened
+/// @param ttl_ms       the time to live of entries in milliseconds, the same as the writer's for a follower
+void BloomStore::UseTTL(std::string& path_times, size_t ttl_ms) {
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    this->f_block_times = std::make_unique<FileObject>(path_times, nullptr, FileMode::Mapped, this->is_read_only);
+    this->ttl = ttl_ms;
+    auto nchains = this->f_bloom_chains.Size() / this->temp_bloom_chain.ByteSize();
+    if (this->is_read_only) {
+        this->FollowTimes(nchains);
+        // rebuild the collector on the next refresh, so its blocks get their seal times
+        this->followed_chains = SIZE_MAX;
+        this->tail_sequence = 0;
+        if (this->tail) { this->Refresh(); }
+        return;
+    }
+    // times are appended after their chain, so the times file is never ahead of bf file
+    auto ntimes = this->f_block_times->Size() / sizeof(uint64_t);
+    assert(ntimes <= nchains * W);
+    this->block_times.resize(ntimes);
+    if (ntimes != 0) {
+        memcpy(this->block_times.data(), this->f_block_times->Map(0, ntimes * sizeof(uint64_t)).data(), ntimes * sizeof(uint64_t));
+    }
+    auto missing = std::vector<uint64_t>(nchains * W - ntimes, Now());
+    if (!missing.empty()) {
+        this->f_block_times->Append(std::span{reinterpret_cast<uint8_t*>(missing.data()), missing.size() * sizeof(uint64_t)});
+        this->block_times.insert(this->block_times.end(), missing.begin(), missing.end());
+    }
+    this->expired_chains = 0;
+    // chains are reclaimed oldest first, the leading chains with zeroed times are freed already
+    this->reclaimed_chains = 0;
+    while ((this->reclaimed_chains + 1) * W <= this->block_times.size()) {
+        auto times = std::span{this->block_times}.subspan(this->reclaimed_chains * W, W);
+        if (std::any_of(times.begin(), times.end(), [](uint64_t time) { return time != 0; })) { break; }
+        this->reclaimed_chains += 1;
+    }
+    this->RecoverHoles();
+}
+
+/// @brief copy seal times the writer appended since the last call, on a read-only follower. 
+///        chains whose times are not written yet count as sealed now, as UseTTL does on the writer. 
+///        the writer zeroes the times of chains it frees, those are expired anyway and keep their old times here. 
+/// @param nchains the number of chains the writer has dumped
+void BloomStore::FollowTimes(size_t nchains) {
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    auto ntimes = std::min(this->f_block_times->Size() / sizeof(uint64_t), nchains * W);
+    if (ntimes > this->followed_times) {
+        this->block_times.resize(this->followed_times);
+        auto times = this->f_block_times->Map(this->followed_times * sizeof(uint64_t), (ntimes - this->followed_times) * sizeof(uint64_t));
+        auto words = reinterpret_cast<uint64_t*>(times.data());
+        this->block_times.insert(this->block_times.end(), words, words + ntimes - this->followed_times);
+        this->followed_times = ntimes;
+    }
+    this->block_times.resize(std::max(this->block_times.size(), nchains * W), Now());
+}
+
+/// @brief the earliest time a value read from this store may expire, so a cached copy knows when to go. 
+///        the value is in a block no older than the oldest one not expired yet, which expires first. 
+///        a value written now sits in the active block, its block is sealed later and expires ttl after that. 
+/// @param is_written true for a value written now, false for a value a get is about to read
+/// @return the deadline in wall clock milliseconds, UINT64_MAX without ttl
+uint64_t BloomStore::Deadline(bool is_written) {
+    if (this->ttl == 0) { return UINT64_MAX; }
+    auto now = Now();
+    if (is_written) { return now + this->ttl; }
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    for (auto i = this->ExpiredChains() * W; i < this->block_times.size(); ++i) {
+        if (this->block_times[i] + this->ttl > now) { return this->block_times[i] + this->ttl; }
+    }
+    for (auto time: this->sealed_times) {
+        if (time + this->ttl > now) { return time + this->ttl; }
+    }
+    return now + this->ttl;
+}
+
+/// @brief the number of oldest chains that are expired or freed, gets don't read them
+size_t BloomStore::DroppedChains() {
+    return std::max(this->ExpiredChains(), this->reclaimed_chains);
+}
+
+/// @brief the number of oldest chains whose blocks are all expired. 
+///        chains are dumped in time order, so every chain older than an expired chain is expired too. 
+size_t BloomStore::ExpiredChains() {
+    if (this->ttl == 0) { return 0; }
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    auto now = Now();
+    // concurrent readers update it too, any of their counts is a safe floor
+    auto cached = std::atomic_ref<size_t>(this->expired_chains);
+    size_t expired_chains = cached.load(std::memory_order_relaxed);
+    // the last block of a chain is sealed last
+    while ((expired_chains + 1) * W <= this->block_times.size() && this->block_times[(expired_chains + 1) * W - 1] + this->ttl <= now) {
+        expired_chains += 1;
+    }
+    cached.store(expired_chains, std::memory_order_relaxed);
+    return expired_chains;
+}
+
+/// @brief skip expired blocks of a chain
+/// @param pointer_iter the pointer iterator over the chain
+/// @param chain        the chain index, the number of dumped chains for the collector
+void BloomStore::DropExpired(PtrIterator& pointer_iter, size_t chain) {
+    if (this->ttl == 0) { return; }
+    auto W = BLOOMSTORE_CHAIN_WIDTH;
+    auto times = (chain + 1) * W <= this->block_times.size()
+        ? std::span{this->block_times}.subspan(chain * W, W)
+        : std::span{this->sealed_times};
+    auto now = Now();
+    size_t nexpired = 0;
+    while (nexpired < times.size() && times[nexpired] + this->ttl <= now) { nexpired += 1; }
+    pointer_iter.DropOldest(nexpired);
+}
+
+/// @brief free expired chains and their blocks by punching holes, like Demote it can be called every now and then. 
+///        chains and blocks keep their offsets, so nothing is rewritten. 
+/// @param nchains the most chains freed in this call
+/// @return true iff every expired chain is freed
+bool BloomStore::Expire(size_t nchains) {
+    assert(!this->is_read_only);
+    assert(!this->is_writing);
+    auto expired = this->ExpiredChains();
+    for (size_t n = 0; n < nchains && this->reclaimed_chains < expired; ++n) { this->ReclaimChain(); }
+    // followers skip expired chains by their own copy of the times, which the tail record tells them to catch up with
+    this->PublishTail();
+    this->PunchHoles();
+    return this->reclaimed_chains >= expired;
+}
+
+/// @brief share the tail of this store with read-only followers on the same host through a small record file. 
+///        the writer publishes file sizes and the blocks sealed in its collector whenever they are on disk, 
+///        a read-only store opened on the same files follows them, catching up before every get. 
+///        freed chains and blocks stay in place until every live follower has caught up past them. 
+/// @param path_tail the tail record, created by the writer
+void BloomStore::UseTail(std::string& path_tail) {
+    this->tail = std::make_unique<SharedRecord>(path_tail, TAIL_WORDS, this->is_read_only);
+    if (this->is_read_only) { this->Refresh(); }
+    else { this->PublishTail(); }
+}
+
+/// @brief publish what is on disk to followers, nothing if there is no tail record
+void BloomStore::PublishTail() {
+    if (!this->tail) { return; }
+    auto record = std::array<uint64_t, TAIL_WORDS>();
+    record[0] = this->f_kv_pairs.Size();
+    record[1] = this->f_bloom_chains.Size();
+    record[2] = this->f_cold_kv_pairs ? this->f_cold_kv_pairs->Size() : 0;
+    record[3] = this->f_cold_bloom_chains ? this->f_cold_bloom_chains->Size() : 0;
+    record[5] = this->f_block_times ? this->f_block_times->Size() : 0;
+    // sealed blocks from the newest to the oldest, times are kept from the oldest
+    size_t nsealed = 0;
+    auto pointer_iter = this->bloom_chain_collector.Enumerate();
+    bool depleted = false;
+    while (true) {
+        size_t address;
+        pointer_iter.Next(address, depleted);
+        if (depleted) break;
+        record[TAIL_ADDRESSES + nsealed] = address;
+        nsealed += 1;
+    }
+    record[4] = nsealed;
+    if (this->sealed_times.size() == nsealed) {
+        for (size_t i = 0; i < nsealed; ++i) { record[TAIL_TIMES + i] = this->sealed_times[nsealed - 1 - i]; }
+    }
+    auto sequence = this->tail->Store(std::span{record});
+    // holes freed so far are not in this record, they go once every follower has caught up with it
+    for (auto& hole: this->holes) {
+        if (hole.sequence == 0) { hole.sequence = sequence; }
+    }
+}
+
+/// @brief catch up with the writer of a read-only store. the collector is rebuilt from blocks the writer has sealed, 
+///        so everything flushed is found, while entries in the writer's active kvpairs are not. 
+///        it acknowledges the record it caught up with, the writer frees demoted and expired chains only after that, see PunchHoles. 
+/// @return true iff the writer published something since the last refresh
+bool BloomStore::Refresh() {
+    if (!this->tail || this->tail->Sequence() == this->tail_sequence) { return false; }
+    auto record = std::array<uint64_t, TAIL_WORDS>();
+    this->tail_sequence = this->tail->Load(std::span{record});
+    assert(this->f_cold_kv_pairs || record[3] == 0);
+    this->f_kv_pairs.Follow(record[0]);
+    this->f_bloom_chains.Follow(record[1]);
+    if (this->f_cold_kv_pairs) {
+        this->f_cold_kv_pairs->Follow(record[2]);
+        this->f_cold_bloom_chains->Follow(record[3]);
+        this->cold_chains = record[3] / this->temp_bloom_chain.ByteSize();
+    }
+    // a dumped chain takes the sealed blocks with it, the writer's collector starts over
+    auto nchains = record[1] / this->temp_bloom_chain.ByteSize();
+    if (nchains != this->followed_chains) {
+        this->bloom_chain_collector.Clear();
+        this->sealed_times.clear();
+        this->followed_chains = nchains;
+        this->followed_blocks = 0;
+    }
+    if (this->f_block_times) {
+        this->f_block_times->Follow(record[5]);
+        this->FollowTimes(nchains);
+    }
+    size_t nsealed = record[4];
+    assert(nsealed >= this->followed_blocks);
+    auto insert = [&](std::span<uint8_t> key) { this->bloom_chain_collector.Insert(key); };
+    for (size_t i = this->followed_blocks; i < nsealed; ++i) {
+        // record lists the newest first, blocks are sealed from the oldest
+        auto address = record[TAIL_ADDRESSES + nsealed - 1 - i];
+        this->LoadBlock(this->temp_kv_pairs, address);
+        this->temp_kv_pairs.ForEach([&](std::span<uint8_t> key, std::span<uint8_t>, bool) { insert(key); }, insert);
+        this->bloom_chain_collector.Seal(address);
+        if (this->f_block_times) { this->sealed_times.push_back(record[TAIL_TIMES + nsealed - 1 - i]); }
+    }
+    this->followed_blocks = nsealed;
+    // nothing older than this record is read from here on, the writer may free what it dropped
+    this->tail->Acknowledge(this->tail_sequence);
+    return true;
+}
+
+/// @brief the kv file holding a block
+/// @param address the block address
+FileObject& BloomStore::BlockFile(size_t address) {
+    if ((address >> TIER_SHIFT) & 1) { return *this->f_cold_kv_pairs; }
+    return this->f_kv_pairs;
+}
+
+/// @brief the bytes of a block sealed by AsyncPut and not written yet, see AsyncCommit
+/// @param address the block address
+/// @return the staged bytes from the block on, empty if the block is in its file
+std::span<uint8_t> BloomStore::StagedBlock(size_t address) {
+    size_t offset = BLOCK_OFFSET(address);
+    if (((address >> TIER_SHIFT) & 1) || offset < this->f_kv_pairs.Size()) { return {}; }
+    return std::span{this->staged_kv_pairs}.subspan(offset - this->f_kv_pairs.Size());
+}
+
+/// @brief the bytes of a chain dumped by AsyncPut and not written yet, see AsyncCommit
+/// @param position the chain position
+/// @return the staged bytes from the chain on, empty if the chain is in its file
+std::span<uint8_t> BloomStore::StagedChain(size_t position) {
+    if (position < this->f_bloom_chains.Size()) { return {}; }
+    return std::span{this->staged_bloom_chains}.subspan(position - this->f_bloom_chains.Size());
+}
+
+/// @brief the bytes of every dumped chain, including chains staged by AsyncPut that are not written yet
+size_t BloomStore::ChainBytes() {
+    return this->f_bloom_chains.Size() + this->staged_bloom_chains.size();
+}
+
+/// @brief whether sealed blocks are staged rather than written, during a batch or while AsyncCommit writes
+bool BloomStore::IsStaging() {
+    return this->is_staging || this->is_writing;
+}
+
+/// @brief the bf file holding a chain
+/// @param position the chain position
+FileObject& BloomStore::ChainFile(size_t position) {
+    if (position < this->cold_chains * this->temp_bloom_chain.ByteSize()) { return *this->f_cold_bloom_chains; }
+    return this->f_bloom_chains;
+}
+
+/// @brief share an engine-wide memory budget with other partitions
+/// @param budget the memory budget
+void BloomStore::UseBudget(MemoryBudget& budget) {
+    this->budget = &budget;
+    this->budget_id = budget.Register();
+    budget.Reserve(this->budget_id, MemoryComponent::ActiveKVPairs, this->active_kv_pairs.ByteSize() + this->active_kv_pairs.IndexByteSize());
+    budget.Reserve(this->budget_id, MemoryComponent::BloomChainCollector, this->bloom_chain_collector.ByteSize());
+    budget.Reserve(this->budget_id, MemoryComponent::Scratch, this->temp_kv_pairs.ByteSize() + this->temp_bloom_chain.ByteSize());
+    if (budget.Charge(this->budget_id, this->active_kv_pairs.UsedBytes())) { this->Flush(); }
 }
 
 } // namespace bloomstore
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include<codec.hpp>
+#include<cassert>
+#include<cstring>
+#include<algorithm>
+
+namespace bloomstore {
+
+#define MIN_MATCH   4
+#define LAST_LITERALS 5
+#define MAX_OFFSET  65535
+#define HASH_LOG    12
+
+/// @brief read 4 bytes at position i
+inline uint32_t Read32(std::span<uint8_t> bytes, size_t i) {
+    uint32_t x = 0;
+    memcpy(&x, &bytes[i], sizeof(uint32_t));
+    return x;
+}
+
+/// @brief write a length in lz4 style, 255 for each full byte and the remainder in the end
+inline void WriteLength(std::vector<uint8_t>& output, size_t length) {
+    while (length >= 255) {
+        output.push_back(255);
+        length -= 255;
+    }
+    output.push_back(static_cast<uint8_t>(length));
+}
+
+/// @brief read a length written by WriteLength
+inline size_t ReadLength(std::span<uint8_t> input, size_t& i) {
+    size_t length = 0;
+    uint8_t byte = 255;
+    while (byte == 255) {
+        assert(i < input.size());
+        byte = input[i++];
+        length += byte;
+    }
+    return length;
+}
+
+/// @brief write one sequence: a run of literals, optionally followed by a match
+inline void WriteSequence(
+    std::vector<uint8_t>& output,
+    std::span<uint8_t> literals,
+    size_t offset,
+    size_t match_length
+) {
+    size_t nliterals = literals.size();
+    uint8_t token = static_cast<uint8_t>(std::min<size_t>(nliterals, 15) << 4);
+    if (match_length != 0) {
+        token |= static_cast<uint8_t>(std::min<size_t>(match_length - MIN_MATCH, 15));
+    }
+    output.push_back(token);
+    if (nliterals >= 15) { WriteLength(output, nliterals - 15); }
+    output.insert(output.end(), literals.begin(), literals.end());
+    if (match_length == 0) { return; }
+    output.push_back(static_cast<uint8_t>(offset & 0xff));
+    output.push_back(static_cast<uint8_t>(offset >> 8));
+    if (match_length - MIN_MATCH >= 15) { WriteLength(output, match_length - MIN_MATCH - 15); }
+}
+
+/// @brief compress input and append it to output
+/// @param input    the raw bytes
+/// @param output   the output buffer, compressed bytes are appended
+void LZCodec::Compress(std::span<uint8_t> input, std::vector<uint8_t>& output) {
+    // the match finding table of calling thread, it stores position + 1, 0 for empty
+    thread_local auto table = std::vector<uint32_t>(size_t{1} << HASH_LOG);
+    std::fill(table.begin(), table.end(), 0);
+    size_t n = input.size();
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH + LAST_LITERALS <= n) {
+        uint32_t sequence = Read32(input, i);
+        uint32_t h = (sequence * 2654435761u) >> (32 - HASH_LOG);
+        size_t candidate = table[h];
+        table[h] = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i - (candidate - 1) > MAX_OFFSET || Read32(input, candidate - 1) != sequence) {
+            i += 1;
+            continue;
+        }
+        candidate -= 1;
+        size_t match_length = MIN_MATCH;
+        while (i + match_length < n - LAST_LITERALS && input[candidate + match_length] == input[i + match_length]) {
+            match_length += 1;
+        }
+        WriteSequence(output, input.subspan(anchor, i - anchor), i - candidate, match_length);
+        i += match_length;
+        anchor = i;
+    }
+    WriteSequence(output, input.subspan(anchor, n - anchor), 0, 0);
+}
+
+/// @brief decompress input into output, which must have exactly the raw size
+/// @param input    the compressed bytes
+/// @param output   the raw bytes
+void LZCodec::Decompress(std::span<uint8_t> input, std::span<uint8_t> output) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < input.size()) {
+        uint8_t token = input[i++];
+        size_t nliterals = token >> 4;
+        if (nliterals == 15) { nliterals += ReadLength(input, i); }
+        assert(i + nliterals <= input.size() && o + nliterals <= output.size());
+        if (nliterals != 0) { memcpy(&output[o], &input[i], nliterals); }
+        i += nliterals;
+        o += nliterals;
+        // the last sequence has literals only
+        if (i == input.size()) { break; }
+        size_t offset = input[i] | (size_t{input[i + 1]} << 8);
+        i += 2;
+        size_t match_length = token & 15;
+        if (match_length == 15) { match_length += ReadLength(input, i); }
+        match_length += MIN_MATCH;
+        assert(offset != 0 && offset <= o && o + match_length <= output.size());
+        // byte by byte, since a match may overlap with its own output
+        for (size_t j = 0; j < match_length; ++j) {
+            output[o + j] = output[o + j - offset];
+        }
+        o += match_length;
+    }
+    assert(o == output.size());
+}
+
+#undef MIN_MATCH
+#undef LAST_LITERALS
+#undef MAX_OFFSET
+#undef HASH_LOG
+
+} // namespace bloomstore
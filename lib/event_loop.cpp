@@ -0,0 +1,78 @@
+#include<event_loop.hpp>
+#include<cassert>
+#include<thread>
+
+namespace bloomstore {
+
+/// @brief initialize an event loop
+/// @param depth the maximal number of in-flight reads and appends
+EventLoop::EventLoop(size_t depth):
+    io{depth}
+{}
+
+/// @brief read bytes at position of file, resuming the awaiting task when done
+/// @param file     the file to read from
+/// @param position the position of the first byte
+/// @param bytes    the buffer, owned by the awaiting task
+EventLoop::IOAwaiter EventLoop::Read(FileObject& file, size_t position, std::span<uint8_t> bytes) {
+    return IOAwaiter(*this, PendingIO{&file, position, bytes, nullptr, false});
+}
+
+/// @brief append bytes at the end of file, resuming the awaiting task once they are written. 
+///        file grows as the task resumes, so other tasks never see it grown before the task does. 
+/// @param file     the file to append to, not mapped, no other append to it may be in flight
+/// @param bytes    the bytes, owned by the awaiting task
+EventLoop::IOAwaiter EventLoop::Append(FileObject& file, std::span<uint8_t> bytes) {
+    return IOAwaiter(*this, PendingIO{&file, 0, bytes, nullptr, true});
+}
+
+/// @brief hand a request to kernel, or hold it back while queues are full
+void EventLoop::Submit(PendingIO request) {
+    if (this->waiting.empty() && this->TrySubmit(request)) { return; }
+    this->waiting.push_back(request);
+}
+
+/// @brief hand a request to kernel
+/// @return false if queues are full
+bool EventLoop::TrySubmit(PendingIO& request) {
+    if (request.is_append) { return this->io.Append(*request.file, request.bytes, request.handle.address()); }
+    return this->io.Submit(*request.file, request.position, request.bytes, request.handle.address());
+}
+
+/// @brief start a task on next Run, the loop owns it afterwards
+/// @param task the task
+void EventLoop::Spawn(Task<void>&& task) {
+    this->ready.push_back(task.handle);
+    this->spawned.push_back(std::move(task));
+}
+
+/// @brief run until every spawned task is done
+void EventLoop::Run() {
+    while (true) {
+        while (!this->ready.empty()) {
+            auto handle = this->ready.front();
+            this->ready.pop_front();
+            handle.resume();
+        }
+        // requests held back are retried in order
+        while (!this->waiting.empty()) {
+            if (!this->TrySubmit(this->waiting.front())) { break; }
+            this->waiting.pop_front();
+        }
+        this->reaped.clear();
+        this->io.Reap(this->reaped, true);
+        for (auto tag: this->reaped) {
+            this->ready.push_back(std::coroutine_handle<>::from_address(tag));
+        }
+        if (!this->ready.empty()) { continue; }
+        if (this->waiting.empty() && this->io.Inflight() == 0) { break; }
+        // device queue is taken by other threads
+        std::this_thread::yield();
+    }
+    for (auto& task: this->spawned) {
+        assert(task.IsDone());
+    }
+    this->spawned.clear();
+}
+
+} // namespace bloomstore
@@ -1,6 +1,11 @@
 #include<cstdint>
 #include<span>
 #include<cstring>
+#include<cassert>
+#include<hashing.hpp>
+#if defined(__x86_64__)
+#include<immintrin.h>
+#endif
 
 namespace bloomstore
 {
@@ -27,6 +32,19 @@ inline uint32_t Scramble(uint32_t k) {
     return k;
 }
 
+/// @brief the last key word, its bytes are shifted in one by one (unlike the reference implementation)
+/// @param key  the hashed key
+/// @param len  the key length
+/// @return the tail word, 0 if len is a multiple of 4
+inline uint32_t Tail(const uint8_t* key, size_t len) {
+    uint32_t k = 0;
+    for (size_t i = len - len % 4; i < len; i += 1) {
+        k <<= 8;
+        k |= key[i];
+    }
+    return k;
+}
+
 /// @brief standard murmur hash algorithm, stenographically copied from [wikipedia](https://en.wikipedia.org/wiki/MurmurHash)
 /// @param key  the hashed key
 /// @param seed seed for hashing
@@ -41,12 +59,7 @@ uint32_t Hash(std::span<uint8_t> key, uint32_t seed) {
         h = (h << 13) | (h >> 19);
         h = h * 5 + 0xe6546b64;
     }
-    uint32_t k = 0;
-    for (size_t i = len - len % 4; i < len; i += 1) {
-        k <<= 8;
-        k |= key[i];
-    }
-    h ^= Scramble(k);
+    h ^= Scramble(Tail(key.data(), len));
     h ^= key.size();
     h ^= h >> 16;
 	h *= 0x85ebca6b;
@@ -56,4 +69,178 @@ uint32_t Hash(std::span<uint8_t> key, uint32_t seed) {
     return h;
 }
 
+// --- Preimages --- //
+// every step of Hash is a bijection on 32-bit words once the other key words are fixed, 
+// so one free key word can be solved for any hash by running the steps after it backwards. 
+
+/// @brief the inverse of an odd number modulo 2^32, by newton iteration
+static constexpr uint32_t Inverse(uint32_t a) {
+    uint32_t x = a;
+    for (int i = 0; i < 5; ++i) { x *= 2 - a * x; }
+    return x;
+}
+
+/// @brief rewrite the last whole word of a key so it hashes to a given value, the other bytes stay. 
+///        e.g. to replay keys recorded only by hash, so they still route to the same partition. 
+/// @param key  the key, at least 4 bytes long
+/// @param seed seed for hashing
+/// @param hash the wanted value of Hash(key, seed)
+void Preimage(std::span<uint8_t> key, uint32_t seed, uint32_t hash) {
+    auto len = key.size();
+    assert(len >= 4);
+    size_t last = (len / 4 - 1) * 4;
+    // forward through the words before the free one
+    uint32_t h = seed;
+    for (size_t i = 0; i < last; i += 4) {
+        uint32_t k = 0;
+        memcpy(&k, &key[i], sizeof(uint32_t));
+        h ^= Scramble(k);
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+    // backward through finalization and the tail
+    uint32_t g = hash;
+    g ^= g >> 16;
+    g *= Inverse(0xc2b2ae35);
+    g ^= (g >> 13) ^ (g >> 26);
+    g *= Inverse(0x85ebca6b);
+    g ^= g >> 16;
+    g ^= len;
+    g ^= Scramble(Tail(key.data(), len));
+    // backward through the free word
+    g = (g - 0xe6546b64) * Inverse(5);
+    g = (g >> 13) | (g << 19);
+    uint32_t k = g ^ h;
+    k *= Inverse(0x1b873593);
+    k = (k >> 15) | (k << 17);
+    k *= Inverse(0xcc9e2d51);
+    memcpy(&key[last], &k, sizeof(uint32_t));
+}
+
+// --- Batch hashing --- //
+// keys of a batch share one length, key i starts at i * stride. 
+// vector kernels run the scalar steps above on 8 (avx2) or 16 (avx512) keys at once, lane i for key i, 
+// so every kernel gives the same hashes as Hash. 
+
+using HashKernel = void (*)(const uint8_t* keys, size_t key_bytes, size_t stride, uint32_t seed, uint32_t* hashes, size_t n);
+
+/// @brief hash n keys one by one
+static void HashBatchScalar(const uint8_t* keys, size_t key_bytes, size_t stride, uint32_t seed, uint32_t* hashes, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        hashes[i] = Hash(std::span{const_cast<uint8_t*>(keys + i * stride), key_bytes}, seed);
+    }
+}
+
+#if defined(__x86_64__)
+
+/// @brief rotate every lane left by r bits
+__attribute__((target("avx2")))
+static inline __m256i Rotl256(__m256i x, int r) {
+    return _mm256_or_si256(_mm256_slli_epi32(x, r), _mm256_srli_epi32(x, 32 - r));
+}
+
+/// @brief Scramble on every lane
+__attribute__((target("avx2")))
+static inline __m256i Scramble256(__m256i k) {
+    k = _mm256_mullo_epi32(k, _mm256_set1_epi32(0xcc9e2d51));
+    k = Rotl256(k, 15);
+    return _mm256_mullo_epi32(k, _mm256_set1_epi32(0x1b873593));
+}
+
+/// @brief hash n keys 8 at a time, words of 8 keys are gathered into one register
+__attribute__((target("avx2")))
+static void HashBatchAVX2(const uint8_t* keys, size_t key_bytes, size_t stride, uint32_t seed, uint32_t* hashes, size_t n) {
+    auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto base = keys + i * stride;
+        auto h = _mm256_set1_epi32(seed);
+        for (size_t w = 0; w + 3 < key_bytes; w += 4) {
+            auto k = _mm256_i32gather_epi32(reinterpret_cast<const int*>(base + w), offsets, 1);
+            h = _mm256_xor_si256(h, Scramble256(k));
+            h = Rotl256(h, 13);
+            h = _mm256_add_epi32(_mm256_mullo_epi32(h, _mm256_set1_epi32(5)), _mm256_set1_epi32(0xe6546b64));
+        }
+        uint32_t tails[8];
+        for (size_t l = 0; l < 8; ++l) { tails[l] = Tail(base + l * stride, key_bytes); }
+        h = _mm256_xor_si256(h, Scramble256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tails))));
+        h = _mm256_xor_si256(h, _mm256_set1_epi32(key_bytes));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x85ebca6b));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 13));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0xc2b2ae35));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hashes + i), h);
+    }
+    HashBatchScalar(keys + i * stride, key_bytes, stride, seed, hashes + i, n - i);
+}
+
+// the unmasked avx512 gather, rotate and shift take an undefined source gcc reports as maybe uninitialized, 
+// their full mask forms with a zeroed source compile to the same instructions
+#define ALL_LANES __mmask16(0xffff)
+
+/// @brief Scramble on every lane
+__attribute__((target("avx512f")))
+static inline __m512i Scramble512(__m512i k) {
+    k = _mm512_mullo_epi32(k, _mm512_set1_epi32(0xcc9e2d51));
+    k = _mm512_maskz_rol_epi32(ALL_LANES, k, 15);
+    return _mm512_mullo_epi32(k, _mm512_set1_epi32(0x1b873593));
+}
+
+/// @brief hash n keys 16 at a time, words of 16 keys are gathered into one register
+__attribute__((target("avx512f")))
+static void HashBatchAVX512(const uint8_t* keys, size_t key_bytes, size_t stride, uint32_t seed, uint32_t* hashes, size_t n) {
+    auto offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stride));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        auto base = keys + i * stride;
+        auto h = _mm512_set1_epi32(seed);
+        for (size_t w = 0; w + 3 < key_bytes; w += 4) {
+            auto k = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), ALL_LANES, offsets, base + w, 1);
+            h = _mm512_xor_si512(h, Scramble512(k));
+            h = _mm512_maskz_rol_epi32(ALL_LANES, h, 13);
+            h = _mm512_add_epi32(_mm512_mullo_epi32(h, _mm512_set1_epi32(5)), _mm512_set1_epi32(0xe6546b64));
+        }
+        uint32_t tails[16];
+        for (size_t l = 0; l < 16; ++l) { tails[l] = Tail(base + l * stride, key_bytes); }
+        h = _mm512_xor_si512(h, Scramble512(_mm512_loadu_si512(tails)));
+        h = _mm512_xor_si512(h, _mm512_set1_epi32(key_bytes));
+        h = _mm512_xor_si512(h, _mm512_maskz_srli_epi32(ALL_LANES, h, 16));
+        h = _mm512_mullo_epi32(h, _mm512_set1_epi32(0x85ebca6b));
+        h = _mm512_xor_si512(h, _mm512_maskz_srli_epi32(ALL_LANES, h, 13));
+        h = _mm512_mullo_epi32(h, _mm512_set1_epi32(0xc2b2ae35));
+        h = _mm512_xor_si512(h, _mm512_maskz_srli_epi32(ALL_LANES, h, 16));
+        _mm512_storeu_si512(hashes + i, h);
+    }
+    HashBatchScalar(keys + i * stride, key_bytes, stride, seed, hashes + i, n - i);
+}
+
+#endif
+
+/// @brief pick the widest kernel this cpu runs
+static HashKernel SelectHashKernel() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { return HashBatchAVX512; }
+    if (__builtin_cpu_supports("avx2")) { return HashBatchAVX2; }
+#endif
+    return HashBatchScalar;
+}
+
+/// @brief hash many keys of the same length at once, hashes[i] is Hash(key i, seed) bit for bit
+/// @param keys         the hashed keys, key i starts at keys[i * stride]
+/// @param key_bytes    the key length
+/// @param stride       the distance between two keys, e.g. key_bytes + value_bytes for records
+/// @param seed         seed for hashing
+/// @param hashes       receives one hash per key
+void HashBatch(std::span<uint8_t> keys, size_t key_bytes, size_t stride, uint32_t seed, std::span<uint32_t> hashes) {
+    static const HashKernel kernel = SelectHashKernel();
+    if (hashes.empty()) { return; }
+    assert(key_bytes <= stride);
+    assert((hashes.size() - 1) * stride + key_bytes <= keys.size());
+    // gathers take 32-bit offsets
+    assert(stride * 16 < (size_t{1} << 31));
+    kernel(&keys[0], key_bytes, stride, seed, &hashes[0], hashes.size());
+}
+
 } // namespace bloomstore
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include<memory_budget.hpp>
+
+namespace bloomstore {
+
+// shrink to this fraction of budget once it is exceeded, so the victim scan is amortized
+#define LOW_WATERMARK(budget) ((budget) / 8 * 7)
+// halve heat of every partition after this many puts per partition
+#define HEAT_HALFLIFE 1024
+
+/// @brief initialize a memory budget
+/// @param budget the maximal number of bytes buffered in active kvpairs over all partitions
+MemoryBudget::MemoryBudget(size_t budget):
+    budget{budget},
+    total_buffered{0},
+    total_requested{0},
+    nputs{0}
+{}
+
+/// @brief start tracking a partition, before anything is charged to the budget
+/// @return the partition id in this budget
+size_t MemoryBudget::Register() {
+    this->partitions.emplace_back();
+    return this->partitions.size() - 1;
+}
+
+/// @brief record memory allocated by a partition component
+/// @param partition    the partition id
+/// @param component    the component holding memory
+/// @param bytes        the number of allocated bytes
+void MemoryBudget::Reserve(size_t partition, MemoryComponent component, size_t bytes) {
+    this->partitions[partition].reserved[size_t(component)] = bytes;
+}
+
+/// @brief record bytes buffered by a write on partition, on the thread writing it. 
+///        when budget runs out, the coldest partitions are asked to flush, each on its own next write. 
+/// @param partition    the partition id
+/// @param bytes        the number of buffered bytes
+/// @return true iff partition has to flush now, because it was asked to or nothing else is left to ask
+bool MemoryBudget::Charge(size_t partition, size_t bytes) {
+    auto& slot = this->partitions[partition];
+    slot.buffered.fetch_add(bytes, std::memory_order_relaxed);
+    auto total = this->total_buffered.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    slot.heat.fetch_add(1, std::memory_order_relaxed);
+    if ((this->nputs.fetch_add(1, std::memory_order_relaxed) + 1) % (this->partitions.size() * HEAT_HALFLIFE) == 0) {
+        for (auto& other: this->partitions) {
+            other.heat.store(other.heat.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+    }
+    if (slot.requested.load(std::memory_order_relaxed) != 0) { return true; }
+    if (total <= this->budget) { return false; }
+    return this->Shrink(partition);
+}
+
+/// @brief record a partition flushing its active buffer, on the thread writing it
+/// @param partition the partition id
+void MemoryBudget::Release(size_t partition) {
+    auto& slot = this->partitions[partition];
+    this->total_buffered.fetch_sub(slot.buffered.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+    this->total_requested.fetch_sub(slot.requested.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/// @brief ask the coldest partitions to flush until bytes nobody was asked to flush drop under the low watermark
+/// @param hot_partition the partition being written to, it flushes only if nothing else is left to ask
+/// @return true iff hot_partition has to flush now
+bool MemoryBudget::Shrink(size_t hot_partition) {
+    while (this->total_buffered.load(std::memory_order_relaxed) > LOW_WATERMARK(this->budget) + this->total_requested.load(std::memory_order_relaxed)) {
+        size_t victim = hot_partition;
+        for (size_t i = 0; i < this->partitions.size(); ++i) {
+            auto& slot = this->partitions[i];
+            if (i == hot_partition || slot.buffered.load(std::memory_order_relaxed) == 0) { continue; }
+            if (slot.requested.load(std::memory_order_relaxed) != 0) { continue; }
+            if (victim == hot_partition || slot.heat.load(std::memory_order_relaxed) < this->partitions[victim].heat.load(std::memory_order_relaxed)) { victim = i; }
+        }
+        if (victim == hot_partition) { return true; }
+        // the victim may flush meanwhile, then its next write flushes a little early
+        auto bytes = this->partitions[victim].buffered.load(std::memory_order_relaxed);
+        size_t expected = 0;
+        if (bytes != 0 && this->partitions[victim].requested.compare_exchange_strong(expected, bytes, std::memory_order_relaxed)) {
+            this->total_requested.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+    return false;
+}
+
+/// @brief bytes currently buffered in active kvpairs of a partition
+size_t MemoryBudget::Buffered(size_t partition) {
+    return this->partitions[partition].buffered.load(std::memory_order_relaxed);
+}
+
+/// @brief bytes allocated by a partition component
+size_t MemoryBudget::Usage(size_t partition, MemoryComponent component) {
+    return this->partitions[partition].reserved[size_t(component)];
+}
+
+/// @brief bytes allocated by a partition
+size_t MemoryBudget::Usage(size_t partition) {
+    size_t usage = 0;
+    for (auto bytes: this->partitions[partition].reserved) { usage += bytes; }
+    return usage;
+}
+
+/// @brief bytes currently buffered in active kvpairs over all partitions
+size_t MemoryBudget::TotalBuffered() {
+    return this->total_buffered.load(std::memory_order_relaxed);
+}
+
+/// @brief bytes partitions were asked to flush and still hold, they go on their next writes
+size_t MemoryBudget::TotalRequested() {
+    return this->total_requested.load(std::memory_order_relaxed);
+}
+
+/// @brief bytes allocated over all partitions
+size_t MemoryBudget::TotalUsage() {
+    size_t usage = 0;
+    for (size_t i = 0; i < this->partitions.size(); ++i) { usage += this->Usage(i); }
+    return usage;
+}
+
+#undef LOW_WATERMARK
+#undef HEAT_HALFLIFE
+
+} // namespace bloomstore
@@ -0,0 +1,19 @@
+#include<merge_operator.hpp>
+#include<cassert>
+
+namespace bloomstore {
+
+/// @brief add operand to value, the carry out of the last byte is dropped
+/// @param value    the value, updated in place
+/// @param operand  the operand, as long as value
+void AddOperator::Merge(std::span<uint8_t> value, std::span<uint8_t> operand) {
+    assert(value.size() == operand.size());
+    uint32_t carry = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        carry += uint32_t{value[i]} + operand[i];
+        value[i] = static_cast<uint8_t>(carry);
+        carry >>= 8;
+    }
+}
+
+} // namespace bloomstore
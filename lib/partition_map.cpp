@@ -0,0 +1,144 @@
+#include<partition_map.hpp>
+#include<hashing.hpp>
+#include<algorithm>
+#include<cassert>
+#include<cstring>
+#include<array>
+
+namespace bloomstore {
+
+/// @brief initialize an empty partition map, which routes nothing
+PartitionMap::PartitionMap():
+    npartitions{0}
+{}
+
+/// @brief initialize a partition map with npartitions partitions, each owning nvnodes points on the ring
+/// @param npartitions  the number of partitions
+/// @param nvnodes      the number of virtual nodes per partition, 0 for a modulo map
+PartitionMap::PartitionMap(size_t npartitions, size_t nvnodes):
+    npartitions{0}
+{
+    for (size_t i = 0; i < npartitions; ++i) {
+        this->AddPartition(nvnodes);
+    }
+}
+
+/// @brief put a token on the ring, keeping tokens sorted. colliding tokens are dropped.
+/// @param token        the position on the ring
+/// @param partition    the partition owning range (previous token, token]
+void PartitionMap::Place(uint32_t token, uint32_t partition) {
+    auto it = std::lower_bound(this->tokens.begin(), this->tokens.end(), token);
+    if (it != this->tokens.end() && *it == token) { return; }
+    auto i = it - this->tokens.begin();
+    this->tokens.insert(it, token);
+    this->owners.insert(this->owners.begin() + i, partition);
+}
+
+/// @brief find the partition owning a key hash
+/// @param hash the key hash
+/// @return the owning partition
+uint32_t PartitionMap::Route(uint32_t hash) {
+    assert(!this->IsEmpty());
+    if (this->IsModulo()) { return hash % this->npartitions; }
+    auto it = std::lower_bound(this->tokens.begin(), this->tokens.end(), hash);
+    if (it == this->tokens.end()) { return this->owners[0]; }
+    return this->owners[it - this->tokens.begin()];
+}
+
+/// @brief the number of partitions
+uint32_t PartitionMap::Size() {
+    return this->npartitions;
+}
+
+/// @brief check if the map has no partition at all
+bool PartitionMap::IsEmpty() {
+    return this->npartitions == 0;
+}
+
+/// @brief check if the map routes by hash modulo the number of partitions instead of a ring
+bool PartitionMap::IsModulo() {
+    return this->tokens.empty() && this->npartitions != 0;
+}
+
+/// @brief add a new partition taking over a little bit of the ring from every existing one
+/// @param nvnodes the number of virtual nodes of the new partition
+/// @return the index of the new partition
+uint32_t PartitionMap::AddPartition(size_t nvnodes) {
+    // a modulo map would move almost every key, it is replaced by a ring first
+    assert(nvnodes == 0 || this->npartitions == 0 || !this->IsModulo());
+    auto partition = this->npartitions;
+    this->npartitions += 1;
+    for (uint32_t vnode = 0; vnode < nvnodes; ++vnode) {
+        auto bytes = std::array<uint8_t, 8>();
+        memcpy(&bytes[0], &partition, sizeof(uint32_t));
+        memcpy(&bytes[4], &vnode, sizeof(uint32_t));
+        this->Place(Hash(std::span{bytes}, static_cast<uint32_t>('R')), partition);
+    }
+    return partition;
+}
+
+/// @brief split a (hot) partition by handing the upper half of each of its ranges to a new partition
+/// @param partition the split partition
+/// @return the index of the new partition
+uint32_t PartitionMap::SplitPartition(uint32_t partition) {
+    assert(partition < this->npartitions && !this->IsModulo());
+    auto new_partition = this->npartitions;
+    this->npartitions += 1;
+    auto midpoints = std::vector<uint32_t>();
+    for (size_t i = 0; i < this->tokens.size(); ++i) {
+        if (this->owners[i] != partition) { continue; }
+        uint32_t prev  = this->tokens[(i + this->tokens.size() - 1) % this->tokens.size()];
+        uint64_t width = uint32_t(this->tokens[i] - prev);
+        if (width == 0) { width = uint64_t{1} << 32; }
+        if (width < 2) { continue; }
+        midpoints.push_back(static_cast<uint32_t>(prev + width / 2));
+    }
+    for (auto token: midpoints) {
+        this->Place(token, new_partition);
+    }
+    return new_partition;
+}
+
+/// @brief find partitions in this map that hand over part of their range in the next map
+/// @param next     the next map, derived from this one by adding or splitting partitions
+/// @param donors   partitions losing keys to new partitions
+void PartitionMap::Donors(PartitionMap& next, std::vector<uint32_t>& donors) {
+    if (this->IsModulo()) {
+        // modulo and ring ranges interleave everywhere, every partition gives some keys away
+        for (uint32_t donor = 0; donor < this->npartitions; ++donor) {
+            if (std::find(donors.begin(), donors.end(), donor) == donors.end()) { donors.push_back(donor); }
+        }
+        return;
+    }
+    for (size_t i = 0; i < next.tokens.size(); ++i) {
+        auto donor = this->Route(next.tokens[i]);
+        if (donor == next.owners[i]) { continue; }
+        if (std::find(donors.begin(), donors.end(), donor) != donors.end()) { continue; }
+        donors.push_back(donor);
+    }
+}
+
+/// @brief write the ring in a plain text format
+/// @param out the output stream
+void PartitionMap::Dump(std::ostream& out) {
+    out << this->npartitions << " " << this->tokens.size() << "\n";
+    for (size_t i = 0; i < this->tokens.size(); ++i) {
+        out << this->tokens[i] << " " << this->owners[i] << "\n";
+    }
+}
+
+/// @brief read a ring written by Dump
+/// @param in the input stream
+/// @return true iff the ring is read successfully
+bool PartitionMap::Load(std::istream& in) {
+    size_t ntokens = 0;
+    if (!(in >> this->npartitions >> ntokens)) { return false; }
+    this->tokens.resize(ntokens);
+    this->owners.resize(ntokens);
+    for (size_t i = 0; i < ntokens; ++i) {
+        if (!(in >> this->tokens[i] >> this->owners[i])) { return false; }
+    }
+    return std::is_sorted(this->tokens.begin(), this->tokens.end());
+}
+
+} // namespace bloomstore
@@ -1,15 +1,55 @@
 #include<iostream>
+#include<fstream>
+#include<algorithm>
+#include<cassert>
+#include<cstdio>
+#include<thread>
 #include<hashing.hpp>
 #include<partitioner.hpp>
 
 namespace bloomstore {
 
+// number of points each partition owns on the hashing ring
+static constexpr size_t VNODES = 64;
+
+/// @brief initialize a partitioner routing by key hash modulo the number of partitions, 
+///        the first AddPartition or SplitPartition moves keys onto a hashing ring, see UseRing
+/// @param instances the partitions, indexed by partition number
 Partitioner::Partitioner(
     std::vector<BloomStore*>&& instances
 ):
-    instances{instances}
+    instances{instances},
+    partition_map{instances.size(), 0}
 {}
 
+/// @brief initialize a partitioner whose partition map is persisted at path_map
+/// @param instances    the partitions, indexed by partition number
+/// @param path_map     the partition map file, created when missing
+Partitioner::Partitioner(
+    std::vector<BloomStore*>&& instances,
+    std::string& path_map
+):
+    instances{instances},
+    path_map{path_map}
+{
+    auto in = std::ifstream(path_map);
+    if (in && this->LoadMap(in)) {
+        assert(this->partition_map.Size() == this->instances.size());
+        if (this->IsMigrating()) {
+            // restart the interrupted migration from scratch, it is idempotent
+            this->previous_map.Donors(this->partition_map, this->migration_sources);
+        }
+        return;
+    }
+    // partitions written without a map were routed by hash modulo their number, they keep it until the first resize
+    bool is_new = std::all_of(this->instances.begin(), this->instances.end(), [](BloomStore* instance) {
+        return instance->f_kv_pairs.Size() == 0;
+    });
+    this->partition_map = PartitionMap(this->instances.size(), is_new ? VNODES : 0);
+    this->previous_map = PartitionMap();
+    this->SaveMap();
+}
+
 Partitioner::~Partitioner() {
     for (auto instance: instances) {
         delete instance;
@@ -17,18 +57,626 @@ Partitioner::~Partitioner() {
 }
 
 void Partitioner::Put(std::span<uint8_t> key, std::span<uint8_t> value) {
-    size_t index = Hash(key, 'Z') % this->instances.size();
+    if (this->recorder) { this->recorder->Record(TraceOp::Put, key); }
+    size_t index = this->partition_map.Route(Hash(key, 'Z'));
     this->instances[index]->Put(key, value);
+    if (this->cache) { this->cache->Update(key, value, this->instances[index]->Deadline(true)); }
+    this->AdvanceMigration(1);
 }
 
 void Partitioner::Del(std::span<uint8_t> key) {
-    size_t index = Hash(key, 'Z') % this->instances.size();
+    if (this->recorder) { this->recorder->Record(TraceOp::Del, key); }
+    size_t index = this->partition_map.Route(Hash(key, 'Z'));
     this->instances[index]->Del(key);
+    if (this->cache) { this->cache->Invalidate(key); }
+    this->AdvanceMigration(1);
+}
+
+/// @brief merge an operand into the value of key, see BloomStore::Merge
+/// @param key      the merged key
+/// @param operand  the merge operand
+void Partitioner::Merge(std::span<uint8_t> key, std::span<uint8_t> operand) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Merge, key); }
+    auto hash = Hash(key, 'Z');
+    size_t index = this->partition_map.Route(hash);
+    assert(this->instances[index]->merge_operator);
+    if (this->cache) { this->cache->Invalidate(key); }
+    if (this->IsMigrating()) {
+        // operands can't stack on a value left in the previous partition, 
+        // nor on one Migrate is about to write again and free (see KeepEntry), fold it here
+        size_t previous_index = this->previous_map.Route(hash);
+        auto value = std::vector<uint8_t>(operand.size());
+        bool is_tombstone = false;
+        bool is_found = false;
+        this->instances[index]->Get(key, std::span{value}, is_tombstone, is_found);
+        if (!is_found && previous_index != index) { this->instances[previous_index]->Get(key, std::span{value}, is_tombstone, is_found); }
+        if (!is_found || is_tombstone) { std::fill(value.begin(), value.end(), 0); }
+        this->instances[index]->merge_operator->Merge(std::span{value}, operand);
+        this->instances[index]->Put(key, std::span{value});
+    }
+    else {
+        this->instances[index]->Merge(key, operand);
+    }
+    this->AdvanceMigration(1);
+}
+
+/// @brief put a key, safe to call from several threads at once, see BloomStore::ConcurrentPut. 
+///        the partition map must not change and nothing may migrate meanwhile. 
+/// @param key      the inserted key
+/// @param value    the inserted value
+void Partitioner::ConcurrentPut(std::span<uint8_t> key, std::span<uint8_t> value) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Put, key); }
+    size_t index = this->partition_map.Route(Hash(key, 'Z'));
+    this->instances[index]->ConcurrentPut(key, value);
+    // dropped once published, concurrent readers never refill the cache
+    if (this->cache) { this->cache->Invalidate(key); }
+}
+
+/// @brief delete a key, safe to call from several threads at once, see ConcurrentPut
+/// @param key the deleted key
+void Partitioner::ConcurrentDel(std::span<uint8_t> key) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Del, key); }
+    size_t index = this->partition_map.Route(Hash(key, 'Z'));
+    this->instances[index]->ConcurrentDel(key);
+    if (this->cache) { this->cache->Invalidate(key); }
+}
+
+/// @brief get a key, safe to call from several threads at once and while ConcurrentPut and ConcurrentDel run, 
+///        see BloomStore::ConcurrentGet. the read cache is read but not filled, a value read may be overwritten 
+///        before it could be admitted. 
+/// @param key          the inquired key
+/// @param value        the value buffer
+/// @param is_tombstone set to true iff key is deleted
+/// @param is_found     set to true iff key has a value or tombstone
+void Partitioner::ConcurrentGet(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Get, key); }
+    if (this->cache && this->cache->Get(key, value, is_found)) {
+        is_tombstone = false;
+        return;
+    }
+    auto hash = Hash(key, 'Z');
+    size_t index = this->partition_map.Route(hash);
+    this->instances[index]->ConcurrentGet(key, value, is_tombstone, is_found);
+    if (!is_found && this->IsMigrating()) {
+        size_t previous_index = this->previous_map.Route(hash);
+        if (previous_index != index) {
+            this->instances[previous_index]->ConcurrentGet(key, value, is_tombstone, is_found);
+        }
+    }
+}
+
+/// @brief seal active kvpairs of every partition, e.g. once concurrent writers are done
+void Partitioner::Flush() {
+    for (auto instance: this->instances) {
+        instance->Flush();
+    }
 }
 
 void Partitioner::Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_tombstone, bool& is_found) {
-    size_t index = Hash(key, 'Z') % this->instances.size();
+    if (this->recorder) { this->recorder->Record(TraceOp::Get, key); }
+    if (this->cache && this->cache->Get(key, value, is_found)) {
+        is_tombstone = false;
+        return;
+    }
+    auto hash = Hash(key, 'Z');
+    size_t index = this->partition_map.Route(hash);
+    // taken before reading, a block read later is no older than the oldest one alive now
+    auto deadline = this->cache ? this->Deadline(hash) : UINT64_MAX;
     this->instances[index]->Get(key, value, is_tombstone, is_found);
+    if (!is_found && this->IsMigrating()) {
+        // the key may not have been moved to its new partition yet
+        size_t previous_index = this->previous_map.Route(hash);
+        if (previous_index != index) {
+            this->instances[previous_index]->Get(key, value, is_tombstone, is_found);
+        }
+    }
+    if (this->cache) { this->cache->Admit(key, value, is_found && !is_tombstone, deadline); }
+}
+
+/// @brief get a key without copying its value. cached values are copies, so the read cache is neither read nor filled. 
+/// @param key the inquired key
+/// @return the view of the value, see BloomStore::GetView
+ValueView Partitioner::GetView(std::span<uint8_t> key) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Get, key); }
+    auto hash = Hash(key, 'Z');
+    size_t index = this->partition_map.Route(hash);
+    auto view = this->instances[index]->GetView(key);
+    if (!view.is_found && this->IsMigrating()) {
+        size_t previous_index = this->previous_map.Route(hash);
+        if (previous_index != index) {
+            view = this->instances[previous_index]->GetView(key);
+        }
+    }
+    return view;
+}
+
+/// @brief get a key without blocking on disk reads
+/// @param loop     the event loop running this task
+/// @param key      the inquired key, must stay alive until the task is done
+/// @param value    the value buffer, must stay alive until the task is done
+/// @return whether the key is found, and whether it is deleted
+Task<Lookup> Partitioner::AsyncGet(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Get, key); }
+    auto result = Lookup();
+    if (this->cache && this->cache->Get(key, value, result.is_found)) { co_return result; }
+    auto hash = Hash(key, 'Z');
+    size_t index = this->partition_map.Route(hash);
+    auto put_count = this->instances[index]->stat_put_count;
+    auto deadline = this->cache ? this->Deadline(hash) : UINT64_MAX;
+    result = co_await this->instances[index]->AsyncGet(loop, key, value);
+    if (!result.is_found && this->IsMigrating()) {
+        size_t previous_index = this->previous_map.Route(hash);
+        if (previous_index != index) {
+            result = co_await this->instances[previous_index]->AsyncGet(loop, key, value);
+        }
+    }
+    // a write while suspended may have changed the key, only a stable answer is cached. 
+    // chains freed meanwhile are expired, and the deadline taken before reading is no later than theirs
+    if (this->cache && this->instances[index]->stat_put_count == put_count) {
+        this->cache->Admit(key, value, result.is_found && !result.is_tombstone, deadline);
+    }
+    co_return result;
+}
+
+/// @brief put a key from a task without blocking on disk, see BloomStore::AsyncPut. 
+///        migration only advances on blocking writes, it reads and writes partitions in place. 
+/// @param loop     the event loop running this task
+/// @param key      the inserted key, must stay alive until the task is done
+/// @param value    the inserted value, must stay alive until the task is done
+Task<void> Partitioner::AsyncPut(EventLoop& loop, std::span<uint8_t> key, std::span<uint8_t> value) {
+    if (this->recorder) { this->recorder->Record(TraceOp::Put, key); }
+    size_t index = this->partition_map.Route(Hash(key, 'Z'));
+    // the entry is in memory before the task first suspends, so the cache is updated in the same step
+    if (this->cache) { this->cache->Update(key, value, this->instances[index]->Deadline(true)); }
+    co_await this->instances[index]->AsyncPut(loop, key, value);
+}
+
+/// @brief apply a write batch, routing every entry once and handing each partition its slice in one go
+/// @param batch the write batch, entries are reordered by partition
+/// @return false if the batch is atomic and some partition gets more entries than a block holds, then nothing is applied
+bool Partitioner::Write(WriteBatch& batch) {
+    batch.HashEntries();
+    auto counts = std::vector<size_t>(this->instances.size(), 0);
+    for (auto& entry: batch.entries) {
+        entry.partition = this->partition_map.Route(entry.hash);
+        counts[entry.partition] += 1;
+    }
+    if (batch.atomic) {
+        for (size_t p = 0; p < counts.size(); ++p) {
+            if (counts[p] > this->instances[p]->capacity) { return false; }
+        }
+    }
+    for (auto& entry: batch.entries) {
+        auto key = std::span{&batch.bytes[entry.offset], batch.key_bytes};
+        if (this->recorder) { this->recorder->Record(entry.is_tombstone ? TraceOp::Del : TraceOp::Put, key); }
+        if (!this->cache) { continue; }
+        if (entry.is_tombstone) { this->cache->Invalidate(key); }
+        else { this->cache->Update(key, std::span{&batch.bytes[entry.offset + batch.key_bytes], batch.value_bytes}, this->instances[entry.partition]->Deadline(true)); }
+    }
+    // stable, so writes to the same key keep their order
+    std::stable_sort(batch.entries.begin(), batch.entries.end(), [](auto& a, auto& b) {
+        return a.partition < b.partition;
+    });
+    size_t begin = 0;
+    while (begin < batch.entries.size()) {
+        auto partition = batch.entries[begin].partition;
+        auto end = begin;
+        while (end < batch.entries.size() && batch.entries[end].partition == partition) { end += 1; }
+        this->instances[partition]->Write(batch, begin, end);
+        begin = end;
+    }
+    this->AdvanceMigration(batch.entries.size());
+    return true;
+}
+
+/// @brief load an unsorted array of records, routed and written by nthreads threads in parallel. 
+///        each partition gets its records in order, as whole blocks and chains with one sync at the end. 
+/// @param records  key value records, key_bytes + value_bytes each
+/// @param nthreads the number of loading threads
+void Partitioner::BulkLoad(std::span<uint8_t> records, size_t nthreads) {
+    this->Migrate(SIZE_MAX);
+    this->LoadRecords(records, nthreads, true);
+}
+
+/// @brief load a file of records chunk by chunk, so it never has to fit in memory, see BulkLoad above. 
+///        partitions keep their blocks open across chunks and sync once after the last one. 
+/// @param path         the record file, key_bytes + value_bytes per record without any header
+/// @param nthreads     the number of loading threads
+/// @param chunk_bytes  the most bytes read and loaded at once, rounded down to whole records
+void Partitioner::BulkLoad(std::string& path, size_t nthreads, size_t chunk_bytes) {
+    auto in = std::ifstream(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        std::cerr << "open: " << path << std::endl;
+    }
+    assert(in.good());
+    size_t remaining = in.tellg();
+    in.seekg(0);
+    auto record_bytes = this->instances[0]->key_bytes + this->instances[0]->value_bytes;
+    assert(remaining % record_bytes == 0);
+    chunk_bytes = std::max(chunk_bytes / record_bytes, size_t{1}) * record_bytes;
+    this->Migrate(SIZE_MAX);
+    auto records = std::vector<uint8_t>(std::min(chunk_bytes, remaining));
+    do {
+        auto chunk = std::span{records.data(), std::min(chunk_bytes, remaining)};
+        in.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+        assert(in.good());
+        remaining -= chunk.size();
+        this->LoadRecords(chunk, nthreads, remaining == 0);
+    } while (remaining > 0);
+}
+
+/// @brief route and load one array of records in parallel, see BulkLoad
+/// @param records  key value records, key_bytes + value_bytes each
+/// @param nthreads the number of loading threads
+/// @param is_last  false if more records follow, partitions then stay open for them
+void Partitioner::LoadRecords(std::span<uint8_t> records, size_t nthreads, bool is_last) {
+    auto record_bytes = this->instances[0]->key_bytes + this->instances[0]->value_bytes;
+    assert(records.size() % record_bytes == 0);
+    auto nrecords = records.size() / record_bytes;
+    // route chunk t of records on thread t, then partition p is loaded on thread p % nthreads, 
+    // pinned to the home node of p so its blocks and filters are built next to the buffers it was bound to
+    auto routed = std::vector<std::vector<std::vector<size_t>>>(nthreads, std::vector<std::vector<size_t>>(this->instances.size()));
+    auto run = [&](auto&& work) {
+        auto threads = std::vector<std::thread>();
+        for (size_t t = 0; t < nthreads; ++t) {
+            threads.emplace_back([&, t]() {
+                if (this->numa) { this->Serve(t % Numa::Nodes()); }
+                work(t);
+            });
+        }
+        for (auto& thread: threads) { thread.join(); }
+    };
+    run([&](size_t t) {
+        auto hashes = std::array<uint32_t, 256>();
+        auto end = nrecords * (t + 1) / nthreads;
+        for (size_t i = nrecords * t / nthreads; i < end; i += hashes.size()) {
+            auto n = std::min(hashes.size(), end - i);
+            HashBatch(records.subspan(i * record_bytes), this->instances[0]->key_bytes, record_bytes, 'Z', std::span{hashes}.subspan(0, n));
+            for (size_t j = 0; j < n; ++j) {
+                routed[t][this->partition_map.Route(hashes[j])].push_back((i + j) * record_bytes);
+            }
+        }
+    });
+    run([&](size_t t) {
+        auto offsets = std::vector<size_t>();
+        for (size_t p = t; p < this->instances.size(); p += nthreads) {
+            if (this->numa) { this->Serve(this->HomeNode(p)); }
+            offsets.clear();
+            for (size_t u = 0; u < nthreads; ++u) {
+                offsets.insert(offsets.end(), routed[u][p].begin(), routed[u][p].end());
+            }
+            this->instances[p]->BulkLoad(records, std::span{offsets}, is_last);
+            // the cache is thread safe, each thread drops the keys of partitions it loaded
+            if (this->cache) {
+                for (auto offset: offsets) { this->cache->Invalidate(records.subspan(offset, this->instances[0]->key_bytes)); }
+            }
+        }
+    });
+}
+
+/// @brief add a new partition, which takes over a share of keys from every existing partition
+/// @param instance the new partition, owned by partitioner afterwards
+/// @return the index of the new partition
+uint32_t Partitioner::AddPartition(BloomStore* instance) {
+    this->Migrate(SIZE_MAX);
+    this->previous_map = this->partition_map;
+    this->UseRing();
+    auto index = this->partition_map.AddPartition(VNODES);
+    assert(index == this->instances.size());
+    this->instances.push_back(instance);
+    if (this->budget) { instance->UseBudget(*this->budget); }
+    if (this->numa) { instance->Bind(this->HomeNode(index)); }
+    this->BeginMigration();
+    return index;
+}
+
+/// @brief split a hot partition, the new partition takes over half of its keys
+/// @param partition    the split partition
+/// @param instance     the new partition, owned by partitioner afterwards
+/// @return the index of the new partition
+uint32_t Partitioner::SplitPartition(uint32_t partition, BloomStore* instance) {
+    this->Migrate(SIZE_MAX);
+    this->previous_map = this->partition_map;
+    this->UseRing();
+    auto index = this->partition_map.SplitPartition(partition);
+    assert(index == this->instances.size());
+    this->instances.push_back(instance);
+    if (this->budget) { instance->UseBudget(*this->budget); }
+    if (this->numa) { instance->Bind(this->HomeNode(index)); }
+    this->BeginMigration();
+    return index;
+}
+
+/// @brief replace a modulo map by a ring of as many partitions before resizing, 
+///        the migration of the resize then moves every key that lands elsewhere on the ring as well
+void Partitioner::UseRing() {
+    if (!this->partition_map.IsModulo()) { return; }
+    this->partition_map = PartitionMap(this->partition_map.Size(), VNODES);
+}
+
+/// @brief start moving keys from the previous map to the current one. 
+///        donors and new partitions are flushed, and where their blocks from before the resize end is persisted with the maps: 
+///        Migrate scans only those blocks of a donor, and probes only newer ones of the partition a key moves to. 
+void Partitioner::BeginMigration() {
+    this->previous_map.Donors(this->partition_map, this->migration_sources);
+    this->migration_chains.assign(this->instances.size(), 0);
+    this->migration_sealed.assign(this->instances.size(), 0);
+    for (uint32_t partition = 0; partition < this->instances.size(); ++partition) {
+        bool is_donor = std::find(this->migration_sources.begin(), this->migration_sources.end(), partition) != this->migration_sources.end();
+        if (!is_donor && partition < this->previous_map.Size()) { continue; }
+        this->instances[partition]->Checkpoint(this->migration_chains[partition], this->migration_sealed[partition]);
+    }
+    this->SaveMap();
+}
+
+/// @brief check if some keys are still waiting to be moved after a resize
+bool Partitioner::IsMigrating() {
+    return !this->previous_map.IsEmpty();
+}
+
+/// @brief move chains older than the newest hot_chains of every partition with a cold tier to its cold files
+/// @param hot_chains   the number of newest chains that stay in hot files, per partition
+/// @param nchains      the most chains moved from each partition in this call
+/// @return true iff no partition has chains left to demote
+bool Partitioner::Demote(size_t hot_chains, size_t nchains) {
+    bool is_done = true;
+    for (auto instance: this->instances) {
+        if (!instance->f_cold_kv_pairs) { continue; }
+        is_done = instance->Demote(hot_chains, nchains) && is_done;
+    }
+    return is_done;
+}
+
+/// @brief demote on the writing thread of every partition with a cold tier, see BloomStore::AutoDemote
+/// @param hot_chains the number of newest chains that stay in hot files, per partition, SIZE_MAX stops demoting
+void Partitioner::AutoDemote(size_t hot_chains) {
+    for (auto instance: this->instances) {
+        if (instance->f_cold_kv_pairs) { instance->AutoDemote(hot_chains); }
+    }
+}
+
+/// @brief free expired chains of every partition with a ttl. 
+///        cached values of a ttl partition carry a deadline no later than their entries expire, see Deadline, 
+///        so nothing cached is left pointing at a freed chain. 
+/// @param nchains the most chains freed from each partition in this call
+/// @return true iff no partition has expired chains left to free
+bool Partitioner::Expire(size_t nchains) {
+    bool is_done = true;
+    for (auto instance: this->instances) {
+        if (instance->ttl == 0) { continue; }
+        is_done = instance->Expire(nchains) && is_done;
+    }
+    return is_done;
+}
+
+/// @brief the deadline of a value a get of key is about to read, see BloomStore::Deadline. 
+///        while migrating the value may come from the previous partition of key, the earlier deadline counts. 
+/// @param hash the key hash
+/// @return the deadline in wall clock milliseconds, UINT64_MAX if no partition involved has a ttl
+uint64_t Partitioner::Deadline(uint32_t hash) {
+    size_t index = this->partition_map.Route(hash);
+    auto deadline = this->instances[index]->Deadline(false);
+    if (this->IsMigrating()) {
+        deadline = std::min(deadline, this->instances[this->previous_map.Route(hash)]->Deadline(false));
+    }
+    return deadline;
+}
+
+/// @brief move keys to their new partitions, at most nblocks flushed blocks are read per call.
+///        reads and writes keep working in between, so it can be interleaved with foreground work.
+///        a donor without ttl also writes the keys it keeps again, then frees its chains from before the resize, 
+///        so moved copies don't stay behind. a donor with ttl lets them expire instead. 
+/// @param nblocks the number of blocks to move in this step
+/// @return true iff the migration is complete
+bool Partitioner::Migrate(size_t nblocks) {
+    while (this->IsMigrating()) {
+        if (!this->migration_started) {
+            if (this->migration_sources.empty()) {
+                this->previous_map = PartitionMap();
+                this->migration_chains.clear();
+                this->migration_sealed.clear();
+                this->SaveMap();
+                break;
+            }
+            auto source = this->migration_sources.back();
+            this->migration_blocks.clear();
+            this->migration_nsealed = this->instances[source]->ScanBlockAddresses(this->migration_blocks, this->migration_chains[source], this->migration_sealed[source]);
+            // demoting the scanned chains would move blocks away from the collected addresses
+            this->instances[source]->held_chains = this->migration_chains[source] + 1;
+            // blocks are popped from the back, newest first
+            std::reverse(this->migration_blocks.begin(), this->migration_blocks.end());
+            this->migration_started = true;
+            continue;
+        }
+        auto source = this->migration_sources.back();
+        auto instance = this->instances[source];
+        if (this->migration_blocks.empty()) {
+            if (instance->ttl == 0) { instance->FreeChains(this->migration_chains[source]); }
+            instance->held_chains = 0;
+            this->migration_sources.pop_back();
+            this->migration_started = false;
+            continue;
+        }
+        if (nblocks == 0) { return false; }
+        nblocks -= 1;
+        auto address = this->migration_blocks.back();
+        this->migration_blocks.pop_back();
+        // blocks sealed in the collector at the resize share their chain with later blocks, it is not freed
+        bool is_freed = this->migration_nsealed == 0 && instance->ttl == 0;
+        if (this->migration_nsealed > 0) { this->migration_nsealed -= 1; }
+        this->migration_kept.clear();
+        instance->ScanBlock(address, [&](std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+            auto hash = Hash(key, 'Z');
+            // stale copies left behind by earlier migrations are not owned by source
+            if (this->previous_map.Route(hash) != source) { return; }
+            auto index = this->partition_map.Route(hash);
+            if (index != source) {
+                this->MigrateEntry(index, key, value, is_tombstone);
+                return;
+            }
+            if (!is_freed) { return; }
+            // source is busy scanning, kept entries are written once the block is done
+            this->migration_kept.insert(this->migration_kept.end(), key.begin(), key.end());
+            this->migration_kept.insert(this->migration_kept.end(), value.begin(), value.end());
+            this->migration_kept.push_back(is_tombstone);
+        });
+        auto entry_bytes = instance->key_bytes + instance->value_bytes + 1;
+        for (size_t i = 0; i < this->migration_kept.size(); i += entry_bytes) {
+            auto entry = std::span{this->migration_kept}.subspan(i, entry_bytes);
+            auto key = entry.subspan(0, instance->key_bytes);
+            auto value = entry.subspan(instance->key_bytes, instance->value_bytes);
+            this->KeepEntry(source, key, value, entry.back() != 0);
+        }
+    }
+    return true;
+}
+
+/// @brief migrate on the thread writing through partitioner from now on: every nwrites writes, one more block is moved, 
+///        so a resize completes in the background of writes without Migrate calls, like BloomStore::AutoDemote. 
+/// @param nwrites the number of writes per moved block, SIZE_MAX stops migrating
+void Partitioner::AutoMigrate(size_t nwrites) {
+    assert(nwrites != 0);
+    this->auto_migrate_writes = nwrites;
+    this->migration_writes = 0;
+}
+
+/// @brief count writes towards the next automatic migration step, see AutoMigrate
+/// @param nwrites the number of writes just done
+void Partitioner::AdvanceMigration(size_t nwrites) {
+    if (this->auto_migrate_writes == SIZE_MAX || !this->IsMigrating()) { return; }
+    this->migration_writes += nwrites;
+    if (this->migration_writes < this->auto_migrate_writes) { return; }
+    // partitions still writing blocks sealed by AsyncPut can't be scanned yet, the count carries over
+    for (auto instance: this->instances) {
+        if (instance->is_writing) { return; }
+    }
+    auto nblocks = this->migration_writes / this->auto_migrate_writes;
+    this->migration_writes %= this->auto_migrate_writes;
+    this->Migrate(nblocks);
+}
+
+/// @brief move one entry to the partition owning it now.
+///        entries are visited newest first, so the first sight of a key lands in the new partition 
+///        and older copies find it there, nothing per key is kept in memory. 
+/// @param index        the partition owning key now
+/// @param key          the moved key
+/// @param value        its value
+/// @param is_tombstone whether key is deleted
+void Partitioner::MigrateEntry(uint32_t index, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+    // anything written to the new partition since the resize, or moved there before, is newer. 
+    // its older blocks are not read, key belonged to another partition then
+    bool is_operand = false;
+    if (this->instances[index]->Probe(key, this->migration_chains[index], is_operand)) { return; }
+    // a tombstone is moved too, so older values of key seen later don't come back
+    if (is_tombstone) { this->instances[index]->Del(key); }
+    else { this->instances[index]->Put(key, value); }
+}
+
+/// @brief write an entry staying in source again, before the chain holding it is freed. 
+///        like MigrateEntry, only the first sight of a key since the resize is written. 
+/// @param source       the donor keeping key
+/// @param key          the kept key
+/// @param value        its value
+/// @param is_tombstone whether key is deleted
+void Partitioner::KeepEntry(uint32_t source, std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+    auto instance = this->instances[source];
+    bool is_operand = false;
+    if (instance->Probe(key, this->migration_chains[source], is_operand)) {
+        if (!is_operand) { return; }
+        // operands sealed in the collector at the resize stack on this value, fold them in before it is freed
+        bool is_found = false;
+        instance->Get(key, value, is_tombstone, is_found);
+        is_tombstone = is_tombstone || !is_found;
+    }
+    if (is_tombstone) { instance->Del(key); }
+    else { instance->Put(key, value); }
+}
+
+/// @brief share a memory budget among all partitions, including ones added later
+/// @param budget the memory budget
+void Partitioner::UseBudget(MemoryBudget& budget) {
+    this->budget = &budget;
+    for (auto instance: this->instances) {
+        instance->UseBudget(budget);
+    }
+}
+
+/// @brief answer hot reads from a cache in front of all partitions, kept up to date by writes through partitioner
+/// @param cache the read cache
+void Partitioner::UseCache(ReadCache& cache) {
+    this->cache = &cache;
+}
+
+/// @brief record every operation through partitioner into a trace
+/// @param recorder the trace recorder
+void Partitioner::UseRecorder(TraceRecorder& recorder) {
+    this->recorder = &recorder;
+}
+
+/// @brief give every partition a home numa node and move its buffers there, including partitions added later. 
+///        partition p lives on node p % nodes, so a thread serving partitions p % nthreads == t 
+///        stays on one node when t runs on node t % nodes and nodes divides nthreads (see Serve). 
+void Partitioner::UseNuma() {
+    this->numa = true;
+    for (uint32_t partition = 0; partition < this->instances.size(); ++partition) {
+        this->instances[partition]->Bind(this->HomeNode(partition));
+    }
+}
+
+/// @brief the numa node holding buffers of a partition
+/// @param partition the partition
+size_t Partitioner::HomeNode(uint32_t partition) {
+    return partition % Numa::Nodes();
+}
+
+/// @brief pin calling thread to a numa node, so it probes filters of partitions homed there without crossing sockets
+/// @param node the numa node
+void Partitioner::Serve(size_t node) {
+    Numa::Pin(node);
+}
+
+/// @brief find the partition currently owning a key, e.g. to split work among threads by partition
+/// @param key the key
+/// @return the partition index
+uint32_t Partitioner::Route(std::span<uint8_t> key) {
+    return this->partition_map.Route(Hash(key, 'Z'));
+}
+
+/// @brief read the maps and the resize checkpoints written by SaveMap
+/// @param in the input stream
+/// @return true iff everything is read successfully
+bool Partitioner::LoadMap(std::istream& in) {
+    if (!this->partition_map.Load(in) || !this->previous_map.Load(in)) { return false; }
+    size_t npartitions = 0;
+    if (!(in >> npartitions)) { return false; }
+    this->migration_chains.resize(npartitions);
+    this->migration_sealed.resize(npartitions);
+    for (size_t partition = 0; partition < npartitions; ++partition) {
+        if (!(in >> this->migration_chains[partition] >> this->migration_sealed[partition])) { return false; }
+    }
+    return !this->IsMigrating() || npartitions == this->partition_map.Size();
+}
+
+/// @brief persist current (and previous, while migrating) partition map, and where partitions stood at the resize
+void Partitioner::SaveMap() {
+    if (this->path_map.empty()) { return; }
+    auto path_temp = this->path_map + ".tmp";
+    {
+        auto out = std::ofstream(path_temp, std::ios::trunc);
+        this->partition_map.Dump(out);
+        this->previous_map.Dump(out);
+        out << this->migration_chains.size() << "\n";
+        for (size_t partition = 0; partition < this->migration_chains.size(); ++partition) {
+            out << this->migration_chains[partition] << " " << this->migration_sealed[partition] << "\n";
+        }
+        out.flush();
+        assert(out.good());
+    }
+    int error_code = std::rename(path_temp.c_str(), this->path_map.c_str());
+    if (error_code != 0) {
+        std::cerr << "rename: " << path_temp << std::endl;
+    }
+    assert(error_code == 0);
 }
 
 size_t Partitioner::StatDiskReadCount() {
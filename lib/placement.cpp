@@ -0,0 +1,72 @@
+#include<placement.hpp>
+#include<cassert>
+#include<numeric>
+#include<sys/stat.h>
+
+namespace bloomstore {
+
+/// @brief initialize placement over a list of directories, one for each device
+/// @param directories  the mount points of devices
+/// @param weights      the relative share of partitions placed on each device
+/// @param queue_depth  the maximal number of in-flight io requests per device
+Placement::Placement(
+    std::vector<std::string>& directories,
+    std::vector<size_t>& weights,
+    size_t queue_depth
+):
+    weights{weights},
+    credits(directories.size(), 0)
+{
+    assert(directories.size() == weights.size());
+    assert(!directories.empty());
+    for (auto& directory: directories) {
+        this->devices.push_back(new Device(directory, queue_depth));
+    }
+}
+
+Placement::~Placement() {
+    for (auto device: this->devices) {
+        delete device;
+    }
+}
+
+/// @brief pick the device of a file. a file already existing on some device stays there, 
+///        new files are placed by smooth weighted round robin. 
+/// @param name the file name
+/// @return the device, owned by placement
+Device* Placement::Place(std::string& name) {
+    for (auto device: this->devices) {
+        struct stat st;
+        if (stat(device->Path(name).c_str(), &st) == 0) { return device; }
+    }
+    int64_t total = std::accumulate(this->weights.begin(), this->weights.end(), int64_t{0});
+    size_t chosen = 0;
+    for (size_t i = 0; i < this->devices.size(); ++i) {
+        this->credits[i] += this->weights[i];
+        if (this->credits[i] > this->credits[chosen]) { chosen = i; }
+    }
+    this->credits[chosen] -= total;
+    return this->devices[chosen];
+}
+
+/// @brief limit an io class on every device, see Device::Limit
+/// @param io_class         the io class
+/// @param bytes_per_second the sustained rate of this class per device, 0 for unlimited
+/// @param max_inflight     the most slots this class may hold per device, 0 for the whole queue
+void Placement::Limit(IOClass io_class, size_t bytes_per_second, size_t max_inflight) {
+    for (auto device: this->devices) {
+        device->Limit(io_class, bytes_per_second, max_inflight);
+    }
+}
+
+/// @brief weight devices by their available capacity
+/// @param directories  the mount points of devices
+/// @param weights      the output weights
+void Placement::CapacityWeights(std::vector<std::string>& directories, std::vector<size_t>& weights) {
+    for (auto& directory: directories) {
+        auto device = Device(directory, 1);
+        weights.push_back(std::max(device.Capacity(), size_t{1}));
+    }
+}
+
+} // namespace bloomstore
@@ -2,6 +2,7 @@
 
 #include<cassert>
 #include<cstdint>
+#include<cstdlib>
 #include<unistd.h>
 #include<port.hpp>
 #include<stdio.h>
@@ -9,13 +10,370 @@
 #include<string>
 #include<span>
 #include<sys/stat.h>
+#include<sys/statvfs.h>
+#include<sys/mman.h>
+#include<cstring>
 #include<iostream>
 #include<errno.h>
+#include<linux/aio_abi.h>
+#include<sys/syscall.h>
+#include<linux/mempolicy.h>
+#include<sched.h>
+#include<signal.h>
+#include<fstream>
+#include<atomic>
+#include<thread>
+#include<sstream>
+
+// --- Clock --- //
+
+/// @brief wall clock time in milliseconds, unlike steady clock it is meaningful across restarts and processes
+uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// --- BufferPool --- //
+
+// buffers from 2MiB on are aligned to huge pages
+#define HUGE_PAGE_BYTES (2 << 20)
+// a thread keeps at most this many idle bytes
+#define POOL_MAX_CACHED_BYTES (64 << 20)
+
+BufferPool::BufferPool():
+    cached_bytes{0},
+    node{-1}
+{}
+
+BufferPool::~BufferPool() {
+    for (auto& [size_class, free_list]: this->free_lists) {
+        for (auto buffer: free_list) { free(buffer); }
+    }
+}
+
+/// @brief the pool of calling thread
+BufferPool& BufferPool::Local() {
+    return *BufferPool::Shared();
+}
+
+/// @brief the pool of calling thread, shared with the buffers borrowed from it so it outlives them
+std::shared_ptr<BufferPool> BufferPool::Shared() {
+    thread_local auto pool = std::make_shared<BufferPool>();
+    return pool;
+}
+
+/// @brief buffers are bucketed by power of two sizes, no smaller than a page
+size_t BufferPool::SizeClass(size_t bytes) {
+    size_t size_class = ALIGN;
+    while (size_class < bytes) { size_class *= 2; }
+    return size_class;
+}
+
+/// @brief take a buffer of at least bytes bytes, reusing an idle one when possible
+/// @param bytes the buffer size
+/// @return a page aligned buffer, to be handed back with Return
+void* BufferPool::Borrow(size_t bytes) {
+    auto size_class = SizeClass(bytes);
+    auto lock = std::lock_guard(this->mutex);
+    auto& free_list = this->free_lists[size_class];
+    if (!free_list.empty()) {
+        auto buffer = free_list.back();
+        free_list.pop_back();
+        this->cached_bytes -= size_class;
+        return buffer;
+    }
+    void* buffer = nullptr;
+    size_t align = size_class >= HUGE_PAGE_BYTES ? HUGE_PAGE_BYTES : ALIGN;
+    int error_code = posix_memalign(&buffer, align, size_class);
+    assert(error_code == 0);
+    if (size_class >= HUGE_PAGE_BYTES) { madvise(buffer, size_class, MADV_HUGEPAGE); }
+    if (this->node >= 0) { Numa::Bind(buffer, size_class, this->node); }
+    return buffer;
+}
+
+/// @brief give a borrowed buffer back, it may be freed if too many bytes are idle
+/// @param buffer   the buffer
+/// @param bytes    the size it was borrowed with
+/// @param node     the numa node its pages were placed on, -1 for first touch
+void BufferPool::Return(void* buffer, size_t bytes, int node) {
+    auto size_class = SizeClass(bytes);
+    // buffers destroyed on other threads come back here too, the lock is uncontended otherwise
+    auto lock = std::lock_guard(this->mutex);
+    // a buffer placed elsewhere than this pool places new ones would hand remote memory to the next Borrow
+    if (node != this->node || this->cached_bytes + size_class > POOL_MAX_CACHED_BYTES) {
+        free(buffer);
+        return;
+    }
+    this->free_lists[size_class].push_back(buffer);
+    this->cached_bytes += size_class;
+}
+
+/// @brief place buffers borrowed from now on on a numa node, -1 leaves it to first touch. 
+///        idle buffers placed on another node are freed, so Borrow never hands them out. 
+/// @param node the numa node
+void BufferPool::UseNode(int node) {
+    auto lock = std::lock_guard(this->mutex);
+    if (node == this->node) { return; }
+    this->node = node;
+    for (auto& [size_class, free_list]: this->free_lists) {
+        for (auto buffer: free_list) { free(buffer); }
+        free_list.clear();
+    }
+    this->cached_bytes = 0;
+}
+
+/// @brief the numa node buffers are borrowed on, -1 for first touch
+int BufferPool::Node() {
+    auto lock = std::lock_guard(this->mutex);
+    return this->node;
+}
+
+/// @brief the number of idle bytes kept for reuse
+size_t BufferPool::CachedBytes() {
+    auto lock = std::lock_guard(this->mutex);
+    return this->cached_bytes;
+}
+
+// --- Numa --- //
+
+/// @brief parse a sysfs list like "0-3,8-11"
+/// @param list the list
+/// @param ids  the listed ids, appended to
+static void ParseList(std::string& list, std::vector<int>& ids) {
+    auto ranges = std::stringstream(list);
+    auto range = std::string();
+    while (std::getline(ranges, range, ',')) {
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; ++id) { ids.push_back(id); }
+    }
+}
+
+/// @brief the sysfs ids of online numa nodes, which need not be contiguous (e.g. "0,2" or "0-1,4-5"). 
+///        nodes are numbered 0 to Nodes() - 1 everywhere else, node i is the i-th online one. 
+static std::vector<int>& NodeIds() {
+    static auto ids = []() {
+        auto ids = std::vector<int>();
+        auto in = std::ifstream("/sys/devices/system/node/online");
+        auto list = std::string();
+        if (in >> list) { ParseList(list, ids); }
+        return ids;
+    }();
+    return ids;
+}
+
+/// @brief the number of online numa nodes, 1 if sysfs doesn't tell
+size_t Numa::Nodes() {
+    return std::max(NodeIds().size(), size_t{1});
+}
+
+/// @brief list cpus of a numa node, parsed from its cpulist
+/// @param node the numa node
+/// @param cpus the cpu ids, appended to
+void Numa::Cpus(size_t node, std::vector<int>& cpus) {
+    auto cpulist = std::string();
+    if (node < NodeIds().size()) {
+        auto in = std::ifstream("/sys/devices/system/node/node" + std::to_string(NodeIds()[node]) + "/cpulist");
+        in >> cpulist;
+    }
+    if (cpulist.empty()) {
+        // no numa information, every cpu is on node 0
+        for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN); ++cpu) { cpus.push_back(cpu); }
+        return;
+    }
+    ParseList(cpulist, cpus);
+}
+
+/// @brief run calling thread on cpus of a numa node only, and allocate its pooled buffers there
+/// @param node the numa node
+void Numa::Pin(size_t node) {
+    auto cpus = std::vector<int>();
+    Numa::Cpus(node, cpus);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu: cpus) { CPU_SET(cpu, &set); }
+    int error_code = sched_setaffinity(0, sizeof(set), &set);
+    if (error_code != 0) {
+        std::cerr << "sched_setaffinity: " << errno << std::endl;
+    }
+    BufferPool::Local().UseNode(node);
+}
+
+/// @brief prefer a numa node for a page aligned buffer, moving pages already touched
+/// @param buffer   the buffer, page aligned
+/// @param bytes    the buffer size
+/// @param node     the numa node
+void Numa::Bind(void* buffer, size_t bytes, size_t node) {
+    if (Numa::Nodes() == 1) { return; }
+    assert(reinterpret_cast<uintptr_t>(buffer) % BufferPool::ALIGN == 0);
+    int id = NodeIds()[node];
+    assert(id < int(sizeof(unsigned long) * 8));
+    unsigned long mask = 1ul << id;
+    long error_code = syscall(SYS_mbind, buffer, bytes, MPOL_PREFERRED, &mask, sizeof(mask) * 8, MPOL_MF_MOVE);
+    // binding is a hint, e.g. containers may forbid it
+    if (error_code != 0) {
+        std::cerr << "mbind: " << errno << std::endl;
+    }
+}
+
+// --- Device --- //
+
+// a token bucket holds at most this many seconds of its rate, the burst a class may issue after idling
+#define TOKEN_BURST_SECONDS 0.1
+
+/// @brief initialize a device
+/// @param directory    the directory where device is mounted
+/// @param queue_depth  the maximal number of in-flight io requests on this device
+Device::Device(std::string& directory, size_t queue_depth):
+    directory{directory},
+    queue_depth{queue_depth},
+    inflight{0}
+{}
+
+/// @brief get the path of a file placed on this device
+/// @param name the file name
+/// @return the file path
+std::string Device::Path(std::string& name) {
+    return this->directory + "/" + name;
+}
+
+/// @brief get available capacity of this device in MiB
+size_t Device::Capacity() {
+    struct statvfs st;
+    int error_code = statvfs(this->directory.c_str(), &st);
+    if (error_code != 0) {
+        std::cerr << "statvfs: " << this->directory << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(error_code == 0);
+    return st.f_bavail * st.f_frsize / (1024 * 1024);
+}
+
+/// @brief limit an io class, e.g. keep flushes from crowding out foreground reads
+/// @param io_class         the io class
+/// @param bytes_per_second the sustained rate of this class, 0 for unlimited
+/// @param max_inflight     the most slots this class may hold at once, 0 for the whole queue
+void Device::Limit(IOClass io_class, size_t bytes_per_second, size_t max_inflight) {
+    auto lock = std::unique_lock(this->mutex);
+    auto& queue = this->queues[static_cast<size_t>(io_class)];
+    queue.bytes_per_second = bytes_per_second;
+    queue.max_inflight = max_inflight == 0 ? SIZE_MAX : max_inflight;
+    queue.tokens = bytes_per_second * TOKEN_BURST_SECONDS;
+    queue.refilled = std::chrono::steady_clock::now();
+    this->available.notify_all();
+}
+
+/// @brief add tokens earned since last refill, up to the burst
+void Device::Refill(IOQueue& queue) {
+    if (queue.bytes_per_second == 0) { return; }
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - queue.refilled).count();
+    queue.tokens = std::min(queue.tokens + elapsed * queue.bytes_per_second, queue.bytes_per_second * TOKEN_BURST_SECONDS);
+    queue.refilled = now;
+}
+
+/// @brief check if a request of io_class may take a slot now, the lock must be held. 
+///        a class in token debt waits, and so does any class below a waiting class that could be served. 
+bool Device::IsAdmitted(IOClass io_class) {
+    if (this->inflight >= this->queue_depth) { return false; }
+    for (size_t c = 0; c <= static_cast<size_t>(io_class); ++c) {
+        auto& queue = this->queues[c];
+        this->Refill(queue);
+        bool is_ready = queue.inflight < queue.max_inflight && (queue.bytes_per_second == 0 || queue.tokens > 0);
+        if (c == static_cast<size_t>(io_class)) { return is_ready; }
+        if (is_ready && queue.waiting != 0) { return false; }
+    }
+    return false;
+}
+
+/// @brief take a slot and charge bytes to the token bucket, the lock must be held. 
+///        a request larger than the bucket leaves it in debt, which later requests wait out. 
+void Device::Take(IOClass io_class, size_t bytes) {
+    auto& queue = this->queues[static_cast<size_t>(io_class)];
+    this->inflight += 1;
+    queue.inflight += 1;
+    if (queue.bytes_per_second != 0) { queue.tokens -= bytes; }
+}
+
+/// @brief wait for a free slot in device io queue
+/// @param io_class the io class of this request
+/// @param bytes    the number of bytes transferred, charged to the class rate limit
+void Device::Acquire(IOClass io_class, size_t bytes) {
+    auto lock = std::unique_lock(this->mutex);
+    auto& queue = this->queues[static_cast<size_t>(io_class)];
+    queue.waiting += 1;
+    while (!this->IsAdmitted(io_class)) {
+        if (queue.bytes_per_second != 0 && queue.tokens <= 0) {
+            // nothing releases a slot when tokens run out, wake up when the debt is paid off
+            auto debt = std::chrono::duration<double>((1 - queue.tokens) / queue.bytes_per_second);
+            this->available.wait_for(lock, debt);
+        }
+        else {
+            this->available.wait(lock);
+        }
+    }
+    queue.waiting -= 1;
+    this->Take(io_class, bytes);
+    // lower classes held back by this request may go on if slots are left
+    if (queue.waiting == 0) { this->available.notify_all(); }
+}
+
+/// @brief take a free slot in device io queue without waiting
+/// @param io_class the io class of this request
+/// @param bytes    the number of bytes transferred, charged to the class rate limit
+/// @return false if the queue is full or this class has to wait
+bool Device::TryAcquire(IOClass io_class, size_t bytes) {
+    auto lock = std::unique_lock(this->mutex);
+    if (!this->IsAdmitted(io_class)) { return false; }
+    this->Take(io_class, bytes);
+    return true;
+}
+
+/// @brief return a slot to device io queue
+/// @param io_class the io class of the finished request
+void Device::Release(IOClass io_class) {
+    auto lock = std::unique_lock(this->mutex);
+    this->inflight -= 1;
+    this->queues[static_cast<size_t>(io_class)].inflight -= 1;
+    this->available.notify_all();
+}
+
+// --- FileObject --- //
 
 FileObject::FileObject(std::string& path):
-    path{path}
+    FileObject(path, nullptr)
+{}
+
+FileObject::FileObject(std::string& path, Device* device):
+    FileObject(path, device, FileMode::Direct)
+{}
+
+/// @brief open a file whose io requests are queued on device
+/// @param path     the file path
+/// @param device   the device holding this file, nullptr for unbounded io
+/// @param mode     Direct for O_DIRECT io, Mapped for page cached reads through mmap
+FileObject::FileObject(std::string& path, Device* device, FileMode mode):
+    FileObject(path, device, mode, false)
+{}
+
+/// @brief open a file whose io requests are queued on device
+/// @param path         the file path
+/// @param device       the device holding this file, nullptr for unbounded io
+/// @param mode         Direct for O_DIRECT io, Mapped for page cached reads through mmap
+/// @param is_read_only open an existing file only for reading, e.g. one appended by another process
+FileObject::FileObject(std::string& path, Device* device, FileMode mode, bool is_read_only):
+    path{path},
+    unsynced_fd{-1},
+    device{device},
+    mode{mode},
+    advice{FileAdvice::Normal},
+    is_read_only{is_read_only},
+    mapping{nullptr},
+    mapping_size{0}
 {
-    this->fd = open(this->path.c_str(), O_CREAT|O_RDWR|O_DIRECT|O_SYNC|O_APPEND, S_IRWXU);
+    int32_t flags = is_read_only ? O_RDONLY : O_CREAT|O_RDWR|O_SYNC|O_APPEND;
+    if (this->mode == FileMode::Direct) { flags |= O_DIRECT; }
+    this->fd = open(this->path.c_str(), flags, S_IRWXU);
     if (this->fd < 0) {
         std::cerr << "open: " << path << std::endl;
         std::cerr << "errno: " << errno << std::endl;
@@ -25,9 +383,15 @@ FileObject::FileObject(std::string& path):
     struct stat st;
     stat(this->path.c_str(), &st);
     this->size = st.st_size;
+    this->Remap();
 }
 
 FileObject::~FileObject() {
+    if (this->unsynced_fd >= 0) { this->Sync(); }
+    this->Unpin();
+    if (this->mapping != nullptr) {
+        munmap(this->mapping, this->mapping_size);
+    }
     int error_code = close(this->fd);
     if (error_code != 0) {
         std::cerr << "close: " << this->path << std::endl;
@@ -37,25 +401,187 @@ FileObject::~FileObject() {
     assert(error_code == 0);
 }
 
+/// @brief a retired mapping, unmapped once the last view pinning it is gone
+struct MappingPin {
+    uint8_t* mapping = nullptr;
+    size_t mapping_size = 0;
+    ~MappingPin() {
+        if (this->mapping != nullptr) { munmap(this->mapping, this->mapping_size); }
+    }
+};
+
+/// @brief keep the current mapping alive while views hold a pin to it
+/// @return the pin, nullptr if the file is not mapped
+std::shared_ptr<void> FileObject::Pin() {
+    if (this->mapping == nullptr) { return nullptr; }
+    if (!this->mapping_pin) { this->mapping_pin = std::make_shared<MappingPin>(); }
+    return this->mapping_pin;
+}
+
+/// @brief check if views pin the current mapping
+bool FileObject::IsPinned() {
+    return this->mapping_pin && this->mapping_pin.use_count() > 1;
+}
+
+/// @brief stop owning the current mapping if views pin it, they unmap it once they are gone
+void FileObject::Unpin() {
+    if (!this->mapping_pin) { return; }
+    if (this->IsPinned()) {
+        this->mapping_pin->mapping = std::exchange(this->mapping, nullptr);
+        this->mapping_pin->mapping_size = std::exchange(this->mapping_size, 0);
+    }
+    this->mapping_pin.reset();
+}
+
+/// @brief extend the read-only mapping to cover the whole file. 
+///        a pinned mapping can't move, the file is mapped anew instead. 
+void FileObject::Remap() {
+    if (this->mode != FileMode::Mapped || this->size == this->mapping_size) { return; }
+    this->Unpin();
+    void* mapping = this->mapping == nullptr
+        ? mmap(nullptr, this->size, PROT_READ, MAP_SHARED, this->fd, 0)
+        : mremap(this->mapping, this->mapping_size, this->size, MREMAP_MAYMOVE);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "mmap: " << this->path << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(mapping != MAP_FAILED);
+    this->mapping = static_cast<uint8_t*>(mapping);
+    this->mapping_size = this->size;
+    this->Advise(this->advice);
+}
+
+/// @brief hint the kernel about how the mapping will be accessed, kept across remapping
+/// @param advice the access pattern
+void FileObject::Advise(FileAdvice advice) {
+    this->advice = advice;
+    if (this->mapping == nullptr) { return; }
+    int32_t flag = MADV_NORMAL;
+    switch (advice) {
+        case FileAdvice::Normal:     flag = MADV_NORMAL;     break;
+        case FileAdvice::Random:     flag = MADV_RANDOM;     break;
+        case FileAdvice::Sequential: flag = MADV_SEQUENTIAL; break;
+        case FileAdvice::WillNeed:   flag = MADV_WILLNEED;   break;
+    }
+    madvise(this->mapping, this->mapping_size, flag);
+}
+
+/// @brief check if file content can be accessed through Map
+bool FileObject::IsMapped() {
+    return this->mapping != nullptr;
+}
+
+/// @brief get file content without copying, only valid until next Append unless the mapping is pinned
+/// @param position the starting position
+/// @param length   the number of bytes
+/// @return a read-only view into the mapping
+std::span<uint8_t> FileObject::Map(size_t position, size_t length) {
+    assert(this->IsMapped());
+    assert(position + length <= this->mapping_size);
+    return std::span{this->mapping + position, length};
+}
+
 size_t FileObject::Size() {
     return this->size;
 }
 
-void FileObject::Append(std::span<uint8_t> bytes) {
-    assert(bytes.size() % 512 == 0);
+/// @brief append bytes at the end of file
+/// @param bytes    the bytes, a multiple of 512 for direct io
+/// @param io_class the io class this write is scheduled as on device
+void FileObject::Append(std::span<uint8_t> bytes, IOClass io_class) {
+    assert(!this->is_read_only);
+    assert(this->mode != FileMode::Direct || bytes.size() % 512 == 0);
     // we used O_APPEND, so no lseek is required
     this->Seek(this->Size());
-    int32_t flag = write(this->fd, &bytes[0], bytes.size());
+    auto bounce = AlignedBuffer<uint8_t>(0);
+    if (this->mode == FileMode::Direct && reinterpret_cast<uintptr_t>(&bytes[0]) % BufferPool::ALIGN != 0) {
+        // direct io needs aligned memory too, staging vectors are copied once
+        bounce = AlignedBuffer<uint8_t>(bytes.size());
+        memcpy(bounce.data(), &bytes[0], bytes.size());
+        bytes = std::span{bounce.data(), bounce.size()};
+    }
+    if (this->device) { this->device->Acquire(io_class, bytes.size()); }
+    int32_t flag = write(this->unsynced_fd >= 0 ? this->unsynced_fd : this->fd, &bytes[0], bytes.size());
+    if (this->device) { this->device->Release(io_class); }
     assert(flag > 0);
     this->size += bytes.size();
+    this->Remap();
+}
+
+/// @brief grow file by bytes an asynchronous append wrote at its end, see AsyncIO::Append
+/// @param nbytes the number of appended bytes
+void FileObject::Appended(size_t nbytes) {
+    this->size += nbytes;
+}
+
+/// @brief let appends skip O_SYNC until Sync, e.g. for a bulk load that syncs once at the end. 
+///        linux can't drop O_SYNC from an open file, so appends go through a second descriptor. 
+void FileObject::Unsync() {
+    if (this->unsynced_fd >= 0) { return; }
+    int32_t flags = O_RDWR|O_APPEND;
+    if (this->mode == FileMode::Direct) { flags |= O_DIRECT; }
+    this->unsynced_fd = open(this->path.c_str(), flags);
+    if (this->unsynced_fd < 0) {
+        std::cerr << "open: " << this->path << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(this->unsynced_fd >= 0);
+}
+
+/// @brief make appends since Unsync durable, later appends are synchronous again
+void FileObject::Sync() {
+    if (this->unsynced_fd < 0) { return; }
+    int error_code = fdatasync(this->unsynced_fd);
+    if (error_code != 0) {
+        std::cerr << "fdatasync: " << this->path << std::endl;
+    }
+    assert(error_code == 0);
+    close(this->unsynced_fd);
+    this->unsynced_fd = -1;
 }
 
-void FileObject::Read(size_t position, std::span<uint8_t> bytes) {
-    assert(bytes.size() % 512 == 0);
-    assert(position % 512 == 0);
-    lseek(this->fd, position, SEEK_SET);
-    int32_t flag = read(this->fd, &bytes[0], bytes.size());
-    this->position = position + bytes.size();
+/// @brief free the disk space of a range that is never read again, the file size and other offsets stay the same
+/// @param position the starting position
+/// @param length   the number of bytes
+void FileObject::Punch(size_t position, size_t length) {
+    assert(position + length <= this->size);
+    int error_code = fallocate(this->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, position, length);
+    if (error_code != 0) {
+        std::cerr << "fallocate: " << this->path << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(error_code == 0);
+}
+
+/// @brief catch up with a file appended by another process, the mapping is extended to cover the new bytes
+/// @param size the file size published by the writer, every byte before it is written in full
+void FileObject::Follow(size_t size) {
+    assert(this->is_read_only);
+    this->size = size;
+    this->Remap();
+}
+
+/// @brief read bytes at position
+/// @param position the position of the first byte
+/// @param bytes    the buffer
+/// @param io_class the io class this read is scheduled as on device
+/// @note doesn't touch the file cursor, so several threads may read at once
+void FileObject::Read(size_t position, std::span<uint8_t> bytes, IOClass io_class) {
+    assert(this->mode != FileMode::Direct || bytes.size() % 512 == 0);
+    assert(this->mode != FileMode::Direct || position % 512 == 0);
+    if (this->IsMapped()) {
+        memcpy(&bytes[0], &this->Map(position, bytes.size())[0], bytes.size());
+        return;
+    }
+    if (this->mode == FileMode::Direct && reinterpret_cast<uintptr_t>(&bytes[0]) % BufferPool::ALIGN != 0) {
+        auto bounce = AlignedBuffer<uint8_t>(bytes.size());
+        this->Read(position, std::span{bounce.data(), bounce.size()}, io_class);
+        memcpy(&bytes[0], bounce.data(), bytes.size());
+        return;
+    }
+    if (this->device) { this->device->Acquire(io_class, bytes.size()); }
+    int32_t flag = pread(this->fd, &bytes[0], bytes.size(), position);
+    if (this->device) { this->device->Release(io_class); }
     assert(flag > 0);
 }
 
@@ -66,23 +592,292 @@ void FileObject::Seek(size_t position) {
 }
 
 bool FileObject::ContinueRead(std::span<uint8_t> bytes) {
-    assert(bytes.size() % 512 == 0);
+    assert(this->mode != FileMode::Direct || bytes.size() % 512 == 0);
     if (this->size - this->position < bytes.size()) { return false; }
-    int32_t flag = read(this->fd, &bytes[0], bytes.size());
+    this->Read(this->position, bytes);
     this->position += bytes.size();
-    assert(flag > 0);
     return true;
 }
 
 bool FileObject::ContinueReadRev(std::span<uint8_t> bytes) {
-    assert(bytes.size() % 512 == 0);
+    assert(this->mode != FileMode::Direct || bytes.size() % 512 == 0);
     if (this->position < bytes.size()) { return false; }
     this->position -= bytes.size();
-    lseek(this->fd, -bytes.size(), SEEK_CUR);
-    int32_t flag = read(this->fd, &bytes[0], bytes.size());
-    lseek(this->fd, -bytes.size(), SEEK_CUR);
-    assert(flag > 0);
+    this->Read(this->position, bytes);
     return true;
 }
 
-#endif
\ No newline at end of file
+// --- SharedRecord --- //
+
+// after the record, each reader acknowledging sequence numbers claims a slot of two words, 
+// the pid of its process (0 for a free slot) and the sequence number it has caught up with
+#define RECORD_READER_SLOTS 64
+
+/// @brief the bytes of the record file: the sequence number, the record and the reader slots
+size_t SharedRecord::Bytes() {
+    return (1 + this->nwords + 2 * RECORD_READER_SLOTS) * sizeof(uint64_t);
+}
+
+/// @brief open a shared record, the writer creates it and readers open it once it exists
+/// @param path         the file path
+/// @param nwords       the number of words in the record
+/// @param is_read_only open as a reader, it still writes its own reader slot
+SharedRecord::SharedRecord(std::string& path, size_t nwords, bool is_read_only):
+    path{path},
+    nwords{nwords},
+    is_read_only{is_read_only},
+    slot{SIZE_MAX}
+{
+    this->fd = open(this->path.c_str(), is_read_only ? O_RDWR : O_CREAT|O_RDWR, S_IRWXU);
+    if (this->fd < 0) {
+        std::cerr << "open: " << path << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(this->fd >= 0);
+    // word 0 is the sequence number, odd while the writer is storing a record
+    size_t bytes = this->Bytes();
+    if (!is_read_only) {
+        int error_code = ftruncate(this->fd, bytes);
+        assert(error_code == 0);
+    }
+    struct stat st;
+    fstat(this->fd, &st);
+    assert(static_cast<size_t>(st.st_size) >= bytes);
+    void* mapping = mmap(nullptr, bytes, PROT_READ|PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "mmap: " << this->path << std::endl;
+        std::cerr << "errno: " << errno << std::endl;
+    }
+    assert(mapping != MAP_FAILED);
+    this->words = static_cast<uint64_t*>(mapping);
+    // a writer that died while storing left an odd sequence number
+    if (!is_read_only && this->Sequence() % 2 == 1) {
+        std::atomic_ref<uint64_t>(this->words[0]).fetch_add(1, std::memory_order_release);
+    }
+}
+
+SharedRecord::~SharedRecord() {
+    if (this->slot != SIZE_MAX) {
+        std::atomic_ref<uint64_t>(this->words[1 + this->nwords + 2 * this->slot]).store(0, std::memory_order_release);
+    }
+    munmap(this->words, this->Bytes());
+    close(this->fd);
+}
+
+/// @brief publish a record, readers see either the old or the new one as a whole
+/// @param record the words of record, nwords of them
+/// @return the sequence number of the stored record
+uint64_t SharedRecord::Store(std::span<uint64_t> record) {
+    assert(!this->is_read_only);
+    assert(record.size() == this->nwords);
+    auto sequence = std::atomic_ref<uint64_t>(this->words[0]);
+    auto current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < this->nwords; ++i) {
+        std::atomic_ref<uint64_t>(this->words[i + 1]).store(record[i], std::memory_order_relaxed);
+    }
+    sequence.store(current + 2, std::memory_order_release);
+    return current + 2;
+}
+
+/// @brief copy the latest record, retrying while the writer is storing a new one
+/// @param record the words of record, nwords of them
+/// @return the sequence number of the copied record
+uint64_t SharedRecord::Load(std::span<uint64_t> record) {
+    assert(record.size() == this->nwords);
+    auto sequence = std::atomic_ref<uint64_t>(this->words[0]);
+    while (true) {
+        auto before = sequence.load(std::memory_order_acquire);
+        if (before % 2 == 1) { std::this_thread::yield(); continue; }
+        for (size_t i = 0; i < this->nwords; ++i) {
+            record[i] = std::atomic_ref<uint64_t>(this->words[i + 1]).load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) { return before; }
+    }
+}
+
+/// @brief the sequence number of the latest record, it changes on every Store
+uint64_t SharedRecord::Sequence() {
+    return std::atomic_ref<uint64_t>(this->words[0]).load(std::memory_order_acquire);
+}
+
+/// @brief tell the writer this reader is done with every record older than sequence. 
+///        the first call claims a reader slot, it is given up when the reader is destroyed. 
+/// @param sequence the sequence number of the record the reader has caught up with
+void SharedRecord::Acknowledge(uint64_t sequence) {
+    assert(this->is_read_only);
+    auto slots = this->words + 1 + this->nwords;
+    if (this->slot == SIZE_MAX) {
+        uint64_t pid = getpid();
+        // until the sequence number below is stored, the writer may see the one of the slot's previous reader. 
+        // it is older than any record this reader loaded, so the writer only keeps more than it has to
+        for (size_t i = 0; i < RECORD_READER_SLOTS && this->slot == SIZE_MAX; ++i) {
+            uint64_t expected = 0;
+            if (std::atomic_ref<uint64_t>(slots[2 * i]).compare_exchange_strong(expected, pid, std::memory_order_acq_rel)) { this->slot = i; }
+        }
+        if (this->slot == SIZE_MAX) {
+            std::cerr << "no free reader slot: " << this->path << std::endl;
+        }
+        assert(this->slot != SIZE_MAX);
+    }
+    std::atomic_ref<uint64_t>(slots[2 * this->slot + 1]).store(sequence, std::memory_order_release);
+}
+
+/// @brief the oldest sequence number a reader may still be using, UINT64_MAX if no reader acknowledges any. 
+///        slots of readers whose process is gone are given up here. 
+uint64_t SharedRecord::Acknowledged() {
+    assert(!this->is_read_only);
+    auto slots = this->words + 1 + this->nwords;
+    uint64_t acknowledged = UINT64_MAX;
+    for (size_t i = 0; i < RECORD_READER_SLOTS; ++i) {
+        auto pid = std::atomic_ref<uint64_t>(slots[2 * i]).load(std::memory_order_acquire);
+        if (pid == 0) { continue; }
+        if (kill(pid_t(pid), 0) != 0 && errno == ESRCH) {
+            std::atomic_ref<uint64_t>(slots[2 * i]).compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+            continue;
+        }
+        acknowledged = std::min(acknowledged, std::atomic_ref<uint64_t>(slots[2 * i + 1]).load(std::memory_order_acquire));
+    }
+    return acknowledged;
+}
+
+// --- AsyncIO --- //
+
+// glibc has no wrappers for kernel aio
+static int io_setup(unsigned nr, aio_context_t* ctx) { return syscall(SYS_io_setup, nr, ctx); }
+static int io_destroy(aio_context_t ctx) { return syscall(SYS_io_destroy, ctx); }
+static int io_submit(aio_context_t ctx, long nr, struct iocb** iocbpp) { return syscall(SYS_io_submit, ctx, nr, iocbpp); }
+static int io_getevents(aio_context_t ctx, long min_nr, long nr, struct io_event* events) {
+    return syscall(SYS_io_getevents, ctx, min_nr, nr, events, nullptr);
+}
+
+/// @brief a submitted read or append, the device slot is returned when it is reaped
+struct AsyncRequest {
+    void* tag;
+    Device* device;
+    IOClass io_class;
+};
+
+/// @brief initialize an aio context
+/// @param depth the maximal number of in-flight reads and appends
+AsyncIO::AsyncIO(size_t depth):
+    context{0},
+    depth{depth},
+    inflight{0}
+{
+    aio_context_t context = 0;
+    int error_code = io_setup(depth, &context);
+    if (error_code != 0) {
+        std::cerr << "io_setup: " << errno << std::endl;
+    }
+    assert(error_code == 0);
+    this->context = context;
+}
+
+AsyncIO::~AsyncIO() {
+    auto tags = std::vector<void*>();
+    while (this->inflight != 0) { this->Reap(tags, true); }
+    io_destroy(this->context);
+}
+
+/// @brief start reading bytes at position of file, a mapped file is read right away
+/// @param file     the file to read from
+/// @param position the position of the first byte
+/// @param bytes    the buffer, must stay alive until the read is reaped
+/// @param tag      handed back by Reap once bytes are filled
+/// @return false if the context or device queue is full, try again after reaping
+bool AsyncIO::Submit(FileObject& file, size_t position, std::span<uint8_t> bytes, void* tag) {
+    if (file.IsMapped()) {
+        file.Read(position, bytes);
+        this->completed.push_back(tag);
+        return true;
+    }
+    assert(file.mode != FileMode::Direct || bytes.size() % 512 == 0);
+    assert(file.mode != FileMode::Direct || position % 512 == 0);
+    assert(file.mode != FileMode::Direct || reinterpret_cast<uintptr_t>(&bytes[0]) % BufferPool::ALIGN == 0);
+    if (this->inflight == this->depth) { return false; }
+    if (file.device && !file.device->TryAcquire(IOClass::Foreground, bytes.size())) { return false; }
+    auto request = new AsyncRequest{tag, file.device, IOClass::Foreground};
+    struct iocb cb;
+    memset(&cb, 0, sizeof(cb));
+    cb.aio_data = reinterpret_cast<uint64_t>(request);
+    cb.aio_lio_opcode = IOCB_CMD_PREAD;
+    cb.aio_fildes = file.fd;
+    cb.aio_buf = reinterpret_cast<uint64_t>(&bytes[0]);
+    cb.aio_nbytes = bytes.size();
+    cb.aio_offset = position;
+    struct iocb* cbs[1] = {&cb};
+    int flag = io_submit(this->context, 1, cbs);
+    if (flag != 1) {
+        std::cerr << "io_submit: " << errno << std::endl;
+    }
+    assert(flag == 1);
+    this->inflight += 1;
+    return true;
+}
+
+/// @brief start appending bytes at the end of file, mapped files are appended in place by FileObject::Append. 
+///        the file keeps its size until the caller calls Appended, so only one append per file may be in flight. 
+/// @param file     the file to append to
+/// @param bytes    the bytes, must stay alive until the append is reaped
+/// @param tag      handed back by Reap once bytes are written
+/// @return false if the context or device queue is full, try again after reaping
+bool AsyncIO::Append(FileObject& file, std::span<uint8_t> bytes, void* tag) {
+    assert(!file.IsMapped());
+    assert(!file.is_read_only);
+    assert(file.mode != FileMode::Direct || bytes.size() % 512 == 0);
+    assert(file.mode != FileMode::Direct || reinterpret_cast<uintptr_t>(&bytes[0]) % BufferPool::ALIGN == 0);
+    if (this->inflight == this->depth) { return false; }
+    if (file.device && !file.device->TryAcquire(IOClass::Flush, bytes.size())) { return false; }
+    auto request = new AsyncRequest{tag, file.device, IOClass::Flush};
+    struct iocb cb;
+    memset(&cb, 0, sizeof(cb));
+    cb.aio_data = reinterpret_cast<uint64_t>(request);
+    cb.aio_lio_opcode = IOCB_CMD_PWRITE;
+    // O_APPEND writes at the end of file whatever the offset
+    cb.aio_fildes = file.unsynced_fd >= 0 ? file.unsynced_fd : file.fd;
+    cb.aio_buf = reinterpret_cast<uint64_t>(&bytes[0]);
+    cb.aio_nbytes = bytes.size();
+    cb.aio_offset = file.size;
+    struct iocb* cbs[1] = {&cb};
+    int flag = io_submit(this->context, 1, cbs);
+    if (flag != 1) {
+        std::cerr << "io_submit: " << errno << std::endl;
+    }
+    assert(flag == 1);
+    this->inflight += 1;
+    return true;
+}
+
+/// @brief collect tags of completed reads and appends
+/// @param tags the tags, appended to
+/// @param wait block until at least one read completes, if none has yet
+void AsyncIO::Reap(std::vector<void*>& tags, bool wait) {
+    if (!this->completed.empty()) {
+        tags.insert(tags.end(), this->completed.begin(), this->completed.end());
+        this->completed.clear();
+        wait = false;
+    }
+    if (this->inflight == 0) { return; }
+    struct io_event events[64];
+    int n = io_getevents(this->context, wait ? 1 : 0, 64, events);
+    while (n < 0 && errno == EINTR) { n = io_getevents(this->context, wait ? 1 : 0, 64, events); }
+    assert(n >= 0);
+    for (int i = 0; i < n; ++i) {
+        auto request = reinterpret_cast<AsyncRequest*>(events[i].data);
+        assert(events[i].res > 0);
+        if (request->device) { request->device->Release(request->io_class); }
+        tags.push_back(request->tag);
+        delete request;
+    }
+    this->inflight -= n;
+}
+
+/// @brief the number of reads and appends submitted to kernel and not reaped yet
+size_t AsyncIO::Inflight() {
+    return this->inflight;
+}
+
+#endif
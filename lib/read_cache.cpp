@@ -0,0 +1,209 @@
+#include<read_cache.hpp>
+#include<hashing.hpp>
+#include<port.hpp>
+#include<algorithm>
+#include<bit>
+#include<cassert>
+#include<cstring>
+
+namespace bloomstore {
+
+// the count-min sketch has 4 rows of 4-bit saturating counters
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 15
+// besides key and value, an entry takes a map node and a list node
+#define ENTRY_OVERHEAD 96
+
+/// @brief initialize an empty cache
+/// @param budget   the maximal number of bytes taken by entries
+/// @param nshards  the number of independently locked shards
+/// @param negative cache absent (and deleted) keys too
+ReadCache::ReadCache(size_t budget, size_t nshards, bool negative):
+    shards{new Shard[nshards]},
+    nshards{nshards},
+    shard_budget{budget / nshards},
+    sketch_width{std::bit_ceil(std::max<size_t>(64, budget / nshards / ENTRY_OVERHEAD))},
+    negative{negative}
+{
+    for (size_t i = 0; i < nshards; ++i) {
+        this->shards[i].sketch.assign(SKETCH_ROWS * this->sketch_width, 0);
+    }
+}
+
+/// @brief find the shard of a key
+/// @param key  the key
+/// @param hash set to the key hash
+/// @return the shard, not locked yet
+ReadCache::Shard& ReadCache::Locate(std::span<uint8_t> key, uint32_t& hash) {
+    hash = Hash(key, static_cast<uint32_t>('C'));
+    return this->shards[hash % this->nshards];
+}
+
+/// @brief count one read of a key in the frequency sketch, halving all counters once in a while so old popularity fades
+void ReadCache::Record(Shard& shard, uint32_t hash) {
+    uint32_t step = (hash >> 16) | 1;
+    for (size_t row = 0; row < SKETCH_ROWS; ++row) {
+        auto& counter = shard.sketch[row * this->sketch_width + ((hash + row * step) & (this->sketch_width - 1))];
+        if (counter < SKETCH_MAX) { counter += 1; }
+    }
+    shard.samples += 1;
+    if (shard.samples < 10 * this->sketch_width) { return; }
+    shard.samples = 0;
+    for (auto& counter: shard.sketch) { counter >>= 1; }
+}
+
+/// @brief estimate how often a key was read recently
+uint8_t ReadCache::Frequency(Shard& shard, uint32_t hash) {
+    uint32_t step = (hash >> 16) | 1;
+    uint8_t frequency = SKETCH_MAX;
+    for (size_t row = 0; row < SKETCH_ROWS; ++row) {
+        frequency = std::min(frequency, shard.sketch[row * this->sketch_width + ((hash + row * step) & (this->sketch_width - 1))]);
+    }
+    return frequency;
+}
+
+/// @brief view key bytes as a map key, without copying
+std::string_view ReadCache::View(std::span<uint8_t> key) {
+    return std::string_view(reinterpret_cast<const char*>(key.data()), key.size());
+}
+
+/// @brief drop an entry from its shard, the shard must be locked
+void ReadCache::Evict(Shard& shard, EntryMap::iterator it) {
+    shard.bytes -= it->first.size() + it->second.value.size() + ENTRY_OVERHEAD;
+    shard.recency.erase(it->second.position);
+    shard.entries.erase(it);
+}
+
+/// @brief evict least recent entries until bytes more fit the shard budget, as long as they are read less often. 
+///        the shard must be locked. 
+/// @param bytes        the bytes to make room for
+/// @param frequency    the read frequency of the entry that needs the room
+/// @param keep         an entry never evicted for room, e.g. the one growing, or entries.end()
+/// @return true iff the bytes fit now
+bool ReadCache::Reserve(Shard& shard, size_t bytes, uint8_t frequency, EntryMap::iterator keep) {
+    while (shard.bytes + bytes > this->shard_budget) {
+        auto victim = shard.entries.find(shard.recency.back());
+        if (victim == keep) {
+            if (shard.recency.size() == 1) { return false; }
+            // the kept entry is least recent, try the one before it
+            victim = shard.entries.find(*std::prev(shard.recency.end(), 2));
+        }
+        if (frequency <= this->Frequency(shard, victim->second.hash)) { return false; }
+        this->Evict(shard, victim);
+    }
+    return true;
+}
+
+/// @brief look a key up, counting the read for admission either way
+/// @param key      the inquired key
+/// @param value    filled with the cached value on a hit
+/// @param is_found false if the key is cached as absent
+/// @return true iff the key is cached
+bool ReadCache::Get(std::span<uint8_t> key, std::span<uint8_t> value, bool& is_found) {
+    uint32_t hash = 0;
+    auto& shard = this->Locate(key, hash);
+    auto lock = std::lock_guard(shard.mutex);
+    this->Record(shard, hash);
+    auto it = shard.entries.find(View(key));
+    if (it != shard.entries.end() && it->second.deadline != UINT64_MAX && it->second.deadline <= Now()) {
+        this->Evict(shard, it);
+        it = shard.entries.end();
+    }
+    if (it == shard.entries.end()) {
+        this->stat_miss += 1;
+        return false;
+    }
+    this->stat_hit += 1;
+    shard.recency.splice(shard.recency.begin(), shard.recency, it->second.position);
+    is_found = it->second.is_present;
+    if (is_found) {
+        assert(value.size() == it->second.value.size());
+        memcpy(&value[0], it->second.value.data(), value.size());
+    }
+    return true;
+}
+
+/// @brief offer the result of a lookup that missed the cache. 
+///        when the shard is full, it replaces the least recent entries only if it is read more often than them. 
+/// @param key      the inquired key
+/// @param value    the value read from store
+/// @param is_found false if the key is absent or deleted
+/// @param deadline the time the value may expire, UINT64_MAX if never
+void ReadCache::Admit(std::span<uint8_t> key, std::span<uint8_t> value, bool is_found, uint64_t deadline) {
+    if (!is_found && !this->negative) { return; }
+    uint32_t hash = 0;
+    auto& shard = this->Locate(key, hash);
+    auto lock = std::lock_guard(shard.mutex);
+    auto it = shard.entries.find(View(key));
+    if (it != shard.entries.end()) { this->Evict(shard, it); }
+    size_t bytes = key.size() + (is_found ? value.size() : 0) + ENTRY_OVERHEAD;
+    if (bytes > this->shard_budget) { return; }
+    if (!this->Reserve(shard, bytes, this->Frequency(shard, hash), shard.entries.end())) { return; }
+    auto value_bytes = is_found ? std::string(value.begin(), value.end()) : std::string();
+    auto entry = Entry{std::move(value_bytes), hash, is_found, deadline, {}};
+    it = shard.entries.emplace(std::string(View(key)), std::move(entry)).first;
+    shard.recency.push_front(it->first);
+    it->second.position = shard.recency.begin();
+    shard.bytes += bytes;
+}
+
+/// @brief write a new value through to a cached key, uncached keys are left alone. 
+///        a key cached as absent grows by its value, which evicts least recent entries as Admit does, 
+///        or drops the key if they are read more often. 
+/// @param key      the written key
+/// @param value    the new value
+/// @param deadline the time the new value may expire, UINT64_MAX if never
+void ReadCache::Update(std::span<uint8_t> key, std::span<uint8_t> value, uint64_t deadline) {
+    uint32_t hash = 0;
+    auto& shard = this->Locate(key, hash);
+    auto lock = std::lock_guard(shard.mutex);
+    auto it = shard.entries.find(View(key));
+    if (it == shard.entries.end()) { return; }
+    if (value.size() > it->second.value.size()) {
+        size_t growth = value.size() - it->second.value.size();
+        if (!this->Reserve(shard, growth, this->Frequency(shard, hash), it)) {
+            this->Evict(shard, it);
+            return;
+        }
+    }
+    shard.bytes -= it->second.value.size();
+    it->second.value.assign(value.begin(), value.end());
+    it->second.is_present = true;
+    it->second.deadline = deadline;
+    shard.bytes += it->second.value.size();
+}
+
+/// @brief drop a key, e.g. when it is deleted
+/// @param key the key
+void ReadCache::Invalidate(std::span<uint8_t> key) {
+    uint32_t hash = 0;
+    auto& shard = this->Locate(key, hash);
+    auto lock = std::lock_guard(shard.mutex);
+    auto it = shard.entries.find(View(key));
+    if (it == shard.entries.end()) { return; }
+    this->Evict(shard, it);
+}
+
+/// @brief drop every entry, e.g. when the store behind it is replaced. 
+///        read frequencies are kept, so hot keys are admitted again right away. 
+void ReadCache::Clear() {
+    for (size_t i = 0; i < this->nshards; ++i) {
+        auto& shard = this->shards[i];
+        auto lock = std::lock_guard(shard.mutex);
+        shard.entries.clear();
+        shard.recency.clear();
+        shard.bytes = 0;
+    }
+}
+
+/// @brief the number of bytes taken by all entries
+size_t ReadCache::Bytes() {
+    size_t bytes = 0;
+    for (size_t i = 0; i < this->nshards; ++i) {
+        auto lock = std::lock_guard(this->shards[i].mutex);
+        bytes += this->shards[i].bytes;
+    }
+    return bytes;
+}
+
+} // namespace bloomstore
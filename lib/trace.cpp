@@ -0,0 +1,148 @@
+#include<trace.hpp>
+#include<hashing.hpp>
+#include<cassert>
+#include<cstring>
+#include<iostream>
+
+namespace bloomstore {
+
+// a trace starts with magic, version, key bytes, value bytes and whether keys are recorded
+static constexpr char TRACE_MAGIC[4] = {'B', 'S', 'T', 'R'};
+// version 2 adds merge operations, version 1 traces are still read
+static constexpr uint8_t TRACE_VERSION = 2;
+// the recorder writes through a buffer this large
+#define TRACE_BUFFER_BYTES (1 << 20)
+
+/// @brief start a trace file, truncating it
+/// @param path         the trace file
+/// @param key_bytes    the key size
+/// @param value_bytes  the value size, values themselves are not recorded
+/// @param record_keys  record whole keys, or only their hashes when keys are sensitive or large
+TraceRecorder::TraceRecorder(std::string& path, size_t key_bytes, size_t value_bytes, bool record_keys):
+    buffer(TRACE_BUFFER_BYTES),
+    start{std::chrono::steady_clock::now()},
+    last{0},
+    key_bytes{key_bytes},
+    record_keys{record_keys}
+{
+    // a stand-in key is solved from its hash over one whole word, see TraceReader::Next
+    if (!record_keys && key_bytes < sizeof(uint32_t)) {
+        std::cerr << "trace: keys shorter than a hash are recorded whole" << std::endl;
+    }
+    assert(record_keys || key_bytes >= sizeof(uint32_t));
+    this->out.open(path, std::ios::binary | std::ios::trunc);
+    if (!this->out) {
+        std::cerr << "open: " << path << std::endl;
+    }
+    assert(this->out.good());
+    // a buffer only takes effect reliably on an open file before any io
+    this->out.rdbuf()->pubsetbuf(this->buffer.data(), this->buffer.size());
+    uint32_t header[3] = {uint32_t(key_bytes), uint32_t(value_bytes), uint32_t(record_keys)};
+    this->out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    this->out.put(TRACE_VERSION);
+    this->out.write(reinterpret_cast<char*>(header), sizeof(header));
+}
+
+TraceRecorder::~TraceRecorder() {
+    this->Flush();
+}
+
+/// @brief append one operation
+/// @param op   the operation
+/// @param key  the key it touches
+void TraceRecorder::Record(TraceOp op, std::span<uint8_t> key) {
+    assert(key.size() == this->key_bytes);
+    auto now = std::chrono::steady_clock::now();
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(now - this->start).count();
+    auto lock = std::lock_guard(this->mutex);
+    // threads may race between reading clock and taking lock
+    uint64_t delta = timestamp > this->last ? timestamp - this->last : 0;
+    this->last += delta;
+    char record[1 + 10];
+    size_t n = 0;
+    record[n++] = static_cast<char>(op);
+    do {
+        record[n++] = static_cast<char>((delta & 0x7f) | (delta >= 0x80 ? 0x80 : 0));
+        delta >>= 7;
+    } while (delta != 0);
+    this->out.write(record, n);
+    if (this->record_keys) {
+        this->out.write(reinterpret_cast<char*>(&key[0]), key.size());
+    }
+    else {
+        uint32_t hash = Hash(key, static_cast<uint32_t>('Z'));
+        this->out.write(reinterpret_cast<char*>(&hash), sizeof(hash));
+    }
+}
+
+/// @brief push buffered records to file
+void TraceRecorder::Flush() {
+    auto lock = std::lock_guard(this->mutex);
+    this->out.flush();
+}
+
+/// @brief open a trace file
+/// @param path the trace file
+TraceReader::TraceReader(std::string& path):
+    in(path, std::ios::binary),
+    timestamp{0}
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    uint32_t header[3] = {0, 0, 0};
+    this->in.read(magic, sizeof(magic));
+    auto version = this->in.get();
+    this->in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!this->in || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 || version < 1 || version > TRACE_VERSION) {
+        std::cerr << "not a trace: " << path << std::endl;
+    }
+    assert(this->in.good());
+    this->key_bytes = header[0];
+    this->value_bytes = header[1];
+    this->record_keys = header[2] != 0;
+}
+
+/// @brief read next operation
+/// @param entry the operation, with its timestamp in nanoseconds since the trace started
+/// @return false at the end of trace
+bool TraceReader::Next(TraceEntry& entry) {
+    int op = this->in.get();
+    if (op == EOF) { return false; }
+    entry.op = static_cast<TraceOp>(op);
+    uint64_t delta = 0;
+    for (int shift = 0; ; shift += 7) {
+        int byte = this->in.get();
+        if (byte == EOF) { return false; }
+        delta |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) { break; }
+    }
+    this->timestamp += delta;
+    entry.timestamp = this->timestamp;
+    entry.key.resize(this->key_bytes);
+    if (this->record_keys) {
+        this->in.read(reinterpret_cast<char*>(entry.key.data()), this->key_bytes);
+        return bool(this->in);
+    }
+    uint32_t hash = 0;
+    this->in.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    // spread the hash over the key, equal hashes give equal keys. 
+    // then one word is solved so the stand-in hashes like the recorded key, and routes to the same partition
+    uint32_t state = hash;
+    for (size_t i = 0; i < this->key_bytes; ++i) {
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        entry.key[i] = static_cast<uint8_t>(state);
+    }
+    Preimage(std::span{entry.key}, 'Z', hash);
+    return bool(this->in);
+}
+
+/// @brief the key size of traced operations
+size_t TraceReader::KeyBytes() {
+    return this->key_bytes;
+}
+
+/// @brief the value size of traced operations
+size_t TraceReader::ValueBytes() {
+    return this->value_bytes;
+}
+
+} // namespace bloomstore
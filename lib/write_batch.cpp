@@ -0,0 +1,82 @@
+#include<write_batch.hpp>
+#include<hashing.hpp>
+#include<cassert>
+#include<cstring>
+
+namespace bloomstore {
+
+/// @brief initialize an empty write batch
+/// @param key_bytes    the key size
+/// @param value_bytes  the value size
+/// @param atomic       if true, the entries of each partition are sealed into one block together, 
+///                     so a partition may get at most a block of them (see Partitioner::Write)
+WriteBatch::WriteBatch(size_t key_bytes, size_t value_bytes, bool atomic):
+    key_bytes{key_bytes},
+    value_bytes{value_bytes},
+    atomic{atomic}
+{}
+
+/// @brief put a key in batch
+/// @param key      the inserted key
+/// @param value    the inserted value
+void WriteBatch::Put(std::span<uint8_t> key, std::span<uint8_t> value) {
+    assert(value.size() == this->value_bytes);
+    this->Add(key, value, false);
+}
+
+/// @brief delete a key in batch
+/// @param key the deleted key
+void WriteBatch::Del(std::span<uint8_t> key) {
+    this->Add(key, {}, true);
+}
+
+/// @brief copy key and value into batch, routing and filter hashes are computed later for all added entries at once
+void WriteBatch::Add(std::span<uint8_t> key, std::span<uint8_t> value, bool is_tombstone) {
+    assert(key.size() == this->key_bytes);
+    auto offset = this->bytes.size();
+    this->bytes.resize(offset + this->key_bytes + this->value_bytes, 0);
+    memcpy(&this->bytes[offset], &key[0], this->key_bytes);
+    if (!is_tombstone) {
+        memcpy(&this->bytes[offset + this->key_bytes], &value[0], this->value_bytes);
+    }
+    this->entries.push_back(Entry{
+        0,
+        0,
+        0,
+        0,
+        offset,
+        is_tombstone
+    });
+}
+
+/// @brief compute routing and filter hashes of entries added since last time, with batch hashing. 
+///        they were appended in order, so their keys are evenly strided in bytes. 
+void WriteBatch::HashEntries() {
+    auto n = this->entries.size() - this->nhashed;
+    if (n == 0) { return; }
+    auto stride = this->key_bytes + this->value_bytes;
+    auto keys = std::span{this->bytes}.subspan(this->entries[this->nhashed].offset);
+    auto hashes = std::vector<uint32_t>(n);
+    auto hash_into = [&](uint32_t seed, uint32_t Entry::* field) {
+        HashBatch(keys, this->key_bytes, stride, seed, std::span{hashes});
+        for (size_t i = 0; i < n; ++i) { this->entries[this->nhashed + i].*field = hashes[i]; }
+    };
+    hash_into(static_cast<uint32_t>('Z'), &Entry::hash);
+    hash_into(static_cast<uint32_t>('A'), &Entry::hash_a);
+    hash_into(static_cast<uint32_t>('B'), &Entry::hash_b);
+    this->nhashed = this->entries.size();
+}
+
+/// @brief the number of entries in batch
+size_t WriteBatch::Size() {
+    return this->entries.size();
+}
+
+/// @brief remove all entries, so the batch can be reused
+void WriteBatch::Clear() {
+    this->bytes.clear();
+    this->entries.clear();
+    this->nhashed = 0;
+}
+
+} // namespace bloomstore
@@ -164,6 +164,84 @@ TEST(BloomChain, DumpLoadConsistency) {
     }
 }
 
+/// @brief verify a chain filled column by column in place answers like joined bloom filters
+TEST(BloomChain, InsertSealConsistency) {
+    auto random_number_generator = xorshift::XorShift32(5);
+    uint32_t k = 5, n = 200, m = 1000;
+    auto joined_chain = bloomstore::BloomChain(m, k, 1024);
+    auto sealed_chain = bloomstore::BloomChain(m, k, 1024);
+    for (int i = 0; i < 64; ++i) {
+        auto bloom_filter = bloomstore::BloomFilter(m, k);
+        for (size_t j = 0; j < n; ++j) {
+            auto key = to_arr(random_number_generator.Sample());
+            bloom_filter.Insert(std::span{key});
+            sealed_chain.Insert(std::span{key});
+            ASSERT_TRUE(sealed_chain.TestActive(std::span{key}));
+        }
+        joined_chain.Join(bloom_filter, i);
+        sealed_chain.Seal(i);
+        ASSERT_EQ(joined_chain.IsFull(), sealed_chain.IsFull());
+    }
+    for (int i = 0; i < 20000; ++i) {
+        auto key = to_arr(random_number_generator.Sample());
+        auto joined_iter = joined_chain.Test(std::span{key});
+        auto sealed_iter = sealed_chain.Test(std::span{key});
+        bool joined_depleted = false, sealed_depleted = false;
+        while (!joined_depleted) {
+            size_t joined_address = 0x7777, sealed_address = 0x7777;
+            joined_iter.Next(joined_address, joined_depleted);
+            sealed_iter.Next(sealed_address, sealed_depleted);
+            ASSERT_EQ(joined_depleted, sealed_depleted);
+            ASSERT_EQ(joined_address, sealed_address);
+        }
+    }
+}
+
+/// @brief check a chain of width W joined from W bloom filters against the filters themselves
+template<size_t W>
+void CheckWideJoinConsistency() {
+    auto random_number_generator = xorshift::XorShift32(5);
+    uint32_t k = 5, n = 50, m = 500;
+    auto bloom_chain = bloomstore::BasicBloomChain<W>(m, k, 1024);
+    auto bloom_vector = std::vector<bloomstore::BloomFilter>();
+    for (size_t i = 0; i < W; ++i) {
+        auto bloom_filter = bloomstore::BloomFilter(m, k);
+        for (size_t j = 0; j < n; ++j) {
+            auto key = to_arr(random_number_generator.Sample());
+            bloom_filter.Insert(std::span{key});
+        }
+        bloom_vector.push_back(bloom_filter);
+        ASSERT_FALSE(bloom_chain.IsFull());
+        bloom_chain.Join(bloom_filter, i);
+    }
+    ASSERT_TRUE(bloom_chain.IsFull());
+    for (int i = 0; i < 5000; ++i) {
+        auto key = to_arr(random_number_generator.Sample());
+        auto test_vector_positive = std::vector<int>();
+        for (int j = W - 1; j >= 0; --j) {
+            if (bloom_vector[j].Test(std::span{key})) {
+                test_vector_positive.push_back(j);
+            }
+        }
+        auto test_chain_positive = std::vector<int>();
+        auto chain_iter = bloom_chain.Test(std::span{key});
+        bool depleted = false;
+        while (!depleted) {
+            size_t address = 0x7777;
+            chain_iter.Next(address, depleted);
+            if (!depleted) { test_chain_positive.push_back(address); }
+        }
+        ASSERT_EQ(test_vector_positive, test_chain_positive);
+    }
+}
+
+/// @brief verify wider chains behave the same as seperate bloom filters on join
+TEST(BloomChain, WideJoinConsistency) {
+    CheckWideJoinConsistency<128>();
+    CheckWideJoinConsistency<256>();
+    CheckWideJoinConsistency<512>();
+}
+
 #undef ARR
 
 }
\ No newline at end of file
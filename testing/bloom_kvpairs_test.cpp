@@ -1,5 +1,6 @@
 #include<gtest/gtest.h>
 #include<bloom_kvpairs.hpp>
+#include<merge_operator.hpp>
 #include<port.hpp>
 #include<unordered_map>
 #include<array>
@@ -73,6 +74,167 @@ TEST(KVPairs, ReadWriteTest) {
     }
 }
 
+TEST(KVPairs, IndexedReadWriteTest) {
+    auto indexed = bloomstore::KVPairs(K, V, 4096, 1024, true);
+    auto scanned = bloomstore::KVPairs(K, V, 4096, 1024);
+    auto random_number_generator = xorshift::XorShift32(7);
+    for (int i = 0; i < 4096; ++i) {
+        auto action = random_number_generator.Sample() % 3;
+        auto key    = to_arr(random_number_generator.Sample() % 256);
+        auto value  = to_arr(random_number_generator.Sample());
+        switch (action) {
+            case 0: {
+                indexed.Put(std::span{key}, std::span{value});
+                scanned.Put(std::span{key}, std::span{value});
+                break;
+            }
+            case 1: {
+                indexed.Del(std::span{key});
+                scanned.Del(std::span{key});
+                break;
+            }
+            case 2: {
+                auto value = ARR();
+                auto expected_value = ARR();
+                bool is_tombstone = false, expected_is_tombstone = false;
+                bool is_found = false, expected_is_found = false;
+                indexed.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+                scanned.Get(std::span{key}, std::span{expected_value}, expected_is_tombstone, expected_is_found);
+                ASSERT_EQ(expected_is_found, is_found);
+                ASSERT_EQ(expected_is_tombstone, is_tombstone);
+                if (is_found && !is_tombstone) { ASSERT_EQ(expected_value, value); }
+                break;
+            }
+        }
+    }
+    // the index is rebuilt when a dumped kvpairs is loaded back
+    auto space = std::vector<uint8_t>();
+    indexed.Dump([&](std::span<uint8_t> s) { space.assign(s.begin(), s.end()); });
+    indexed.Load([&](std::span<uint8_t> s) { memcpy(&s[0], &space[0], s.size()); });
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        auto value = ARR(), expected_value = ARR();
+        bool is_tombstone = false, expected_is_tombstone = false;
+        bool is_found = false, expected_is_found = false;
+        indexed.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        scanned.Get(std::span{key}, std::span{expected_value}, expected_is_tombstone, expected_is_found);
+        ASSERT_EQ(expected_is_found, is_found);
+        ASSERT_EQ(expected_is_tombstone, is_tombstone);
+        if (is_found && !is_tombstone) { ASSERT_EQ(expected_value, value); }
+    }
+}
+
+TEST(KVPairs, CoalesceTest) {
+    auto kvpairs = bloomstore::KVPairs(K, V, 16, 1024, true);
+    auto random_number_generator = xorshift::XorShift32(9);
+    for (int i = 0; i < 4096; ++i) {
+        auto key   = to_arr(random_number_generator.Sample() % 8);
+        auto value = to_arr(i);
+        if (i % 5 == 0) { kvpairs.Del(std::span{key}); }
+        else { kvpairs.Put(std::span{key}, std::span{value}); }
+        auto got = ARR();
+        bool is_tombstone = false;
+        bool is_found = false;
+        kvpairs.Get(std::span{key}, std::span{got}, is_tombstone, is_found);
+        ASSERT_TRUE(is_found);
+        ASSERT_EQ(i % 5 == 0, is_tombstone);
+        if (!is_tombstone) { ASSERT_EQ(value, got); }
+    }
+    // one entry per distinct key, however many times it was written
+    ASSERT_EQ(8 * (K + V), kvpairs.UsedBytes());
+    ASSERT_FALSE(kvpairs.IsFull());
+}
+
+/// @brief verify a block takes header, tombstones, tags, keys, values and operand bits, padded to align and no more
+TEST(KVPairs, ExactByteSize) {
+    ASSERT_EQ(8 + 2 * (4096 / 8) + 4096 * (1 + K + V), bloomstore::KVPairs(K, V, 4096, 1).ByteSize());
+    ASSERT_EQ(40960, bloomstore::KVPairs(K, V, 4096, 4096).ByteSize());
+    ASSERT_EQ(512, bloomstore::KVPairs(20, 44, 7, 512).ByteSize());
+}
+
+/// @brief verify a block written before merge operands, without the operand flag, loads when its padding is wide enough
+TEST(KVPairs, UnflaggedBlock) {
+    auto kvpairs = bloomstore::KVPairs(K, V, 16, 1024);
+    for (uint32_t k = 0; k < 16; ++k) {
+        auto key = to_arr(k);
+        auto value = to_arr(k * 3);
+        if (k % 4 == 0) { kvpairs.Del(std::span{key}); }
+        else { kvpairs.Put(std::span{key}, std::span{value}); }
+    }
+    auto space = std::vector<uint8_t>();
+    kvpairs.Dump([&](std::span<uint8_t> bytes) { space.assign(bytes.begin(), bytes.end()); });
+    // the old header is the bare entry count
+    space[7] &= 0x7f;
+    kvpairs.Load([&](std::span<uint8_t> bytes) { memcpy(&bytes[0], &space[0], bytes.size()); });
+    for (uint32_t k = 0; k < 16; ++k) {
+        auto key = to_arr(k);
+        bool is_tombstone = false;
+        bool is_found = false;
+        bool is_operand = true;
+        auto value = kvpairs.View(std::span{key}, is_tombstone, is_found, is_operand);
+        ASSERT_TRUE(is_found);
+        ASSERT_FALSE(is_operand);
+        ASSERT_EQ(k % 4 == 0, is_tombstone);
+        if (!is_tombstone) { ASSERT_EQ(0, memcmp(&value[0], to_arr(k * 3).data(), V)); }
+    }
+}
+
+/// @brief verify merge operands fold into resident entries, stay operands otherwise, and survive dump and load
+TEST(KVPairs, MergeTest) {
+    auto merge_operator = bloomstore::AddOperator();
+    auto kvpairs = bloomstore::KVPairs(K, V, 16, 1024, true);
+    auto view = [&](uint32_t xkey, uint32_t& xvalue, bool& is_operand) {
+        auto key = to_arr(xkey);
+        bool is_tombstone = false;
+        bool is_found = false;
+        auto value = kvpairs.View(std::span{key}, is_tombstone, is_found, is_operand);
+        EXPECT_TRUE(is_found && !is_tombstone);
+        memcpy(&xvalue, &value[0], sizeof(uint32_t));
+    };
+    auto merge = [&](uint32_t xkey, uint32_t xoperand) {
+        auto key = to_arr(xkey);
+        auto operand = to_arr(xoperand);
+        return kvpairs.Merge(std::span{key}, std::span{operand}, merge_operator);
+    };
+    auto key = to_arr(1);
+    auto value = to_arr(100);
+    kvpairs.Put(std::span{key}, std::span{value});
+    key = to_arr(2);
+    kvpairs.Del(std::span{key});
+    // a value and a tombstone take the operand in place and stay values
+    ASSERT_TRUE(merge(1, 5));
+    ASSERT_TRUE(merge(2, 7));
+    // a missing key gets an operand entry, later operands are combined into it
+    ASSERT_FALSE(merge(3, 11));
+    ASSERT_TRUE(merge(3, 13));
+    uint32_t xvalue = 0;
+    bool is_operand = false;
+    view(1, xvalue, is_operand);
+    ASSERT_EQ(105, xvalue);
+    ASSERT_FALSE(is_operand);
+    view(2, xvalue, is_operand);
+    ASSERT_EQ(7, xvalue);
+    ASSERT_FALSE(is_operand);
+    view(3, xvalue, is_operand);
+    ASSERT_EQ(24, xvalue);
+    ASSERT_TRUE(is_operand);
+    // a put replaces an operand
+    key = to_arr(3);
+    value = to_arr(1);
+    kvpairs.Put(std::span{key}, std::span{value});
+    view(3, xvalue, is_operand);
+    ASSERT_FALSE(is_operand);
+    ASSERT_FALSE(merge(4, 17));
+    auto space = std::vector<uint8_t>();
+    kvpairs.Dump([&](std::span<uint8_t> bytes) { space.assign(bytes.begin(), bytes.end()); });
+    kvpairs.Load([&](std::span<uint8_t> bytes) { memcpy(&bytes[0], &space[0], bytes.size()); });
+    view(4, xvalue, is_operand);
+    ASSERT_EQ(17, xvalue);
+    ASSERT_TRUE(is_operand);
+    view(1, xvalue, is_operand);
+    ASSERT_FALSE(is_operand);
+}
+
 TEST(KVPairs, DumpLoadTest) {
     auto kvpairs = bloomstore::KVPairs(K, V, 4096, 1024);
     auto ground_truth = std::unordered_map<ARR, ARR, KeyHasher>();
@@ -119,6 +281,36 @@ TEST(KVPairs, DumpLoadTest) {
     }
 }
 
+/// @brief verify an attached kvpairs reads straight from the mapping
+TEST(KVPairs, AttachMappedTest) {
+    auto kvpairs = bloomstore::KVPairs(K, V, 4096, 1024);
+    auto ground_truth = std::unordered_map<ARR, ARR, KeyHasher>();
+    auto random_number_generator = xorshift::XorShift32(7);
+    for (int i = 0; i < 4096; ++i) {
+        auto key    = to_arr(random_number_generator.Sample() % 1024);
+        auto value  = to_arr(random_number_generator.Sample());
+        ground_truth.erase(key);
+        ground_truth.insert(std::make_pair(key, value));
+        kvpairs.Put(std::span{key}, std::span{value});
+    }
+    auto path = std::string("/tmp/bloomstore-test-mapped");
+    auto file = FileObject(path, nullptr, FileMode::Mapped);
+    auto start = file.Size();
+    kvpairs.Dump(file);
+    ASSERT_TRUE(file.IsMapped());
+    auto mapped = file.Map(start, kvpairs.ByteSize());
+    kvpairs.Attach(mapped);
+    for (auto& [key, expected_value]: ground_truth) {
+        auto value = ARR();
+        bool is_tombstone = true;
+        bool is_found = false;
+        auto key_copy = key;
+        kvpairs.Get(std::span{key_copy}, std::span{value}, is_tombstone, is_found);
+        ASSERT_TRUE(is_found && !is_tombstone);
+        ASSERT_EQ(expected_value, value);
+    }
+}
+
 #undef K
 #undef V
 #undef ARR
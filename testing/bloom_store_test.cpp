@@ -1,9 +1,14 @@
 #include<bloom_store.hpp>
 #include<unistd.h>
 #include<fcntl.h>
+#include<sys/stat.h>
 #include<cassert>
 #include<gtest/gtest.h>
 #include<array>
+#include<thread>
+#include<atomic>
+#include<chrono>
+#include<memory>
 #include"./xorshift.hpp"
 
 namespace {
@@ -26,17 +31,7 @@ void Truncate(std::string& path) {
     assert(error_code == 0);
 }
 
-TEST(BloomStoreInstance, Correctness) {
-    auto path_kv = std::string{"./test-kv"};
-    auto path_bf = std::string{"./test-bf"};
-    Truncate(path_kv);
-    Truncate(path_bf);
-    auto bloom_store = bloomstore::BloomStore(
-        path_kv, path_bf,
-        512, 6,     // bf_slots, bf_functions
-        4,   4,     // key_bytes, value_bytes
-        512, 4096   // ram_capacity, align
-    );
+void CheckAgainstGroundTruth(bloomstore::BloomStore& bloom_store) {
     auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
     auto random_number_generator = xorshift::XorShift32(5);
     auto to_arr = [](uint32_t xvalue) {
@@ -84,4 +79,718 @@ TEST(BloomStoreInstance, Correctness) {
     }
 }
 
-}
\ No newline at end of file
+TEST(BloomStoreInstance, Correctness) {
+    auto path_kv = std::string{"./test-kv"};
+    auto path_bf = std::string{"./test-bf"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto bloom_store = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        512, 4096   // ram_capacity, align
+    );
+    CheckAgainstGroundTruth(bloom_store);
+}
+
+/// @brief verify reading blocks and chains in place from memory mapped files
+TEST(BloomStoreInstance, MappedCorrectness) {
+    auto path_kv = std::string{"./test-kv-mapped"};
+    auto path_bf = std::string{"./test-bf-mapped"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto bloom_store = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        512, 4096,  // ram_capacity, align
+        nullptr, FileMode::Mapped
+    );
+    CheckAgainstGroundTruth(bloom_store);
+}
+
+/// @brief verify blocks compressed into extents read back, also through the mapping
+TEST(BloomStoreInstance, CompressedCorrectness) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        auto path_kv = std::string{"./test-kv-compressed"};
+        auto path_bf = std::string{"./test-bf-compressed"};
+        Truncate(path_kv);
+        Truncate(path_bf);
+        auto codec = bloomstore::LZCodec();
+        auto bloom_store = bloomstore::BloomStore(
+            path_kv, path_bf,
+            512, 6,     // bf_slots, bf_functions
+            4,   4,     // key_bytes, value_bytes
+            512, 4096,  // ram_capacity, align
+            nullptr, mode
+        );
+        bloom_store.UseCodec(codec);
+        CheckAgainstGroundTruth(bloom_store);
+    }
+}
+
+/// @brief verify several threads writing one store at once, each thread owns a disjoint set of keys
+TEST(BloomStoreInstance, ConcurrentWriters) {
+    auto path_kv = std::string{"./test-kv-concurrent"};
+    auto path_bf = std::string{"./test-bf-concurrent"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto bloom_store = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        512, 4096   // ram_capacity, align
+    );
+    // blocks filled by concurrent writers neither charge nor release a shared budget
+    auto budget = bloomstore::MemoryBudget(1 << 20);
+    bloom_store.UseBudget(budget);
+    const uint32_t nthreads = 4;
+    auto ground_truths = std::vector<std::unordered_map<uint32_t, uint32_t>>(nthreads);
+    auto threads = std::vector<std::thread>();
+    for (uint32_t t = 0; t < nthreads; ++t) {
+        threads.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(5 + t);
+            auto& ground_truth = ground_truths[t];
+            for (int i = 0; i < 50000; ++i) {
+                uint32_t key   = random_number_generator.Sample() % 1024 * nthreads + t;
+                uint32_t value = random_number_generator.Sample();
+                if (value % 4 == 0) {
+                    ground_truth.erase(key);
+                    bloom_store.ConcurrentDel(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+                }
+                else {
+                    ground_truth[key] = value;
+                    bloom_store.ConcurrentPut(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) { thread.join(); }
+    ASSERT_EQ(0, budget.TotalBuffered());
+    bloom_store.Flush();
+    ASSERT_EQ(0, budget.TotalBuffered());
+    for (uint32_t key = 0; key < 1024 * nthreads; ++key) {
+        auto& ground_truth = ground_truths[key % nthreads];
+        uint32_t value = 0;
+        bool is_tombstone = true;
+        bool is_found = true;
+        bloom_store.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        if (ground_truth.contains(key)) {
+            ASSERT_TRUE(is_found && !is_tombstone) << key;
+            ASSERT_EQ(ground_truth[key], value);
+        }
+        else {
+            ASSERT_TRUE(is_tombstone || !is_found) << key;
+        }
+    }
+}
+
+/// @brief verify readers running alongside concurrent writers only see whole values, each newer than the last they saw. 
+///        each writer owns a disjoint set of keys and writes its versions in order, values carry their key and version. 
+TEST(BloomStoreInstance, ConcurrentReaders) {
+    auto path_kv = std::string{"./test-kv-concurrent-readers"};
+    auto path_bf = std::string{"./test-bf-concurrent-readers"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto bloom_store = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        512, 4096   // ram_capacity, align
+    );
+    const uint32_t nwriters = 4;
+    const uint32_t nreaders = 4;
+    const uint32_t nkeys = 1024;
+    auto versions = std::vector<std::vector<uint32_t>>(nwriters, std::vector<uint32_t>(nkeys, 0));
+    auto deleted = std::vector<std::vector<bool>>(nwriters, std::vector<bool>(nkeys, true));
+    auto writers_done = std::atomic<bool>{false};
+    auto nerrors = std::atomic<size_t>{0};
+    auto nhits = std::atomic<size_t>{0};
+    auto readers = std::vector<std::thread>();
+    for (uint32_t t = 0; t < nreaders; ++t) {
+        readers.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(17 + t);
+            auto seen = std::vector<uint32_t>(nkeys * nwriters, 0);
+            while (!writers_done.load(std::memory_order_acquire)) {
+                uint32_t key = random_number_generator.Sample() % (nkeys * nwriters);
+                uint32_t value = 0;
+                bool is_tombstone = false;
+                bool is_found = false;
+                bloom_store.ConcurrentGet(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+                if (!is_found || is_tombstone) { continue; }
+                nhits += 1;
+                if ((value & 0xfff) != key || (value >> 12) < seen[key]) { nerrors += 1; }
+                seen[key] = value >> 12;
+            }
+        });
+    }
+    auto writers = std::vector<std::thread>();
+    for (uint32_t t = 0; t < nwriters; ++t) {
+        writers.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(5 + t);
+            for (int i = 0; i < 50000; ++i) {
+                uint32_t k = random_number_generator.Sample() % nkeys;
+                uint32_t key = k * nwriters + t;
+                if (random_number_generator.Sample() % 4 == 0) {
+                    deleted[t][k] = true;
+                    bloom_store.ConcurrentDel(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+                }
+                else {
+                    versions[t][k] += 1;
+                    deleted[t][k] = false;
+                    uint32_t value = (versions[t][k] << 12) | key;
+                    bloom_store.ConcurrentPut(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+                }
+            }
+        });
+    }
+    for (auto& writer: writers) { writer.join(); }
+    writers_done.store(true, std::memory_order_release);
+    for (auto& reader: readers) { reader.join(); }
+    ASSERT_EQ(0, nerrors.load());
+    ASSERT_LT(0, nhits.load());
+    bloom_store.Flush();
+    for (uint32_t key = 0; key < nkeys * nwriters; ++key) {
+        uint32_t value = 0;
+        bool is_tombstone = true;
+        bool is_found = true;
+        bloom_store.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        if (!deleted[key % nwriters][key / nwriters]) {
+            ASSERT_TRUE(is_found && !is_tombstone) << key;
+            ASSERT_EQ((versions[key % nwriters][key / nwriters] << 12) | key, value);
+        }
+        else {
+            ASSERT_TRUE(is_tombstone || !is_found) << key;
+        }
+    }
+}
+
+/// @brief verify views match Get and stay intact while their keys are overwritten, flushed and files remapped
+TEST(BloomStoreInstance, GetView) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        auto path_kv = std::string{"./test-kv-view"};
+        auto path_bf = std::string{"./test-bf-view"};
+        Truncate(path_kv);
+        Truncate(path_bf);
+        auto bloom_store = bloomstore::BloomStore(
+            path_kv, path_bf,
+            512, 6,     // bf_slots, bf_functions
+            4,   4,     // key_bytes, value_bytes
+            512, 4096,  // ram_capacity, align
+            nullptr, mode
+        );
+        auto put = [&](uint32_t key, uint32_t value) {
+            bloom_store.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+        };
+        auto get_view = [&](uint32_t key) {
+            return bloom_store.GetView(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+        };
+        auto to_int = [](bloomstore::ValueView& view) {
+            uint32_t value = 0;
+            memcpy(&value, view.value.data(), sizeof(uint32_t));
+            return value;
+        };
+        // keys [0, 2000) are on disk and keys [2000, 2100) in active buffer
+        for (uint32_t key = 0; key < 2100; ++key) { put(key, key * 3); }
+        auto views = std::vector<bloomstore::ValueView>();
+        for (uint32_t key = 0; key < 2100; key += 50) {
+            views.push_back(get_view(key));
+            ASSERT_TRUE(views.back().is_found && !views.back().is_tombstone) << key;
+            ASSERT_EQ(to_int(views.back()), key * 3);
+        }
+        ASSERT_FALSE(get_view(5000).is_found);
+        // overwrite everything, flushing active buffer and growing both files
+        for (uint32_t key = 0; key < 2100; ++key) { put(key, key * 7); }
+        for (uint32_t key = 0; key < 2100; key += 50) {
+            ASSERT_EQ(to_int(views[key / 50]), key * 3) << key;
+            auto view = get_view(key);
+            ASSERT_TRUE(view.is_found && !view.is_tombstone) << key;
+            ASSERT_EQ(to_int(view), key * 7);
+        }
+    }
+}
+
+/// @brief verify reads stay correct while old chains and blocks are demoted to cold files, compressed or not
+TEST(BloomStoreInstance, Tiering) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        for (bool compressed: {false, true}) {
+            auto path_kv = std::string{"./test-kv-hot"};
+            auto path_bf = std::string{"./test-bf-hot"};
+            auto path_cold_kv = std::string{"./test-kv-cold"};
+            auto path_cold_bf = std::string{"./test-bf-cold"};
+            for (auto path: {&path_kv, &path_bf, &path_cold_kv, &path_cold_bf}) { Truncate(*path); }
+            auto codec = bloomstore::LZCodec();
+            auto bloom_store = bloomstore::BloomStore(
+                path_kv, path_bf,
+                512, 6,     // bf_slots, bf_functions
+                4,   4,     // key_bytes, value_bytes
+                16,  4096,  // ram_capacity, align
+                nullptr, mode
+            );
+            if (compressed) { bloom_store.UseCodec(codec); }
+            bloom_store.UseColdTier(path_cold_kv, path_cold_bf, nullptr, mode);
+            auto ground_truth = std::unordered_map<uint32_t, uint32_t>();
+            auto random_number_generator = xorshift::XorShift32(5);
+            auto get = [&](uint32_t key) {
+                uint32_t value = 0;
+                bool is_tombstone = true;
+                bool is_found = true;
+                bloom_store.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+                if (ground_truth.contains(key)) {
+                    ASSERT_TRUE(is_found && !is_tombstone) << key;
+                    ASSERT_EQ(ground_truth[key], value) << key;
+                }
+                else {
+                    ASSERT_TRUE(is_tombstone || !is_found) << key;
+                }
+            };
+            for (int i = 0; i < 60000; ++i) {
+                if (i % 2000 == 0) { bloom_store.Demote(4, 2); }
+                uint32_t key   = random_number_generator.Sample() % 4096;
+                uint32_t value = random_number_generator.Sample();
+                switch (value % 3) {
+                    case 0: {
+                        ground_truth[key] = value;
+                        bloom_store.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+                        break;
+                    }
+                    case 1: {
+                        ground_truth.erase(key);
+                        bloom_store.Del(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+                        break;
+                    }
+                    case 2: {
+                        get(key);
+                        break;
+                    }
+                }
+            }
+            ASSERT_TRUE(bloom_store.Demote(4, SIZE_MAX));
+            for (uint32_t key = 0; key < 4096; ++key) { get(key); }
+            struct stat hot;
+            struct stat cold;
+            stat(path_kv.c_str(), &hot);
+            stat(path_cold_kv.c_str(), &cold);
+            ASSERT_GT(cold.st_size, 0);
+            ASSERT_LT(hot.st_blocks * 512, hot.st_size);
+        }
+    }
+}
+
+/// @brief verify holes deferred by a view are punched after reopening, and demoting on flushes keeps up with writes
+TEST(BloomStoreInstance, TieringReopen) {
+    auto path_kv = std::string{"./test-kv-hot-reopen"};
+    auto path_bf = std::string{"./test-bf-hot-reopen"};
+    auto path_cold_kv = std::string{"./test-kv-cold-reopen"};
+    auto path_cold_bf = std::string{"./test-bf-cold-reopen"};
+    for (auto path: {&path_kv, &path_bf, &path_cold_kv, &path_cold_bf}) { Truncate(*path); }
+    auto open_store = [&]() {
+        auto bloom_store = std::make_unique<bloomstore::BloomStore>(
+            path_kv, path_bf,
+            512, 6,     // bf_slots, bf_functions
+            4,   4,     // key_bytes, value_bytes
+            16,  4096,  // ram_capacity, align
+            nullptr, FileMode::Mapped
+        );
+        bloom_store->UseColdTier(path_cold_kv, path_cold_bf, nullptr, FileMode::Mapped);
+        return bloom_store;
+    };
+    auto put = [](bloomstore::BloomStore& bloom_store, uint32_t begin, uint32_t end) {
+        for (uint32_t key = begin; key < end; ++key) {
+            uint32_t value = key * 3;
+            bloom_store.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+        }
+    };
+    auto allocated = [](std::string& path) {
+        struct stat st;
+        stat(path.c_str(), &st);
+        return std::make_pair(size_t(st.st_blocks * 512), size_t(st.st_size));
+    };
+    {
+        auto bloom_store = open_store();
+        put(*bloom_store, 0, 20000);
+        // a view into the mapping defers the holes, and the store is closed before they are punched
+        uint32_t key = 0;
+        auto view = bloom_store->GetView(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+        ASSERT_TRUE(view.is_found);
+        ASSERT_TRUE(bloom_store->Demote(2, SIZE_MAX));
+        auto [hot_allocated, hot_size] = allocated(path_kv);
+        ASSERT_GE(hot_allocated, hot_size);
+    }
+    auto bloom_store = open_store();
+    auto [hot_allocated, hot_size] = allocated(path_kv);
+    ASSERT_LT(hot_allocated, hot_size / 2);
+    auto get = [&](uint32_t key, bool& is_found) {
+        uint32_t value = 0;
+        bool is_tombstone = true;
+        bloom_store->Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        if (is_found) {
+            ASSERT_FALSE(is_tombstone);
+            ASSERT_EQ(key * 3, value) << key;
+        }
+    };
+    for (uint32_t key = 0; key < 20000; ++key) {
+        // keys of the last, undumped chain are lost with the store
+        bool is_found = false;
+        get(key, is_found);
+        if (key < 16000) { ASSERT_TRUE(is_found) << key; }
+    }
+    // no more Demote calls, flushes move old chains on their own
+    bloom_store->AutoDemote(2);
+    auto cold_size = allocated(path_cold_bf).second;
+    put(*bloom_store, 20000, 40000);
+    ASSERT_GT(allocated(path_cold_bf).second, cold_size);
+    std::tie(hot_allocated, hot_size) = allocated(path_kv);
+    ASSERT_LT(hot_allocated, hot_size / 2);
+    for (uint32_t key = 20000; key < 36000; ++key) {
+        bool is_found = false;
+        get(key, is_found);
+        ASSERT_TRUE(is_found) << key;
+    }
+}
+
+/// @brief verify merge operands fold with values and tombstones across the active buffer and flushed blocks
+TEST(BloomStoreInstance, Merge) {
+    auto path_kv = std::string{"./test-kv-merge"};
+    auto path_bf = std::string{"./test-bf-merge"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto merge_operator = bloomstore::AddOperator();
+    auto bloom_store = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        16,  4096   // ram_capacity, align
+    );
+    bloom_store.UseMergeOperator(merge_operator);
+    auto ground_truth = std::unordered_map<uint32_t, uint32_t>();
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (int i = 0; i < 40000; ++i) {
+        uint32_t key   = random_number_generator.Sample() % 256;
+        uint32_t value = random_number_generator.Sample();
+        auto key_span   = std::span{reinterpret_cast<uint8_t*>(&key), 4};
+        auto value_span = std::span{reinterpret_cast<uint8_t*>(&value), 4};
+        switch (value % 8) {
+            case 0: {
+                ground_truth[key] = value;
+                bloom_store.Put(key_span, value_span);
+                break;
+            }
+            case 1: {
+                ground_truth.erase(key);
+                bloom_store.Del(key_span);
+                break;
+            }
+            case 2: case 3: case 4: {
+                value %= 1000;
+                ground_truth[key] += value;
+                bloom_store.Merge(key_span, value_span);
+                break;
+            }
+            default: {
+                bool is_tombstone = true;
+                bool is_found = true;
+                bloom_store.Get(key_span, value_span, is_tombstone, is_found);
+                auto view = bloom_store.GetView(key_span);
+                if (ground_truth.contains(key)) {
+                    ASSERT_TRUE(is_found && !is_tombstone) << i;
+                    ASSERT_EQ(ground_truth[key], value) << i;
+                    ASSERT_TRUE(view.is_found && !view.is_tombstone) << i;
+                    ASSERT_EQ(0, memcmp(&value, view.value.data(), 4)) << i;
+                }
+                else {
+                    ASSERT_TRUE(is_tombstone || !is_found) << i;
+                    ASSERT_TRUE(view.is_tombstone || !view.is_found) << i;
+                }
+                break;
+            }
+        }
+    }
+}
+
+/// @brief verify read-only followers find everything the writer flushed, and nothing still in its active buffer
+TEST(BloomStoreInstance, Followers) {
+    auto path_kv = std::string{"./test-kv-follow"};
+    auto path_bf = std::string{"./test-bf-follow"};
+    auto path_tail = std::string{"./test-tail-follow"};
+    Truncate(path_kv);
+    Truncate(path_bf);
+    auto writer = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        16,  4096   // ram_capacity, align
+    );
+    writer.UseTail(path_tail);
+    auto followers = std::vector<std::unique_ptr<bloomstore::BloomStore>>();
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        followers.push_back(std::make_unique<bloomstore::BloomStore>(
+            path_kv, path_bf,
+            512, 6, 4, 4, 16, 4096,
+            nullptr, mode, true
+        ));
+        followers.back()->UseTail(path_tail);
+    }
+    auto ground_truth = std::unordered_map<uint32_t, uint32_t>();
+    auto random_number_generator = xorshift::XorShift32(7);
+    auto check = [&](uint32_t key) {
+        for (auto& follower: followers) {
+            uint32_t value = 0;
+            bool is_tombstone = false;
+            bool is_found = false;
+            follower->Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+            if (ground_truth.contains(key)) {
+                ASSERT_TRUE(is_found && !is_tombstone) << key;
+                ASSERT_EQ(ground_truth[key], value) << key;
+            }
+            else {
+                ASSERT_TRUE(is_tombstone || !is_found) << key;
+            }
+        }
+    };
+    for (int round = 0; round < 40; ++round) {
+        for (int i = 0; i < 200; ++i) {
+            uint32_t key   = random_number_generator.Sample() % 2048;
+            uint32_t value = random_number_generator.Sample();
+            auto key_span = std::span{reinterpret_cast<uint8_t*>(&key), 4};
+            if (value % 4 == 0) {
+                ground_truth.erase(key);
+                writer.Del(key_span);
+            }
+            else {
+                ground_truth[key] = value;
+                writer.Put(key_span, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+            }
+        }
+        writer.Flush();
+        for (int i = 0; i < 64; ++i) { check(random_number_generator.Sample() % 2048); }
+    }
+    for (uint32_t key = 0; key < 2048; ++key) { check(key); }
+    // an entry only in the writer's active buffer is not seen until it is flushed
+    uint32_t key = 5000;
+    uint32_t value = 1;
+    writer.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+    ground_truth.erase(key);
+    check(key);
+    writer.Flush();
+    ground_truth[key] = value;
+    check(key);
+}
+
+/// @brief verify entries are gone once their blocks expire, and expired chains and blocks are freed without rewriting
+TEST(BloomStoreInstance, TTL) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        auto path_kv = std::string{"./test-kv-ttl"};
+        auto path_bf = std::string{"./test-bf-ttl"};
+        auto path_times = std::string{"./test-times-ttl"};
+        for (auto path: {&path_kv, &path_bf, &path_times}) { Truncate(*path); }
+        auto bloom_store = bloomstore::BloomStore(
+            path_kv, path_bf,
+            512, 6,     // bf_slots, bf_functions
+            4,   4,     // key_bytes, value_bytes
+            16,  4096,  // ram_capacity, align
+            nullptr, mode
+        );
+        bloom_store.UseTTL(path_times, 300);
+        auto put = [&](uint32_t key, uint32_t value) {
+            bloom_store.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+        };
+        auto get = [&](uint32_t key, uint32_t& value) {
+            bool is_tombstone = true;
+            bool is_found = true;
+            bloom_store.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+            return is_found && !is_tombstone;
+        };
+        // 125 blocks, a whole chain and most of the next one
+        for (uint32_t key = 0; key < 2000; ++key) { put(key, key); }
+        bloom_store.Flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        // keys [1000, 2000) are only in expired blocks, some of them in a chain that is not expired as a whole
+        auto is_live = [](uint32_t key) { return key < 1000 || key >= 2000; };
+        for (uint32_t key = 0; key < 3000; ++key) { if (is_live(key)) { put(key, key * 3); } }
+        bloom_store.Flush();
+        uint32_t value = 0;
+        for (uint32_t key = 0; key < 3000; ++key) {
+            if (is_live(key)) {
+                ASSERT_TRUE(get(key, value)) << key;
+                ASSERT_EQ(key * 3, value);
+            }
+            else {
+                ASSERT_FALSE(get(key, value)) << key;
+            }
+        }
+        ASSERT_TRUE(bloom_store.Expire(SIZE_MAX));
+        struct stat kv;
+        stat(path_kv.c_str(), &kv);
+        ASSERT_LT(kv.st_blocks * 512, kv.st_size);
+        for (uint32_t key = 0; key < 3000; key += 7) { ASSERT_EQ(is_live(key), get(key, value)) << key; }
+        // everything expires, new entries are still found
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        for (uint32_t key = 0; key < 3000; key += 7) { ASSERT_FALSE(get(key, value)) << key; }
+        ASSERT_TRUE(bloom_store.Expire(SIZE_MAX));
+        put(5000, 1);
+        ASSERT_TRUE(get(5000, value));
+        bloom_store.Flush();
+        ASSERT_TRUE(get(5000, value));
+    }
+}
+
+/// @brief verify the writer keeps demoted chains and blocks in place until a follower has caught up past them
+TEST(BloomStoreInstance, FollowerDemote) {
+    auto path_kv = std::string{"./test-kv-follow-demote"};
+    auto path_bf = std::string{"./test-bf-follow-demote"};
+    auto path_cold_kv = std::string{"./test-kv-cold-follow-demote"};
+    auto path_cold_bf = std::string{"./test-bf-cold-follow-demote"};
+    auto path_tail = std::string{"./test-tail-follow-demote"};
+    for (auto path: {&path_kv, &path_bf, &path_cold_kv, &path_cold_bf, &path_tail}) { Truncate(*path); }
+    auto writer = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        16,  4096   // ram_capacity, align
+    );
+    writer.UseColdTier(path_cold_kv, path_cold_bf);
+    writer.UseTail(path_tail);
+    auto follower = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6, 4, 4, 16, 4096,
+        nullptr, FileMode::Direct, true
+    );
+    follower.UseColdTier(path_cold_kv, path_cold_bf);
+    follower.UseTail(path_tail);
+    auto check = [&](uint32_t key) {
+        uint32_t value = 0;
+        bool is_tombstone = false;
+        bool is_found = false;
+        follower.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        ASSERT_TRUE(is_found && !is_tombstone) << key;
+        ASSERT_EQ(key * 3, value);
+    };
+    auto allocated = [](std::string& path) {
+        struct stat st;
+        stat(path.c_str(), &st);
+        return std::make_pair(size_t(st.st_blocks * 512), size_t(st.st_size));
+    };
+    for (uint32_t key = 0; key < 4096; ++key) {
+        uint32_t value = key * 3;
+        writer.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+    }
+    writer.Flush();
+    check(0);
+    // the follower still reads the old record, nothing it may read is freed
+    ASSERT_TRUE(writer.Demote(1, SIZE_MAX));
+    auto [hot_allocated, hot_size] = allocated(path_kv);
+    ASSERT_GE(hot_allocated, hot_size);
+    writer.Demote(1, SIZE_MAX);
+    ASSERT_GE(allocated(path_kv).first, hot_size);
+    // once it caught up, the next attempt frees the hot copies
+    for (uint32_t key = 0; key < 4096; key += 5) { check(key); }
+    writer.Demote(1, SIZE_MAX);
+    std::tie(hot_allocated, hot_size) = allocated(path_kv);
+    ASSERT_LT(hot_allocated, hot_size / 2);
+    for (uint32_t key = 0; key < 4096; key += 3) { check(key); }
+}
+
+/// @brief verify followers skip expired entries like the writer, in dumped chains and in the collector they rebuild
+TEST(BloomStoreInstance, FollowerTTL) {
+    auto path_kv = std::string{"./test-kv-follow-ttl"};
+    auto path_bf = std::string{"./test-bf-follow-ttl"};
+    auto path_tail = std::string{"./test-tail-follow-ttl"};
+    auto path_times = std::string{"./test-times-follow-ttl"};
+    for (auto path: {&path_kv, &path_bf, &path_times}) { Truncate(*path); }
+    auto writer = bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 6,     // bf_slots, bf_functions
+        4,   4,     // key_bytes, value_bytes
+        16,  4096   // ram_capacity, align
+    );
+    writer.UseTTL(path_times, 300);
+    writer.UseTail(path_tail);
+    auto followers = std::vector<std::unique_ptr<bloomstore::BloomStore>>();
+    for (bool is_ttl_first: {false, true}) {
+        followers.push_back(std::make_unique<bloomstore::BloomStore>(
+            path_kv, path_bf,
+            512, 6, 4, 4, 16, 4096,
+            nullptr, FileMode::Mapped, true
+        ));
+        if (is_ttl_first) { followers.back()->UseTTL(path_times, 300); }
+        followers.back()->UseTail(path_tail);
+        if (!is_ttl_first) { followers.back()->UseTTL(path_times, 300); }
+    }
+    auto put = [&](uint32_t key) {
+        writer.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&key), 4});
+    };
+    auto check = [&](uint32_t key, bool is_live) {
+        for (auto& follower: followers) {
+            uint32_t value = 0;
+            bool is_tombstone = false;
+            bool is_found = false;
+            follower->Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+            ASSERT_EQ(is_live, is_found && !is_tombstone) << key;
+            if (is_live) { ASSERT_EQ(key, value); }
+        }
+    };
+    // a dumped chain, and most of the next one sealed in the collector
+    for (uint32_t key = 0; key < 2000; ++key) { put(key); }
+    writer.Flush();
+    for (uint32_t key = 0; key < 2000; key += 7) { check(key, true); }
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    for (uint32_t key = 0; key < 2000; key += 7) { check(key, false); }
+    for (uint32_t key = 2000; key < 3000; ++key) { put(key); }
+    writer.Flush();
+    for (uint32_t key = 0; key < 3000; key += 7) { check(key, key >= 2000); }
+}
+
+/// @brief verify a reopened store remembers which expired chains are freed and only frees the newer ones
+TEST(BloomStoreInstance, TTLReopen) {
+    auto path_kv = std::string{"./test-kv-ttl-reopen"};
+    auto path_bf = std::string{"./test-bf-ttl-reopen"};
+    auto path_times = std::string{"./test-times-ttl-reopen"};
+    for (auto path: {&path_kv, &path_bf, &path_times}) { Truncate(*path); }
+    auto open = [&]() {
+        auto bloom_store = std::make_unique<bloomstore::BloomStore>(
+            path_kv, path_bf,
+            512, 6,     // bf_slots, bf_functions
+            4,   4,     // key_bytes, value_bytes
+            16,  4096   // ram_capacity, align
+        );
+        bloom_store->UseTTL(path_times, 300);
+        return bloom_store;
+    };
+    auto put = [](bloomstore::BloomStore& bloom_store, uint32_t key) {
+        bloom_store.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&key), 4});
+    };
+    auto get = [](bloomstore::BloomStore& bloom_store, uint32_t key) {
+        uint32_t value = 0;
+        bool is_tombstone = true;
+        bool is_found = true;
+        bloom_store.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        return is_found && !is_tombstone && value == key;
+    };
+    {
+        // one whole chain, freed before the store is closed
+        auto bloom_store = open();
+        for (uint32_t key = 0; key < 1024; ++key) { put(*bloom_store, key); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+        ASSERT_TRUE(bloom_store->Expire(SIZE_MAX));
+        // another chain, expired but not freed before the store is closed
+        for (uint32_t key = 1024; key < 2048; ++key) { put(*bloom_store, key); }
+        std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    }
+    auto bloom_store = open();
+    // only the second chain is left to free, and freeing it does not touch the first one again
+    ASSERT_FALSE(bloom_store->Expire(0));
+    ASSERT_TRUE(bloom_store->Expire(1));
+    ASSERT_TRUE(bloom_store->Expire(0));
+    for (uint32_t key = 0; key < 2048; key += 7) { ASSERT_FALSE(get(*bloom_store, key)) << key; }
+    struct stat kv;
+    stat(path_kv.c_str(), &kv);
+    ASSERT_EQ(0, kv.st_blocks);
+    for (uint32_t key = 4096; key < 5120; ++key) { put(*bloom_store, key); }
+    bloom_store.reset();
+    bloom_store = open();
+    ASSERT_TRUE(bloom_store->Expire(0));
+    for (uint32_t key = 4096; key < 5120; key += 7) { ASSERT_TRUE(get(*bloom_store, key)) << key; }
+}
+
+}
@@ -0,0 +1,72 @@
+#include<gtest/gtest.h>
+#include<codec.hpp>
+#include<vector>
+#include<thread>
+#include<atomic>
+#include"./xorshift.hpp"
+
+namespace {
+
+std::vector<uint8_t> RoundTrip(bloomstore::Codec& codec, std::vector<uint8_t>& input, size_t& compressed_size) {
+    auto compressed = std::vector<uint8_t>{7, 7, 7};
+    codec.Compress(std::span{input}, compressed);
+    compressed_size = compressed.size() - 3;
+    auto output = std::vector<uint8_t>(input.size(), 0x77);
+    codec.Decompress(std::span{compressed}.subspan(3), std::span{output});
+    return output;
+}
+
+/// @brief verify lz codec restores inputs of any shape exactly
+TEST(LZCodec, RoundTrip) {
+    auto codec = bloomstore::LZCodec();
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (size_t n: {0, 1, 8, 9, 13, 64, 1000, 4096, 100000, 300000}) {
+        for (int shape = 0; shape < 3; ++shape) {
+            auto input = std::vector<uint8_t>(n, 0);
+            for (size_t i = 0; i < n; ++i) {
+                switch (shape) {
+                    case 0: input[i] = random_number_generator.Sample(); break;
+                    case 1: input[i] = random_number_generator.Sample() % 4; break;
+                    case 2: input[i] = (i / 64) % 2 ? 0 : random_number_generator.Sample() % 16; break;
+                }
+            }
+            size_t compressed_size = 0;
+            ASSERT_EQ(RoundTrip(codec, input, compressed_size), input) << n << " " << shape;
+        }
+    }
+}
+
+/// @brief verify padding and repeated records shrink a lot
+TEST(LZCodec, CompressesPadding) {
+    auto codec = bloomstore::LZCodec();
+    auto random_number_generator = xorshift::XorShift32(5);
+    auto input = std::vector<uint8_t>(1 << 16, 0);
+    for (size_t i = 0; i < 4096; ++i) {
+        input[i] = random_number_generator.Sample();
+    }
+    size_t compressed_size = 0;
+    ASSERT_EQ(RoundTrip(codec, input, compressed_size), input);
+    ASSERT_LT(compressed_size, 4096 + 512);
+}
+
+/// @brief verify one codec shared by several threads compresses each input on its own
+TEST(LZCodec, SharedAcrossThreads) {
+    auto codec = bloomstore::LZCodec();
+    auto mismatches = std::atomic<size_t>(0);
+    auto threads = std::vector<std::thread>();
+    for (uint32_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(t + 1);
+            for (int round = 0; round < 200; ++round) {
+                auto input = std::vector<uint8_t>(4096, 0);
+                for (auto& byte: input) { byte = random_number_generator.Sample() % 4; }
+                size_t compressed_size = 0;
+                if (RoundTrip(codec, input, compressed_size) != input) { mismatches += 1; }
+            }
+        });
+    }
+    for (auto& thread: threads) { thread.join(); }
+    ASSERT_EQ(0, mismatches.load());
+}
+
+}
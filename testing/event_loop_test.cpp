@@ -0,0 +1,152 @@
+#include<gtest/gtest.h>
+#include<partitioner.hpp>
+#include<event_loop.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<array>
+#include<optional>
+#include"./xorshift.hpp"
+
+namespace {
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+std::array<uint8_t, 4> to_arr(uint32_t xvalue) {
+    auto value = std::array<uint8_t, 4>();
+    memcpy(&value, &xvalue, sizeof(uint32_t));
+    return value;
+}
+
+bloomstore::BloomStore* MakeInstance(std::string name, FileMode mode) {
+    auto path_kv = std::string{"./test-kv-async-"} + name;
+    auto path_bf = std::string{"./test-bf-async-"} + name;
+    Truncate(path_kv);
+    Truncate(path_bf);
+    return new bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 5,      // bf_slots, bf_functions
+        4,   4,      // key_bytes, value_bytes
+        64,  4096,   // ram_capacity, align
+        nullptr, mode
+    );
+}
+
+bloomstore::Task<void> PutTask(bloomstore::EventLoop& loop, bloomstore::Partitioner& partitioner, std::array<uint8_t, 4> key, std::array<uint8_t, 4> value) {
+    co_await partitioner.AsyncPut(loop, std::span{key}, std::span{value});
+}
+
+bloomstore::Task<void> DelTask(bloomstore::Partitioner& partitioner, std::array<uint8_t, 4> key) {
+    partitioner.Del(std::span{key});
+    co_return;
+}
+
+/// @brief look a key up while other tasks write, the answer must match expected unless key was written meanwhile
+bloomstore::Task<void> CheckTask(bloomstore::EventLoop& loop, bloomstore::Partitioner& partitioner, uint32_t k, std::optional<uint32_t> expected, std::vector<size_t>& writes, size_t& mismatches) {
+    auto key = to_arr(k);
+    auto value = std::array<uint8_t, 4>();
+    auto nwrites = writes[k];
+    auto result = co_await partitioner.AsyncGet(loop, std::span{key}, std::span{value});
+    if (writes[k] != nwrites) { co_return; }
+    bool is_present = result.is_found && !result.is_tombstone;
+    if (is_present != expected.has_value() || (is_present && value != to_arr(*expected))) {
+        mismatches += 1;
+    }
+}
+
+bloomstore::Task<void> GetTask(bloomstore::EventLoop& loop, bloomstore::Partitioner& partitioner, uint32_t k, size_t& mismatches) {
+    auto key = to_arr(k);
+    auto value = std::array<uint8_t, 4>();
+    auto result = co_await partitioner.AsyncGet(loop, std::span{key}, std::span{value});
+    auto expected_value = std::array<uint8_t, 4>();
+    bool is_tombstone = false;
+    bool is_found = false;
+    partitioner.Get(std::span{key}, std::span{expected_value}, is_tombstone, is_found);
+    bool is_present = result.is_found && !result.is_tombstone;
+    if (is_present != (is_found && !is_tombstone) || (is_present && value != expected_value)) {
+        mismatches += 1;
+    }
+}
+
+/// @brief verify many lookups in flight on one loop read the same as blocking ones
+TEST(EventLoop, AsyncGetMatchesGet) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        auto instances = std::vector<bloomstore::BloomStore*>();
+        for (int i = 0; i < 4; ++i) {
+            instances.push_back(MakeInstance(std::to_string(i), mode));
+        }
+        auto partitioner = bloomstore::Partitioner(std::move(instances));
+        auto loop = bloomstore::EventLoop(64);
+        auto random_number_generator = xorshift::XorShift32(11);
+        for (int i = 0; i < 20000; ++i) {
+            auto key = to_arr(random_number_generator.Sample() % 4096);
+            auto value = to_arr(random_number_generator.Sample());
+            if (i % 7 == 0) { partitioner.Del(std::span{key}); }
+            else { loop.Spawn(PutTask(loop, partitioner, key, value)); }
+        }
+        loop.Run();
+        size_t mismatches = 0;
+        for (uint32_t k = 0; k < 4096; ++k) {
+            loop.Spawn(GetTask(loop, partitioner, k, mismatches));
+        }
+        loop.Run();
+        ASSERT_EQ(0, mismatches);
+    }
+}
+
+/// @brief verify puts that fill blocks don't block the loop: lookups running alongside read sealed blocks 
+///        and chains from memory until they are written, and blocking writes queue behind them
+TEST(EventLoop, AsyncPutAlongsideReads) {
+    for (auto mode: {FileMode::Direct, FileMode::Mapped}) {
+        auto instances = std::vector<bloomstore::BloomStore*>();
+        for (int i = 0; i < 4; ++i) {
+            instances.push_back(MakeInstance("put-" + std::to_string(i), mode));
+        }
+        auto partitioner = bloomstore::Partitioner(std::move(instances));
+        auto loop = bloomstore::EventLoop(64);
+        auto random_number_generator = xorshift::XorShift32(13);
+        auto ground_truth = std::vector<std::optional<uint32_t>>(4096);
+        auto writes = std::vector<size_t>(4096, 0);
+        size_t mismatches = 0;
+        for (int round = 0; round < 10; ++round) {
+            // tasks start in order, so each check sees the writes spawned before it
+            for (int i = 0; i < 5000; ++i) {
+                uint32_t k = random_number_generator.Sample() % 4096;
+                if (i % 5 == 0) {
+                    loop.Spawn(CheckTask(loop, partitioner, k, ground_truth[k], writes, mismatches));
+                    continue;
+                }
+                writes[k] += 1;
+                if (i % 7 == 0) {
+                    ground_truth[k].reset();
+                    loop.Spawn(DelTask(partitioner, to_arr(k)));
+                }
+                else {
+                    ground_truth[k] = random_number_generator.Sample();
+                    loop.Spawn(PutTask(loop, partitioner, to_arr(k), to_arr(*ground_truth[k])));
+                }
+            }
+            // checks spawned after the writes have no write racing them
+            for (uint32_t k = 0; k < 4096; k += 7) {
+                loop.Spawn(CheckTask(loop, partitioner, k, ground_truth[k], writes, mismatches));
+            }
+            loop.Run();
+        }
+        ASSERT_EQ(0, mismatches);
+        for (uint32_t k = 0; k < 4096; ++k) {
+            auto key = to_arr(k);
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = true;
+            partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+            ASSERT_EQ(ground_truth[k].has_value(), is_found && !is_tombstone) << k;
+            if (ground_truth[k]) { ASSERT_EQ(to_arr(*ground_truth[k]), value) << k; }
+        }
+    }
+}
+
+}
@@ -0,0 +1,49 @@
+#include<gtest/gtest.h>
+#include<hashing.hpp>
+#include<vector>
+#include"./xorshift.hpp"
+
+namespace {
+
+/// @brief verify batch hashing gives the same hashes as hashing keys one by one, for any key length and stride
+TEST(Hashing, BatchMatchesScalar) {
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (size_t key_bytes: {1, 3, 4, 7, 8, 13, 16, 32, 61}) {
+        for (size_t padding: {0, 1, 4}) {
+            for (size_t n: {1, 7, 8, 15, 16, 17, 100, 1000}) {
+                auto stride = key_bytes + padding;
+                auto keys = std::vector<uint8_t>(n * stride);
+                for (auto& byte: keys) { byte = random_number_generator.Sample(); }
+                auto hashes = std::vector<uint32_t>(n, 0);
+                for (uint32_t seed: {0u, uint32_t{'Z'}, 0xdeadbeefu}) {
+                    bloomstore::HashBatch(std::span{keys}, key_bytes, stride, seed, std::span{hashes});
+                    for (size_t i = 0; i < n; ++i) {
+                        ASSERT_EQ(hashes[i], bloomstore::Hash(std::span{keys}.subspan(i * stride, key_bytes), seed))
+                            << key_bytes << " " << stride << " " << n << " " << i;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// @brief verify a key rewritten by Preimage hashes to the wanted value and keeps its other bytes
+TEST(Hashing, Preimage) {
+    auto random_number_generator = xorshift::XorShift32(7);
+    for (size_t key_bytes: {4, 5, 7, 8, 13, 16, 61}) {
+        for (int round = 0; round < 1000; ++round) {
+            auto key = std::vector<uint8_t>(key_bytes);
+            for (auto& byte: key) { byte = random_number_generator.Sample(); }
+            auto original = key;
+            uint32_t hash = random_number_generator.Sample();
+            bloomstore::Preimage(std::span{key}, 'Z', hash);
+            ASSERT_EQ(hash, bloomstore::Hash(std::span{key}, 'Z')) << key_bytes;
+            size_t last = (key_bytes / 4 - 1) * 4;
+            for (size_t i = 0; i < key_bytes; ++i) {
+                if (i < last || i >= last + 4) { ASSERT_EQ(original[i], key[i]); }
+            }
+        }
+    }
+}
+
+}
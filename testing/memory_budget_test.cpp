@@ -0,0 +1,149 @@
+#include<gtest/gtest.h>
+#include<bloom_store.hpp>
+#include<memory_budget.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<unordered_map>
+#include<thread>
+#include"./xorshift.hpp"
+
+namespace {
+
+template<int const N>
+struct KeyHasher {
+    std::size_t operator()(const std::array<uint8_t, N>& a) const {
+        std::size_t h = 0;
+        for (auto e : a) {
+            h ^= std::hash<int>{}(e)  + 0x9e3779b9 + (h << 6) + (h >> 2); 
+        }
+        return h;
+    }   
+};
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+std::array<uint8_t, 4> to_arr(uint32_t xvalue) {
+    auto value = std::array<uint8_t, 4>();
+    memcpy(&value, &xvalue, sizeof(uint32_t));
+    return value;
+}
+
+std::vector<bloomstore::BloomStore*> MakeInstances(std::string prefix, int n) {
+    auto instances = std::vector<bloomstore::BloomStore*>();
+    for (int i = 0; i < n; ++i) {
+        auto path_kv = std::string{"./test-kv-"} + prefix + std::to_string(i);
+        auto path_bf = std::string{"./test-bf-"} + prefix + std::to_string(i);
+        Truncate(path_kv);
+        Truncate(path_bf);
+        instances.push_back(new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            256,  4096   // ram_capacity, align
+        ));
+    }
+    return instances;
+}
+
+/// @brief verify buffered bytes stay in budget, hot partitions keep bigger buffers, and early flushed data is readable
+TEST(MemoryBudget, HotPartitionsKeepBiggerBuffers) {
+    auto budget = bloomstore::MemoryBudget(2 * 256 * 8);
+    auto instances = MakeInstances("budget-", 8);
+    for (auto instance: instances) { instance->UseBudget(budget); }
+    auto ground_truth = std::vector<std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>>(8);
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (int i = 0; i < 20000; ++i) {
+        // partition 0 takes most of the writes
+        auto sample = random_number_generator.Sample() % 16;
+        auto partition = sample < 9 ? 0 : sample - 8;
+        auto key   = to_arr(random_number_generator.Sample() % 4096);
+        auto value = to_arr(random_number_generator.Sample());
+        ground_truth[partition][key] = value;
+        instances[partition]->Put(std::span{key}, std::span{value});
+        // partitions asked to flush do so on their own next write
+        ASSERT_LE(budget.TotalBuffered(), 2 * 256 * 8 + budget.TotalRequested());
+    }
+    for (int i = 0; i < 8; ++i) {
+        auto key   = to_arr(4096 + i);
+        auto value = to_arr(i);
+        ground_truth[i][key] = value;
+        instances[i]->Put(std::span{key}, std::span{value});
+    }
+    ASSERT_LE(budget.TotalBuffered(), 2 * 256 * 8);
+    for (int i = 1; i < 8; ++i) {
+        ASSERT_GE(budget.Buffered(0), budget.Buffered(i));
+    }
+    for (int i = 0; i < 8; ++i) {
+        for (auto& [key, expected_value]: ground_truth[i]) {
+            auto key_copy = key;
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = false;
+            instances[i]->Get(std::span{key_copy}, std::span{value}, is_tombstone, is_found);
+            ASSERT_TRUE(is_found && !is_tombstone);
+            ASSERT_EQ(expected_value, value);
+        }
+    }
+    for (auto instance: instances) { delete instance; }
+}
+
+/// @brief verify partitions written by their own threads share a budget, each flushed only by its own thread
+TEST(MemoryBudget, OwningThreads) {
+    auto budget = bloomstore::MemoryBudget(2 * 256 * 8);
+    auto instances = MakeInstances("budget-threads-", 4);
+    for (auto instance: instances) { instance->UseBudget(budget); }
+    auto ground_truth = std::vector<std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>>(4);
+    auto threads = std::vector<std::thread>();
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(5 + t);
+            // partition 0 is written the most
+            for (int i = 0; i < (t == 0 ? 40000 : 5000); ++i) {
+                auto key   = to_arr(random_number_generator.Sample() % 4096);
+                auto value = to_arr(random_number_generator.Sample());
+                ground_truth[t][key] = value;
+                instances[t]->Put(std::span{key}, std::span{value});
+            }
+        });
+    }
+    for (auto& thread: threads) { thread.join(); }
+    ASSERT_LE(budget.TotalBuffered(), 2 * 256 * 8 + budget.TotalRequested());
+    for (int i = 0; i < 4; ++i) {
+        for (auto& [key, expected_value]: ground_truth[i]) {
+            auto key_copy = key;
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = false;
+            instances[i]->Get(std::span{key_copy}, std::span{value}, is_tombstone, is_found);
+            ASSERT_TRUE(is_found && !is_tombstone);
+            ASSERT_EQ(expected_value, value);
+        }
+    }
+    for (auto instance: instances) { delete instance; }
+}
+
+/// @brief verify per partition usage adds up by component
+TEST(MemoryBudget, UsageReport) {
+    auto budget = bloomstore::MemoryBudget(1 << 20);
+    auto instances = MakeInstances("usage-", 3);
+    for (auto instance: instances) { instance->UseBudget(budget); }
+    size_t total = 0;
+    for (size_t i = 0; i < 3; ++i) {
+        auto usage = budget.Usage(i);
+        ASSERT_EQ(usage,
+            budget.Usage(i, bloomstore::MemoryComponent::ActiveKVPairs) +
+            budget.Usage(i, bloomstore::MemoryComponent::BloomChainCollector) +
+            budget.Usage(i, bloomstore::MemoryComponent::Scratch));
+        ASSERT_GE(budget.Usage(i, bloomstore::MemoryComponent::ActiveKVPairs), 256 * 8);
+        total += usage;
+    }
+    ASSERT_EQ(budget.TotalUsage(), total);
+    for (auto instance: instances) { delete instance; }
+}
+
+}
@@ -0,0 +1,67 @@
+#include<gtest/gtest.h>
+#include<partition_map.hpp>
+#include<sstream>
+#include"./xorshift.hpp"
+
+namespace {
+
+/// @brief verify a new partition only takes keys over, and takes roughly its fair share
+TEST(PartitionMap, AddPartitionMovesFairShare) {
+    auto previous_map = bloomstore::PartitionMap(8, 64);
+    auto partition_map = previous_map;
+    auto index = partition_map.AddPartition(64);
+    ASSERT_EQ(index, 8);
+    ASSERT_EQ(partition_map.Size(), 9);
+    auto random_number_generator = xorshift::XorShift32(5);
+    uint32_t moved = 0, n = 100000;
+    for (uint32_t i = 0; i < n; ++i) {
+        auto hash = random_number_generator.Sample();
+        auto before = previous_map.Route(hash);
+        auto after  = partition_map.Route(hash);
+        if (before == after) { continue; }
+        ASSERT_EQ(after, index);
+        moved += 1;
+    }
+    ASSERT_NEAR(moved / float(n), 1.0 / 9.0, 0.05);
+}
+
+/// @brief verify splitting only moves keys of the split partition, and about half of them
+TEST(PartitionMap, SplitPartitionMovesHalf) {
+    auto previous_map = bloomstore::PartitionMap(8, 64);
+    auto partition_map = previous_map;
+    auto index = partition_map.SplitPartition(3);
+    auto donors = std::vector<uint32_t>();
+    previous_map.Donors(partition_map, donors);
+    ASSERT_EQ(donors, std::vector<uint32_t>{3});
+    auto random_number_generator = xorshift::XorShift32(5);
+    uint32_t owned = 0, moved = 0;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        auto hash = random_number_generator.Sample();
+        auto before = previous_map.Route(hash);
+        auto after  = partition_map.Route(hash);
+        owned += (before == 3);
+        if (before == after) { continue; }
+        ASSERT_EQ(before, 3);
+        ASSERT_EQ(after, index);
+        moved += 1;
+    }
+    ASSERT_NEAR(moved / float(owned), 0.5, 0.1);
+}
+
+/// @brief verify the map routes identically after dumping and loading
+TEST(PartitionMap, DumpLoadConsistency) {
+    auto partition_map = bloomstore::PartitionMap(8, 64);
+    partition_map.SplitPartition(2);
+    auto stream = std::stringstream();
+    partition_map.Dump(stream);
+    auto loaded_map = bloomstore::PartitionMap();
+    ASSERT_TRUE(loaded_map.Load(stream));
+    ASSERT_EQ(loaded_map.Size(), partition_map.Size());
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (uint32_t i = 0; i < 10000; ++i) {
+        auto hash = random_number_generator.Sample();
+        ASSERT_EQ(loaded_map.Route(hash), partition_map.Route(hash));
+    }
+}
+
+}
@@ -1,7 +1,11 @@
 #include<partitioner.hpp>
+#include<hashing.hpp>
 #include<gtest/gtest.h>
 #include<unistd.h>
 #include<fcntl.h>
+#include<fstream>
+#include<thread>
+#include<atomic>
 #include"./xorshift.hpp"
 
 namespace {
@@ -84,4 +88,364 @@ TEST(Partitioner, Correctness) {
     }
 }
 
-}
\ No newline at end of file
+/// @brief verify reads and writes stay correct while partitions are added and split online
+TEST(Partitioner, OnlineRepartition) {
+    auto make_instance = [](std::string name) {
+        auto path_kv = std::string{"./test-kv-resize-"} + name;
+        auto path_bf = std::string{"./test-bf-resize-"} + name;
+        Truncate(path_kv);
+        Truncate(path_bf);
+        return new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            128,  4096   // ram_capacity, align
+        );
+    };
+    auto path_map = std::string{"./test-map-resize"};
+    Truncate(path_map);
+    auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
+    for (char i = 'a'; i <= 'd'; ++i) {
+        bloom_store_replications.push_back(make_instance(std::string{i}));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications), path_map);
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(5);
+    auto to_arr = [](uint32_t xvalue) {
+        auto value = std::array<uint8_t, 4>();
+        memcpy(&value, &xvalue, sizeof(uint32_t));
+        return value;
+    };
+    for (int i = 0; i < 200000; ++i) {
+        if (i == 50000)  { partitioner.AddPartition(make_instance("e")); }
+        if (i == 100000) { partitioner.SplitPartition(0, make_instance("f")); }
+        if (i % 1000 == 0) { partitioner.Migrate(1); }
+        auto action = random_number_generator.Sample() % 3;
+        auto key    = to_arr(random_number_generator.Sample() % 4096);
+        auto value  = to_arr(random_number_generator.Sample());
+        switch (action) {
+            case 0: {
+                ground_truth.erase(key);
+                ground_truth.insert(std::make_pair(key, value));
+                partitioner.Put(std::span{key}, std::span{value});
+                break;
+            }
+            case 1: {
+                ground_truth.erase(key);
+                partitioner.Del(std::span{key});
+                break;
+            }
+            case 2: {
+                auto value = std::array<uint8_t, 4>();
+                bool is_tombstone = true;
+                bool is_found = true;
+                partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+                if (ground_truth.contains(key)) {
+                    ASSERT_TRUE(is_found && !is_tombstone) << i;
+                    ASSERT_EQ(ground_truth[key], value);
+                }
+                else {
+                    ASSERT_TRUE(is_tombstone || !is_found);
+                }
+                break;
+            }
+        }
+    }
+    ASSERT_TRUE(partitioner.Migrate(SIZE_MAX));
+    ASSERT_FALSE(partitioner.IsMigrating());
+    // deleted keys stay deleted once their older values are moved
+    for (uint32_t x = 0; x < 4096; ++x) {
+        auto key = to_arr(x);
+        auto value = std::array<uint8_t, 4>();
+        bool is_tombstone = true;
+        bool is_found = true;
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        ASSERT_EQ(ground_truth.contains(key), is_found && !is_tombstone) << x;
+        if (ground_truth.contains(key)) { ASSERT_EQ(ground_truth[key], value) << x; }
+    }
+}
+
+/// @brief verify stores written with modulo routing are read back with it, and move onto a ring on the first resize, 
+///        with migration driven by writes and moved copies freed from their donors
+TEST(Partitioner, ModuloResize) {
+    auto make_instance = [](std::string name, bool is_new) {
+        auto path_kv = std::string{"./test-kv-modulo-"} + name;
+        auto path_bf = std::string{"./test-bf-modulo-"} + name;
+        if (is_new) {
+            Truncate(path_kv);
+            Truncate(path_bf);
+        }
+        return new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            128,  4096   // ram_capacity, align
+        );
+    };
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(7);
+    auto to_arr = [](uint32_t xvalue) {
+        auto value = std::array<uint8_t, 4>();
+        memcpy(&value, &xvalue, sizeof(uint32_t));
+        return value;
+    };
+    auto write = [&](bloomstore::Partitioner& partitioner) {
+        auto key   = to_arr(random_number_generator.Sample() % 4096);
+        auto value = to_arr(random_number_generator.Sample());
+        if (random_number_generator.Sample() % 4 == 0) {
+            ground_truth.erase(key);
+            partitioner.Del(std::span{key});
+            return;
+        }
+        ground_truth[key] = value;
+        partitioner.Put(std::span{key}, std::span{value});
+    };
+    auto check = [&](bloomstore::Partitioner& partitioner) {
+        for (uint32_t x = 0; x < 4096; ++x) {
+            auto key = to_arr(x);
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = true;
+            partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+            ASSERT_EQ(ground_truth.contains(key), is_found && !is_tombstone) << x;
+            if (ground_truth.contains(key)) { ASSERT_EQ(ground_truth[key], value) << x; }
+        }
+    };
+    {
+        auto instances = std::vector<bloomstore::BloomStore*>();
+        for (char i = 'a'; i <= 'd'; ++i) { instances.push_back(make_instance(std::string{i}, true)); }
+        auto donors = instances;
+        auto partitioner = bloomstore::Partitioner(std::move(instances));
+        for (int i = 0; i < 50000; ++i) { write(partitioner); }
+        for (uint32_t x = 0; x < 4096; ++x) {
+            auto key = to_arr(x);
+            ASSERT_EQ(partitioner.Route(std::span{key}), bloomstore::Hash(std::span{key}, 'Z') % 4);
+        }
+        check(partitioner);
+        partitioner.AutoMigrate(20);
+        partitioner.AddPartition(make_instance("e", true));
+        ASSERT_TRUE(partitioner.IsMigrating());
+        for (int i = 0; i < 100000; ++i) {
+            write(partitioner);
+            if (i % 10000 == 0) { check(partitioner); }
+        }
+        ASSERT_FALSE(partitioner.IsMigrating());
+        check(partitioner);
+        // donors keep copies only in the few blocks sealed but not dumped at the resize
+        size_t nowned = 0;
+        size_t nstale = 0;
+        for (uint32_t partition = 0; partition < donors.size(); ++partition) {
+            auto addresses = std::vector<size_t>();
+            donors[partition]->ScanBlockAddresses(addresses);
+            for (auto address: addresses) {
+                donors[partition]->ScanBlock(address, [&](std::span<uint8_t> key, std::span<uint8_t>, bool) {
+                    if (partitioner.Route(key) == partition) { nowned += 1; }
+                    else { nstale += 1; }
+                });
+            }
+        }
+        ASSERT_GT(nowned, 0);
+        ASSERT_LT(nstale, nowned / 4);
+    }
+    // partitions written before a map file appears keep their routing
+    auto path_map = std::string{"./test-map-modulo"};
+    Truncate(path_map);
+    auto instances = std::vector<bloomstore::BloomStore*>();
+    for (char i = 'a'; i <= 'd'; ++i) { instances.push_back(make_instance(std::string{i}, false)); }
+    auto partitioner = bloomstore::Partitioner(std::move(instances), path_map);
+    for (uint32_t x = 0; x < 4096; ++x) {
+        auto key = to_arr(x);
+        ASSERT_EQ(partitioner.Route(std::span{key}), bloomstore::Hash(std::span{key}, 'Z') % 4);
+    }
+}
+
+/// @brief verify readers running alongside concurrent writers only see whole values, each newer than the last they saw, 
+///        while cached values written beforehand are dropped as keys are overwritten. 
+TEST(Partitioner, ConcurrentReaders) {
+    auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
+    for (char i = 'a'; i <= 'd'; ++i) {
+        auto path_kv = std::string{"./test-kv-concurrent-"} + i;
+        auto path_bf = std::string{"./test-bf-concurrent-"} + i;
+        Truncate(path_kv);
+        Truncate(path_bf);
+        bloom_store_replications.push_back(new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            128,  4096   // ram_capacity, align
+        ));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications));
+    auto cache = bloomstore::ReadCache(1 << 20);
+    partitioner.UseCache(cache);
+    const uint32_t nwriters = 2;
+    const uint32_t nreaders = 2;
+    const uint32_t nkeys = 1024;
+    auto versions = std::vector<std::vector<uint32_t>>(nwriters, std::vector<uint32_t>(nkeys, 1));
+    auto deleted = std::vector<std::vector<bool>>(nwriters, std::vector<bool>(nkeys, false));
+    for (uint32_t key = 0; key < nkeys * nwriters; ++key) {
+        uint32_t value = (1 << 12) | key;
+        partitioner.Put(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+    }
+    // concurrent writers start on empty active buffers
+    partitioner.Flush();
+    auto writers_done = std::atomic<bool>{false};
+    auto nerrors = std::atomic<size_t>{0};
+    auto readers = std::vector<std::thread>();
+    for (uint32_t t = 0; t < nreaders; ++t) {
+        readers.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(17 + t);
+            auto seen = std::vector<uint32_t>(nkeys * nwriters, 0);
+            while (!writers_done.load(std::memory_order_acquire)) {
+                uint32_t key = random_number_generator.Sample() % (nkeys * nwriters);
+                uint32_t value = 0;
+                bool is_tombstone = false;
+                bool is_found = false;
+                partitioner.ConcurrentGet(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+                if (!is_found || is_tombstone) { continue; }
+                if ((value & 0xfff) != key || (value >> 12) < seen[key]) { nerrors += 1; }
+                seen[key] = value >> 12;
+            }
+        });
+    }
+    auto writers = std::vector<std::thread>();
+    for (uint32_t t = 0; t < nwriters; ++t) {
+        writers.emplace_back([&, t]() {
+            auto random_number_generator = xorshift::XorShift32(5 + t);
+            for (int i = 0; i < 20000; ++i) {
+                uint32_t k = random_number_generator.Sample() % nkeys;
+                uint32_t key = k * nwriters + t;
+                if (random_number_generator.Sample() % 4 == 0) {
+                    deleted[t][k] = true;
+                    partitioner.ConcurrentDel(std::span{reinterpret_cast<uint8_t*>(&key), 4});
+                }
+                else {
+                    versions[t][k] += 1;
+                    deleted[t][k] = false;
+                    uint32_t value = (versions[t][k] << 12) | key;
+                    partitioner.ConcurrentPut(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4});
+                }
+            }
+        });
+    }
+    for (auto& writer: writers) { writer.join(); }
+    writers_done.store(true, std::memory_order_release);
+    for (auto& reader: readers) { reader.join(); }
+    ASSERT_EQ(0, nerrors.load());
+    partitioner.Flush();
+    for (uint32_t key = 0; key < nkeys * nwriters; ++key) {
+        uint32_t value = 0;
+        bool is_tombstone = true;
+        bool is_found = true;
+        partitioner.Get(std::span{reinterpret_cast<uint8_t*>(&key), 4}, std::span{reinterpret_cast<uint8_t*>(&value), 4}, is_tombstone, is_found);
+        if (!deleted[key % nwriters][key / nwriters]) {
+            ASSERT_TRUE(is_found && !is_tombstone) << key;
+            ASSERT_EQ((versions[key % nwriters][key / nwriters] << 12) | key, value);
+        }
+        else {
+            ASSERT_TRUE(is_tombstone || !is_found) << key;
+        }
+    }
+}
+
+/// @brief verify a parallel bulk load of unsorted records keeps the newest value of each key, and later writes override it
+TEST(Partitioner, BulkLoad) {
+    auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
+    for (char i = 'a'; i <= 'f'; ++i) {
+        auto path_kv = std::string{"./test-kv-bulk-"} + i;
+        auto path_bf = std::string{"./test-bf-bulk-"} + i;
+        Truncate(path_kv);
+        Truncate(path_bf);
+        bloom_store_replications.push_back(new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            128,  4096   // ram_capacity, align
+        ));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications));
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(5);
+    auto to_arr = [](uint32_t xvalue) {
+        auto value = std::array<uint8_t, 4>();
+        memcpy(&value, &xvalue, sizeof(uint32_t));
+        return value;
+    };
+    auto records = std::vector<uint8_t>();
+    for (int i = 0; i < 200000; ++i) {
+        auto key   = to_arr(random_number_generator.Sample() % 65536);
+        auto value = to_arr(random_number_generator.Sample());
+        ground_truth[key] = value;
+        records.insert(records.end(), key.begin(), key.end());
+        records.insert(records.end(), value.begin(), value.end());
+    }
+    partitioner.BulkLoad(std::span{records}, 4);
+    for (int i = 0; i < 1000; ++i) {
+        auto key   = to_arr(random_number_generator.Sample() % 65536);
+        auto value = to_arr(random_number_generator.Sample());
+        ground_truth[key] = value;
+        partitioner.Put(std::span{key}, std::span{value});
+    }
+    for (uint32_t k = 0; k < 65536; ++k) {
+        auto key = to_arr(k);
+        auto value = std::array<uint8_t, 4>();
+        bool is_tombstone = true;
+        bool is_found = true;
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        if (ground_truth.contains(key)) {
+            ASSERT_TRUE(is_found && !is_tombstone) << k;
+            ASSERT_EQ(ground_truth[key], value);
+        }
+        else {
+            ASSERT_TRUE(is_tombstone || !is_found);
+        }
+    }
+}
+
+/// @brief verify a file loaded in many small chunks keeps the newest value of each key, even across chunks
+TEST(Partitioner, BulkLoadFile) {
+    auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
+    for (char i = 'a'; i <= 'd'; ++i) {
+        auto path_kv = std::string{"./test-kv-bulkfile-"} + i;
+        auto path_bf = std::string{"./test-bf-bulkfile-"} + i;
+        Truncate(path_kv);
+        Truncate(path_bf);
+        bloom_store_replications.push_back(new bloomstore::BloomStore(
+            path_kv, path_bf,
+            1024, 5,     // bf_slots, bf_functions
+            4,    4,     // key_bytes, value_bytes
+            128,  4096   // ram_capacity, align
+        ));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications));
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(11);
+    auto to_arr = [](uint32_t xvalue) {
+        auto value = std::array<uint8_t, 4>();
+        memcpy(&value, &xvalue, sizeof(uint32_t));
+        return value;
+    };
+    auto path = std::string{"./test-records-bulkfile"};
+    auto out = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    for (int i = 0; i < 50000; ++i) {
+        auto key   = to_arr(random_number_generator.Sample() % 8192);
+        auto value = to_arr(random_number_generator.Sample());
+        ground_truth[key] = value;
+        out.write(reinterpret_cast<char*>(key.data()), key.size());
+        out.write(reinterpret_cast<char*>(value.data()), value.size());
+    }
+    out.close();
+    // chunks of 1250 records, not a whole number of blocks
+    partitioner.BulkLoad(path, 3, 10001);
+    for (uint32_t k = 0; k < 8192; ++k) {
+        auto key = to_arr(k);
+        auto value = std::array<uint8_t, 4>();
+        bool is_tombstone = true;
+        bool is_found = true;
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        ASSERT_EQ(ground_truth.contains(key), is_found && !is_tombstone) << k;
+        if (ground_truth.contains(key)) { ASSERT_EQ(ground_truth[key], value) << k; }
+    }
+}
+
+}
@@ -0,0 +1,70 @@
+#include<gtest/gtest.h>
+#include<placement.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<unordered_map>
+
+namespace {
+
+void Truncate(std::string path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+std::vector<std::string> MakeDirectories(std::string prefix, int n) {
+    auto directories = std::vector<std::string>();
+    for (int i = 0; i < n; ++i) {
+        auto directory = prefix + std::to_string(i);
+        mkdir(directory.c_str(), S_IRWXU);
+        directories.push_back(directory);
+    }
+    return directories;
+}
+
+/// @brief verify new files are spread over devices proportional to weights
+TEST(Placement, WeightedRoundRobin) {
+    auto directories = MakeDirectories("./test-placement-weighted-", 3);
+    auto weights = std::vector<size_t>{1, 2, 3};
+    auto placement = bloomstore::Placement(directories, weights, 4);
+    auto count = std::unordered_map<Device*, int>();
+    auto order = std::vector<Device*>();
+    for (int i = 0; i < 600; ++i) {
+        auto name = std::string{"never-created-"} + std::to_string(i);
+        auto device = placement.Place(name);
+        if (!count.contains(device)) { order.push_back(device); }
+        count[device] += 1;
+    }
+    ASSERT_EQ(order.size(), 3);
+    std::sort(order.begin(), order.end(), [&](auto a, auto b) { return count[a] < count[b]; });
+    ASSERT_EQ(count[order[0]], 100);
+    ASSERT_EQ(count[order[1]], 200);
+    ASSERT_EQ(count[order[2]], 300);
+}
+
+/// @brief verify existing files are found on the device they were placed on
+TEST(Placement, ExistingFilesStay) {
+    auto directories = MakeDirectories("./test-placement-sticky-", 4);
+    auto weights = std::vector<size_t>{1, 1, 1, 1};
+    auto placed = std::vector<std::string>();
+    {
+        auto placement = bloomstore::Placement(directories, weights, 4);
+        for (int i = 0; i < 16; ++i) {
+            auto name = std::string{"test-kv-"} + std::to_string(i);
+            auto path = placement.Place(name)->Path(name);
+            Truncate(path);
+            placed.push_back(path);
+        }
+    }
+    // a different weighting must not move anything already placed
+    weights = std::vector<size_t>{0, 0, 0, 1};
+    auto placement = bloomstore::Placement(directories, weights, 4);
+    for (int i = 0; i < 16; ++i) {
+        auto name = std::string{"test-kv-"} + std::to_string(i);
+        ASSERT_EQ(placement.Place(name)->Path(name), placed[i]);
+    }
+}
+
+}
@@ -0,0 +1,136 @@
+#include<gtest/gtest.h>
+#include<port.hpp>
+#include<cstdint>
+#include<sched.h>
+#include<thread>
+#include<chrono>
+#include<mutex>
+
+namespace {
+
+/// @brief verify pooled buffers are page aligned and reused once returned
+TEST(BufferPool, AlignedReuse) {
+    auto& pool = BufferPool::Local();
+    void* first = nullptr;
+    {
+        auto buffer = AlignedBuffer<uint8_t>(5000, 0);
+        first = buffer.data();
+        ASSERT_EQ(0, reinterpret_cast<uintptr_t>(buffer.data()) % BufferPool::ALIGN);
+        ASSERT_EQ(5000, buffer.size());
+        ASSERT_EQ(0, buffer[4999]);
+    }
+    ASSERT_GE(pool.CachedBytes(), 8192);
+    // the same size class is handed out again
+    auto buffer = AlignedBuffer<uint64_t>(1000);
+    ASSERT_EQ(first, static_cast<void*>(buffer.data()));
+    auto copy = buffer;
+    ASSERT_NE(copy.data(), buffer.data());
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(copy.data()) % BufferPool::ALIGN);
+}
+
+/// @brief verify a buffer outliving its thread goes back to that thread's pool, not to the pool of the thread freeing it
+TEST(BufferPool, OutlivesThread) {
+    auto& pool = BufferPool::Local();
+    auto buffer = AlignedBuffer<uint8_t>(0);
+    std::thread([&]() { buffer = AlignedBuffer<uint8_t>(3 << 20, 7); }).join();
+    ASSERT_EQ(7, buffer[(3 << 20) - 1]);
+    auto cached_bytes = pool.CachedBytes();
+    buffer = AlignedBuffer<uint8_t>(0);
+    ASSERT_EQ(cached_bytes, pool.CachedBytes());
+}
+
+/// @brief verify idle buffers placed for one node are not handed out after the pool moves to another
+TEST(BufferPool, KeepsNode) {
+    auto& pool = BufferPool::Local();
+    { auto buffer = AlignedBuffer<uint8_t>(5000); }
+    ASSERT_GT(pool.CachedBytes(), 0);
+    pool.UseNode(0);
+    ASSERT_EQ(0, pool.CachedBytes());
+    // a buffer borrowed before the move comes back placed for the old node and is freed
+    auto buffer = AlignedBuffer<uint8_t>(0);
+    pool.UseNode(-1);
+    buffer = AlignedBuffer<uint8_t>(5000);
+    pool.UseNode(0);
+    buffer = AlignedBuffer<uint8_t>(0);
+    ASSERT_EQ(0, pool.CachedBytes());
+    { auto local = AlignedBuffer<uint8_t>(5000); }
+    ASSERT_GT(pool.CachedBytes(), 0);
+    pool.UseNode(-1);
+}
+
+/// @brief verify topology is readable and pinning keeps the thread runnable
+TEST(Numa, PinToEveryNode) {
+    ASSERT_GE(Numa::Nodes(), 1);
+    cpu_set_t affinity;
+    sched_getaffinity(0, sizeof(affinity), &affinity);
+    for (size_t node = 0; node < Numa::Nodes(); ++node) {
+        auto cpus = std::vector<int>();
+        Numa::Cpus(node, cpus);
+        if (cpus.empty()) { continue; }
+        Numa::Pin(node);
+        auto buffer = AlignedBuffer<uint8_t>(1 << 16, 1);
+        buffer.Bind(node);
+        ASSERT_EQ(1, buffer[(1 << 16) - 1]);
+    }
+    BufferPool::Local().UseNode(-1);
+    sched_setaffinity(0, sizeof(affinity), &affinity);
+}
+
+/// @brief verify a freed slot goes to the waiting request of the highest class, not the longest waiting one
+TEST(Device, PriorityOrder) {
+    auto directory = std::string{"."};
+    auto device = Device(directory, 1);
+    auto order = std::vector<IOClass>();
+    auto order_mutex = std::mutex();
+    device.Acquire(IOClass::Foreground);
+    auto waiters = std::vector<std::thread>();
+    for (auto io_class: {IOClass::Background, IOClass::Flush, IOClass::Foreground}) {
+        waiters.emplace_back([&, io_class]() {
+            device.Acquire(io_class);
+            { auto lock = std::unique_lock(order_mutex); order.push_back(io_class); }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            device.Release(io_class);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    device.Release(IOClass::Foreground);
+    for (auto& waiter: waiters) { waiter.join(); }
+    ASSERT_EQ((std::vector{IOClass::Foreground, IOClass::Flush, IOClass::Background}), order);
+}
+
+/// @brief verify a capped class can't take more slots than its cap, while other classes still can
+TEST(Device, SlotCap) {
+    auto directory = std::string{"."};
+    auto device = Device(directory, 4);
+    device.Limit(IOClass::Flush, 0, 1);
+    ASSERT_TRUE(device.TryAcquire(IOClass::Flush));
+    ASSERT_FALSE(device.TryAcquire(IOClass::Flush));
+    ASSERT_TRUE(device.TryAcquire(IOClass::Foreground));
+    ASSERT_TRUE(device.TryAcquire(IOClass::Background));
+    device.Release(IOClass::Flush);
+    ASSERT_TRUE(device.TryAcquire(IOClass::Flush));
+}
+
+/// @brief verify a rate limited class is held to its rate once its burst is spent, and other classes are not
+TEST(Device, RateLimit) {
+    auto directory = std::string{"."};
+    auto device = Device(directory, 8);
+    device.Limit(IOClass::Background, 1 << 20, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; ++i) {
+        device.Acquire(IOClass::Foreground, 1 << 20);
+        device.Release(IOClass::Foreground);
+    }
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+    start = std::chrono::steady_clock::now();
+    // 640KiB at 1MiB/s, less the burst of 0.1s
+    for (int i = 0; i < 10; ++i) {
+        device.Acquire(IOClass::Background, 64 << 10);
+        device.Release(IOClass::Background);
+    }
+    ASSERT_GT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(400));
+    ASSERT_TRUE(device.TryAcquire(IOClass::Foreground));
+    ASSERT_FALSE(device.TryAcquire(IOClass::Background));
+}
+
+}
@@ -0,0 +1,206 @@
+#include<gtest/gtest.h>
+#include<partitioner.hpp>
+#include<read_cache.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<array>
+#include<unordered_map>
+#include<thread>
+#include<chrono>
+#include"./xorshift.hpp"
+
+namespace {
+
+template<int const N>
+struct KeyHasher {
+    std::size_t operator()(const std::array<uint8_t, N>& a) const {
+        std::size_t h = 0;
+        for (auto e : a) {
+            h ^= std::hash<int>{}(e)  + 0x9e3779b9 + (h << 6) + (h >> 2); 
+        }
+        return h;
+    }   
+};
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+std::array<uint8_t, 4> to_arr(uint32_t xvalue) {
+    auto value = std::array<uint8_t, 4>();
+    memcpy(&value, &xvalue, sizeof(uint32_t));
+    return value;
+}
+
+bloomstore::BloomStore* MakeInstance(std::string name) {
+    auto path_kv = std::string{"./test-kv-cache-"} + name;
+    auto path_bf = std::string{"./test-bf-cache-"} + name;
+    Truncate(path_kv);
+    Truncate(path_bf);
+    return new bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 5,      // bf_slots, bf_functions
+        4,   4,      // key_bytes, value_bytes
+        64,  4096    // ram_capacity, align
+    );
+}
+
+/// @brief verify reads through a (negative) cache stay correct under puts, deletes and batches
+TEST(ReadCache, Correctness) {
+    auto instances = std::vector<bloomstore::BloomStore*>();
+    for (int i = 0; i < 4; ++i) {
+        instances.push_back(MakeInstance(std::to_string(i)));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(instances));
+    auto cache = bloomstore::ReadCache(8 << 10, 4, true);
+    partitioner.UseCache(cache);
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(13);
+    for (int i = 0; i < 100000; ++i) {
+        auto action = random_number_generator.Sample() % 8;
+        // skewed keys, so some get hot enough to be admitted
+        auto key    = to_arr(random_number_generator.Sample() % (i % 2 ? 16 : 1024));
+        auto value  = to_arr(random_number_generator.Sample());
+        switch (action) {
+            case 0: {
+                ground_truth[key] = value;
+                partitioner.Put(std::span{key}, std::span{value});
+                break;
+            }
+            case 1: {
+                ground_truth.erase(key);
+                partitioner.Del(std::span{key});
+                break;
+            }
+            case 2: {
+                auto batch = bloomstore::WriteBatch(4, 4);
+                ground_truth[key] = value;
+                batch.Put(std::span{key}, std::span{value});
+                partitioner.Write(batch);
+                break;
+            }
+            default: {
+                auto value = std::array<uint8_t, 4>();
+                bool is_tombstone = false;
+                bool is_found = false;
+                partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+                ASSERT_EQ(ground_truth.contains(key), is_found && !is_tombstone);
+                if (ground_truth.contains(key)) { ASSERT_EQ(ground_truth[key], value); }
+                break;
+            }
+        }
+    }
+    ASSERT_GT(cache.stat_hit.load(), 0);
+    ASSERT_LE(cache.Bytes(), 8 << 10);
+}
+
+/// @brief verify cached values expire with their entries, before and after their chains are freed
+TEST(ReadCache, TTL) {
+    auto instances = std::vector<bloomstore::BloomStore*>();
+    for (int i = 0; i < 2; ++i) {
+        instances.push_back(MakeInstance(std::string{"ttl-"} + std::to_string(i)));
+        auto path_times = std::string{"./test-times-cache-ttl-"} + std::to_string(i);
+        Truncate(path_times);
+        instances.back()->UseTTL(path_times, 300);
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(instances));
+    auto cache = bloomstore::ReadCache(1 << 20, 4);
+    partitioner.UseCache(cache);
+    auto value = std::array<uint8_t, 4>();
+    bool is_tombstone = false;
+    bool is_found = false;
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        partitioner.Put(std::span{key}, std::span{key});
+    }
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        ASSERT_TRUE(is_found && !is_tombstone && value == key) << k;
+    }
+    // enough later keys that the first chain of both partitions is dumped
+    for (uint32_t k = 256; k < 12288; ++k) {
+        auto key = to_arr(k);
+        partitioner.Put(std::span{key}, std::span{key});
+    }
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        ASSERT_TRUE(cache.Get(std::span{key}, std::span{value}, is_found)) << k;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        ASSERT_FALSE(cache.Get(std::span{key}, std::span{value}, is_found)) << k;
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        ASSERT_FALSE(is_found && !is_tombstone) << k;
+    }
+    ASSERT_TRUE(partitioner.Expire(SIZE_MAX));
+    for (uint32_t k = 0; k < 256; ++k) {
+        auto key = to_arr(k);
+        partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+        ASSERT_FALSE(is_found && !is_tombstone) << k;
+    }
+    // a value written through expires no earlier than ttl after the write
+    auto key = to_arr(0);
+    partitioner.Put(std::span{key}, std::span{value});
+    partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+    partitioner.Put(std::span{key}, std::span{key});
+    ASSERT_TRUE(cache.Get(std::span{key}, std::span{value}, is_found));
+    ASSERT_TRUE(is_found && value == key);
+}
+
+/// @brief verify a cold key doesn't push out a hot one
+TEST(ReadCache, Admission) {
+    // room for 4 entries of 4-byte keys and values
+    auto cache = bloomstore::ReadCache(450, 1);
+    auto value = to_arr(7);
+    for (uint32_t k = 0; k < 4; ++k) {
+        auto key = to_arr(k);
+        bool is_found = false;
+        for (int i = 0; i < 8; ++i) { cache.Get(std::span{key}, std::span{value}, is_found); }
+        cache.Admit(std::span{key}, std::span{value}, true);
+    }
+    auto cold = to_arr(1000);
+    bool is_found = false;
+    ASSERT_FALSE(cache.Get(std::span{cold}, std::span{value}, is_found));
+    cache.Admit(std::span{cold}, std::span{value}, true);
+    ASSERT_FALSE(cache.Get(std::span{cold}, std::span{value}, is_found));
+    for (uint32_t k = 0; k < 4; ++k) {
+        auto key = to_arr(k);
+        ASSERT_TRUE(cache.Get(std::span{key}, std::span{value}, is_found));
+        ASSERT_TRUE(is_found);
+    }
+}
+
+/// @brief verify writing through to keys cached as absent keeps the shard in its budget
+TEST(ReadCache, UpdateNegative) {
+    // room for 4 absent 4-byte keys, exactly
+    auto cache = bloomstore::ReadCache(400, 1, true);
+    auto value = to_arr(7);
+    for (uint32_t k = 0; k < 4; ++k) {
+        auto key = to_arr(k);
+        bool is_found = false;
+        cache.Get(std::span{key}, std::span{value}, is_found);
+        cache.Admit(std::span{key}, std::span{value}, false);
+    }
+    ASSERT_EQ(400, cache.Bytes());
+    for (uint32_t k = 0; k < 4; ++k) {
+        auto key = to_arr(k);
+        cache.Update(std::span{key}, std::span{value});
+        ASSERT_LE(cache.Bytes(), 400);
+    }
+    // whatever is still cached holds the written value
+    for (uint32_t k = 0; k < 4; ++k) {
+        auto key = to_arr(k);
+        auto read = to_arr(0);
+        bool is_found = false;
+        if (!cache.Get(std::span{key}, std::span{read}, is_found)) { continue; }
+        ASSERT_TRUE(is_found);
+        ASSERT_EQ(value, read);
+    }
+}
+
+}
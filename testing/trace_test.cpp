@@ -0,0 +1,92 @@
+#include<gtest/gtest.h>
+#include<partitioner.hpp>
+#include<trace.hpp>
+#include<merge_operator.hpp>
+#include<hashing.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<array>
+#include<map>
+#include"./xorshift.hpp"
+
+namespace {
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+bloomstore::BloomStore* MakeInstance(std::string name) {
+    auto path_kv = std::string{"./test-kv-trace-"} + name;
+    auto path_bf = std::string{"./test-bf-trace-"} + name;
+    Truncate(path_kv);
+    Truncate(path_bf);
+    return new bloomstore::BloomStore(
+        path_kv, path_bf,
+        512, 5,      // bf_slots, bf_functions
+        4,   4,      // key_bytes, value_bytes
+        64,  4096    // ram_capacity, align
+    );
+}
+
+/// @brief verify operations through partitioner read back from trace in order, with keys or stand-ins
+TEST(Trace, RecordReadBack) {
+    for (bool record_keys: {true, false}) {
+        auto path_trace = std::string{"./test-trace"};
+        auto expected = std::vector<std::pair<bloomstore::TraceOp, std::array<uint8_t, 4>>>();
+        {
+            auto merge_operator = bloomstore::AddOperator();
+            auto instances = std::vector<bloomstore::BloomStore*>();
+            for (int i = 0; i < 2; ++i) {
+                instances.push_back(MakeInstance(std::to_string(i)));
+                instances.back()->UseMergeOperator(merge_operator);
+            }
+            auto partitioner = bloomstore::Partitioner(std::move(instances));
+            auto recorder = bloomstore::TraceRecorder(path_trace, 4, 4, record_keys);
+            partitioner.UseRecorder(recorder);
+            auto random_number_generator = xorshift::XorShift32(17);
+            auto value = std::array<uint8_t, 4>();
+            for (int i = 0; i < 5000; ++i) {
+                auto key = std::array<uint8_t, 4>();
+                uint32_t k = random_number_generator.Sample() % 64;
+                memcpy(&key, &k, sizeof(k));
+                auto op = static_cast<bloomstore::TraceOp>(random_number_generator.Sample() % 4);
+                bool is_tombstone = false, is_found = false;
+                switch (op) {
+                    case bloomstore::TraceOp::Put: partitioner.Put(std::span{key}, std::span{value}); break;
+                    case bloomstore::TraceOp::Del: partitioner.Del(std::span{key}); break;
+                    case bloomstore::TraceOp::Get: partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found); break;
+                    case bloomstore::TraceOp::Merge: partitioner.Merge(std::span{key}, std::span{value}); break;
+                }
+                expected.push_back({op, key});
+            }
+        }
+        auto reader = bloomstore::TraceReader(path_trace);
+        ASSERT_EQ(4, reader.KeyBytes());
+        ASSERT_EQ(4, reader.ValueBytes());
+        auto entry = bloomstore::TraceEntry();
+        auto stand_ins = std::map<std::array<uint8_t, 4>, std::vector<uint8_t>>();
+        uint64_t timestamp = 0;
+        for (auto& [op, key]: expected) {
+            ASSERT_TRUE(reader.Next(entry));
+            ASSERT_EQ(op, entry.op);
+            ASSERT_GE(entry.timestamp, timestamp);
+            timestamp = entry.timestamp;
+            if (record_keys) {
+                ASSERT_EQ(std::vector<uint8_t>(key.begin(), key.end()), entry.key);
+            }
+            else {
+                // a key is always replayed as the same stand-in
+                if (!stand_ins.contains(key)) { stand_ins[key] = entry.key; }
+                ASSERT_EQ(stand_ins[key], entry.key);
+                // and it routes like the recorded key
+                ASSERT_EQ(bloomstore::Hash(std::span{key}, 'Z'), bloomstore::Hash(std::span{entry.key}, 'Z'));
+            }
+        }
+        ASSERT_FALSE(reader.Next(entry));
+    }
+}
+
+}
@@ -0,0 +1,138 @@
+#include<gtest/gtest.h>
+#include<partitioner.hpp>
+#include<write_batch.hpp>
+#include<unistd.h>
+#include<fcntl.h>
+#include<unordered_map>
+#include"./xorshift.hpp"
+
+namespace {
+
+template<int const N>
+struct KeyHasher {
+    std::size_t operator()(const std::array<uint8_t, N>& a) const {
+        std::size_t h = 0;
+        for (auto e : a) {
+            h ^= std::hash<int>{}(e)  + 0x9e3779b9 + (h << 6) + (h >> 2); 
+        }
+        return h;
+    }   
+};
+
+void Truncate(std::string& path) {
+    int fd = open(path.c_str(), O_CREAT|O_TRUNC, S_IRWXU);
+    assert(fd >= 0);
+    int error_code = close(fd);
+    assert(error_code == 0);
+}
+
+std::array<uint8_t, 4> to_arr(uint32_t xvalue) {
+    auto value = std::array<uint8_t, 4>();
+    memcpy(&value, &xvalue, sizeof(uint32_t));
+    return value;
+}
+
+bloomstore::BloomStore* MakeInstance(std::string name) {
+    auto path_kv = std::string{"./test-kv-batch-"} + name;
+    auto path_bf = std::string{"./test-bf-batch-"} + name;
+    Truncate(path_kv);
+    Truncate(path_bf);
+    return new bloomstore::BloomStore(
+        path_kv, path_bf,
+        1024, 5,     // bf_slots, bf_functions
+        4,    4,     // key_bytes, value_bytes
+        256,  4096   // ram_capacity, align
+    );
+}
+
+/// @brief verify batches of puts and deletes read back like single writes
+TEST(WriteBatch, Correctness) {
+    auto bloom_store_replications = std::vector<bloomstore::BloomStore*>();
+    for (int i = 0; i < 8; ++i) {
+        bloom_store_replications.push_back(MakeInstance(std::to_string(i)));
+    }
+    auto partitioner = bloomstore::Partitioner(std::move(bloom_store_replications));
+    auto ground_truth = std::unordered_map<std::array<uint8_t, 4>, std::array<uint8_t, 4>, KeyHasher<4>>();
+    auto random_number_generator = xorshift::XorShift32(5);
+    for (int round = 0; round < 100; ++round) {
+        auto batch = bloomstore::WriteBatch(4, 4, round % 2 == 0);
+        auto nentries = random_number_generator.Sample() % 3000;
+        auto pending = ground_truth;
+        for (uint32_t i = 0; i < nentries; ++i) {
+            auto key   = to_arr(random_number_generator.Sample() % 8192);
+            auto value = to_arr(random_number_generator.Sample());
+            if (random_number_generator.Sample() % 4 == 0) {
+                pending.erase(key);
+                batch.Del(std::span{key});
+            }
+            else {
+                pending[key] = value;
+                batch.Put(std::span{key}, std::span{value});
+            }
+        }
+        // an atomic batch giving some partition more than a block is rejected as a whole
+        bool is_applied = partitioner.Write(batch);
+        ASSERT_TRUE(is_applied || round % 2 == 0);
+        if (is_applied) { ground_truth = std::move(pending); }
+        for (int i = 0; i < 200; ++i) {
+            auto key   = to_arr(random_number_generator.Sample() % 8192);
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = true;
+            partitioner.Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+            if (ground_truth.contains(key)) {
+                ASSERT_TRUE(is_found && !is_tombstone);
+                ASSERT_EQ(ground_truth[key], value);
+            }
+            else {
+                ASSERT_TRUE(is_tombstone || !is_found);
+            }
+        }
+    }
+}
+
+/// @brief verify an atomic batch seals the active buffer first instead of straddling two blocks
+TEST(WriteBatch, AtomicSliceInOneBlock) {
+    for (bool atomic: {false, true}) {
+        auto bloom_store = std::unique_ptr<bloomstore::BloomStore>(MakeInstance(atomic ? "atomic" : "plain"));
+        for (uint32_t i = 0; i < 200; ++i) {
+            auto key = to_arr(i);
+            bloom_store->Put(std::span{key}, std::span{key});
+        }
+        auto batch = bloomstore::WriteBatch(4, 4, atomic);
+        for (uint32_t i = 200; i < 300; ++i) {
+            auto key = to_arr(i);
+            batch.Put(std::span{key}, std::span{key});
+        }
+        bloom_store->Write(batch, 0, batch.Size());
+        auto addresses = std::vector<size_t>();
+        bloom_store->ScanBlockAddresses(addresses);
+        ASSERT_EQ(addresses.size(), 1);
+        size_t nentries = 0;
+        bloom_store->ScanBlock(addresses[0], [&](auto, auto, bool) { nentries += 1; });
+        ASSERT_EQ(nentries, atomic ? 200 : 256);
+    }
+}
+
+/// @brief verify an atomic slice larger than a block is rejected as a whole, while a plain one is split
+TEST(WriteBatch, OversizedAtomicSlice) {
+    for (bool atomic: {false, true}) {
+        auto bloom_store = std::unique_ptr<bloomstore::BloomStore>(MakeInstance(atomic ? "oversized-atomic" : "oversized-plain"));
+        auto batch = bloomstore::WriteBatch(4, 4, atomic);
+        for (uint32_t i = 0; i < 300; ++i) {
+            auto key = to_arr(i);
+            batch.Put(std::span{key}, std::span{key});
+        }
+        ASSERT_EQ(!atomic, bloom_store->Write(batch, 0, batch.Size()));
+        for (uint32_t i = 0; i < 300; i += 10) {
+            auto key = to_arr(i);
+            auto value = std::array<uint8_t, 4>();
+            bool is_tombstone = true;
+            bool is_found = true;
+            bloom_store->Get(std::span{key}, std::span{value}, is_tombstone, is_found);
+            ASSERT_EQ(!atomic, is_found && !is_tombstone) << i;
+        }
+    }
+}
+
+}